@@ -0,0 +1,291 @@
+#pragma once
+
+#include <Rtypes.h>
+
+#include <vector>
+#include <type_traits>
+#include <cstring>
+
+
+/// Storage policy for read buffers that can hold up to capacity objects
+template<unsigned capacity>
+struct ArrayStorage
+{
+    template<typename T>
+    using Type = T[capacity];
+};
+
+
+/// Storage policy for a single value, used for per-event quantities in read buffers
+struct ValueStorage
+{
+    template<typename T>
+    using Type = T;
+};
+
+
+/// Storage policy for pointers to arrays stored elsewhere
+struct PointerStorage
+{
+    template<typename T>
+    using Type = T const *;
+};
+
+
+/// Storage policy for growing columns
+struct ColumnStorage
+{
+    template<typename T>
+    using Type = std::vector<T>;
+};
+
+
+/**
+ * \brief Groups of branches that are read together
+ * 
+ * The values are bit flags. Each collection and each per-event quantity belongs to exactly one
+ * group, except for the isolation of leptons. It is rarely used and forms a separate group so that
+ * the learning mode of the Reader can drop it (see BranchSchema::FieldGroup).
+ */
+enum BranchGroup: unsigned
+{
+    bgLeptons = 1 << 0,
+    bgJets = 1 << 1,
+    bgJetsJECUp = 1 << 2,
+    bgJetsJECDown = 1 << 3,
+    bgMET = 1 << 4,
+    bgMETJECUp = 1 << 5,
+    bgMETJECDown = 1 << 6,
+    bgNumPV = 1 << 7,
+    bgWeight = 1 << 8,
+    bgLeptonIsolation = 1 << 9
+};
+
+
+/**
+ * \struct LeptonFields
+ * \brief Properties of leptons, stored according to the given policy
+ * 
+ * The list of fields is visited with BranchSchema::ForEachLeptonField, which must be updated
+ * together with it.
+ */
+template<typename Storage>
+struct LeptonFields
+{
+    /// Kinematics and isolation
+    typename Storage::template Type<Float_t> pt, eta, phi, isolation;
+    
+    /// Flavour encoded with PDG ID codes
+    typename Storage::template Type<Int_t> flavour;
+};
+
+
+/**
+ * \struct JetFields
+ * \brief Properties of jets, stored according to the given policy
+ * 
+ * The list of fields is visited with BranchSchema::ForEachJetField, which must be updated together
+ * with it.
+ */
+template<typename Storage>
+struct JetFields
+{
+    /// Kinematics and value of the b-tagging discriminator
+    typename Storage::template Type<Float_t> pt, eta, phi, bTag;
+    
+    /// Flavour encoded with PDG ID codes, zero if not known
+    typename Storage::template Type<Int_t> flavour;
+};
+
+
+/**
+ * \struct EventFields
+ * \brief Per-event quantities, stored according to the given policy
+ * 
+ * The list of fields is visited with BranchSchema::ForEachEventField, which must be updated
+ * together with it.
+ */
+template<typename Storage>
+struct EventFields
+{
+    /// MET, nominal and with JEC variations
+    typename Storage::template Type<Float_t> metPt, metPhi, metJECUpPt, metJECUpPhi,
+     metJECDownPt, metJECDownPhi;
+    
+    /// Number of reconstructed primary vertices
+    typename Storage::template Type<Int_t> nPV;
+    
+    /// Raw event weight as stored in the source tree
+    typename Storage::template Type<Float_t> rawWeight;
+};
+
+
+/**
+ * \class BranchSchema
+ * \brief Compile-time description of the branches of the source trees
+ * 
+ * Properties of leptons, jets, and per-event quantities are listed once, in the class templates
+ * LeptonFields, JetFields, and EventFields. They are instantiated with different storage
+ * policies to obtain the read buffers of the Reader and SkimWriter, the descriptions of
+ * collections used by the object views, and the columns of EventBatch and FlatEventFile. Code
+ * that binds, copies, or writes the fields does not list them but calls a visitor for each field
+ * with the methods of this class. This way a new field only needs to be added to a list and to the
+ * corresponding visiting method.
+ * 
+ * A visitor is called with the description of the field followed by the fields of all given
+ * records in the same order. For fields of a collection, the description is the suffix that gives
+ * the name of the branch when appended to the prefix of the collection. For per-event fields, it
+ * is an object of type EventField.
+ */
+class BranchSchema
+{
+public:
+    /// Description of the branches of a collection of objects
+    struct Collection
+    {
+        /// Name of the branch with the number of objects
+        char const *sizeName;
+        
+        /// Prefix added to suffixes of the fields to obtain names of the branches
+        char const *prefix;
+        
+        /// Group to which the branches belong
+        BranchGroup group;
+        
+        /// Indicates that the branches exist in simulation only
+        bool mcOnly;
+    };
+    
+    /**
+     * \brief Adapts a callback to serve as a visitor of read buffers
+     * 
+     * The callback is called with the description of the field, the address of the buffer, its
+     * size in bytes, and the code of the type of its elements as used in leaf lists of ROOT trees.
+     * Objects are created with the method VisitBuffers.
+     */
+    template<typename Callback>
+    class BufferVisitor
+    {
+    public:
+        /// Constructor from the callback
+        BufferVisitor(Callback const &callback_):
+            callback(callback_)
+        {}
+        
+    public:
+        template<typename Field, typename T>
+        void operator()(Field const &field, T &buffer) const
+        {
+            typedef typename std::remove_extent<T>::type Element;
+            callback(field, &buffer, unsigned(sizeof(buffer)),
+             LeafCode(static_cast<Element const *>(nullptr)));
+        }
+        
+    private:
+        Callback callback;
+    };
+    
+    /// Description of a branch with a per-event quantity
+    struct EventField
+    {
+        /// Name of the branch
+        char const *name;
+        
+        /// Group to which the branch belongs
+        BranchGroup group;
+        
+        /// Indicates that the branch exists in simulation only
+        bool mcOnly;
+    };
+    
+public:
+    /// Collection of leptons
+    static constexpr Collection Leptons() noexcept
+    {
+        return {"nlepton", "lept_", bgLeptons, false};
+    }
+    
+    /// Nominal collection of jets
+    static constexpr Collection Jets() noexcept
+    {
+        return {"njets", "jet_", bgJets, false};
+    }
+    
+    /// Collections of jets with JEC variations
+    static constexpr Collection JetsJECUp() noexcept
+    {
+        return {"jesup_njets", "jet_jesup_", bgJetsJECUp, true};
+    }
+    
+    static constexpr Collection JetsJECDown() noexcept
+    {
+        return {"jesdown_njets", "jet_jesdown_", bgJetsJECDown, true};
+    }
+    
+    /// Returns the code of the type of a field used in leaf lists of ROOT trees
+    static constexpr char LeafCode(Float_t const *) noexcept
+    {
+        return 'F';
+    }
+    
+    static constexpr char LeafCode(Int_t const *) noexcept
+    {
+        return 'I';
+    }
+    
+    /**
+     * \brief Returns the group of the field of the collection with the given suffix
+     * 
+     * Fields belong to the group of their collection, except for the isolation of leptons.
+     */
+    static BranchGroup FieldGroup(Collection const &collection, char const *suffix) noexcept
+    {
+        if (collection.group == bgLeptons and std::strcmp(suffix, "iso") == 0)
+            return bgLeptonIsolation;
+        else
+            return collection.group;
+    }
+    
+    /// Creates a visitor of read buffers that calls the given callback
+    template<typename Callback>
+    static BufferVisitor<Callback> VisitBuffers(Callback const &callback)
+    {
+        return BufferVisitor<Callback>(callback);
+    }
+    
+    /// Calls the visitor for each field of the given LeptonFields records
+    template<typename Visitor, typename... Records>
+    static void ForEachLeptonField(Visitor &&visit, Records &&...records)
+    {
+        visit("pt", records.pt...);
+        visit("eta", records.eta...);
+        visit("phi", records.phi...);
+        visit("iso", records.isolation...);
+        visit("flav", records.flavour...);
+    }
+    
+    /// Calls the visitor for each field of the given JetFields records
+    template<typename Visitor, typename... Records>
+    static void ForEachJetField(Visitor &&visit, Records &&...records)
+    {
+        visit("pt", records.pt...);
+        visit("eta", records.eta...);
+        visit("phi", records.phi...);
+        visit("btagdiscri", records.bTag...);
+        visit("flav", records.flavour...);
+    }
+    
+    /// Calls the visitor for each field of the given EventFields records
+    template<typename Visitor, typename... Records>
+    static void ForEachEventField(Visitor &&visit, Records &&...records)
+    {
+        visit(EventField{"met_pt", bgMET, false}, records.metPt...);
+        visit(EventField{"met_phi", bgMET, false}, records.metPhi...);
+        visit(EventField{"met_jesup_pt", bgMETJECUp, true}, records.metJECUpPt...);
+        visit(EventField{"met_jesup_phi", bgMETJECUp, true}, records.metJECUpPhi...);
+        visit(EventField{"met_jesdown_pt", bgMETJECDown, true}, records.metJECDownPt...);
+        visit(EventField{"met_jesdown_phi", bgMETJECDown, true}, records.metJECDownPhi...);
+        visit(EventField{"nvertex", bgNumPV, false}, records.nPV...);
+        visit(EventField{"evtweight", bgWeight, true}, records.rawWeight...);
+    }
+};
@@ -1,20 +1,76 @@
 #include <CSVReweighter.hpp>
 
 #include <TFile.h>
+#include <TH1D.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <cstdlib>
+#include <cstdio>
+#include <cstring>
 #include <string>
 #include <stdexcept>
 #include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <limits>
 
 
 using namespace std;
 
 
 // Static data members
+char const CSVReweighter::magic[8] = {'C', 'M', 'S', 'D', 'A', 'S', 'C', 'W'};
+uint32_t const CSVReweighter::version;
 unsigned const CSVReweighter::nPtBinsHF;
 unsigned const CSVReweighter::nPtBinsLF;
 unsigned const CSVReweighter::nEtaBinsLF;
+constexpr double CSVReweighter::ptEdges[];
+constexpr double CSVReweighter::etaEdges[];
+unsigned const CSVReweighter::nVariations;
+unsigned const CSVReweighter::nFlavourClasses;
+unsigned const CSVReweighter::nSlices;
+
+
+/// A systematical variation and the suffix that it adds to the names of histograms
+struct VariationSuffix
+{
+    SystType type;
+    SystDirection direction;
+    char const *suffix;
+};
+
+
+/// Reads the histogram with the given name from the file. Throws an exception if it is not found
+static TH1D const *ReadHistogram(TFile &file, string const &name)
+{
+    TH1D const *hist = dynamic_cast<TH1D const *>(file.Get(name.c_str()));
+    
+    if (not hist)
+    {
+        ostringstream ost;
+        ost << "Cannot find histogram \"" << name << "\" in data file \"" << file.GetName() <<
+         "\".";
+        
+        throw runtime_error(ost.str());
+    }
+    
+    return hist;
+}
+
+
+/// Finds the size and the modification time of the given data file
+static void ReadFileStamp(string const &fileName, uint64_t *stamp)
+{
+    struct stat fileStat;
+    
+    if (stat(fileName.c_str(), &fileStat) != 0)
+        throw runtime_error(string("Data file \"") + fileName + "\" does not exist.");
+    
+    stamp[0] = fileStat.st_size;
+    stamp[1] = fileStat.st_mtime;
+}
 
 
 CSVReweighter::CSVReweighter()
@@ -31,239 +87,342 @@ CSVReweighter::CSVReweighter()
         installPath += '/';
     
     string const dataPath(installPath + "Reader/data/");
+    string const fileNameHF(dataPath + "csv_rwt_hf.root"), fileNameLF(dataPath + "csv_rwt_lf.root");
+    
+    
+    // Use the table from the cache file if it has been compiled from the current data files
+    uint64_t stamps[4];
+    ReadFileStamp(fileNameHF, stamps);
+    ReadFileStamp(fileNameLF, stamps + 2);
+    string const cacheFileName(dataPath + "csv_rwt.cache");
     
+    if (LoadCache(cacheFileName, stamps))
+        return;
     
+    
+    // Otherwise compile the table from the histograms and update the cache
+    ReadHistograms(fileNameHF, fileNameLF);
+    SaveCache(cacheFileName, stamps);
+}
+
+
+shared_ptr<CSVReweighter const> CSVReweighter::GetInstance()
+{
+    // Initialisation of a local static variable is thread-safe. If the constructor throws an
+    //exception, the initialisation is attempted again at the next call
+    static shared_ptr<CSVReweighter const> const instance(new CSVReweighter);
+    return instance;
+}
+
+
+void CSVReweighter::ReadHistograms(string const &fileNameHF, string const &fileNameLF)
+{
     // Open data files that contain histograms for CSV reweighting
-    unique_ptr<TFile> dataFileHF(TFile::Open((dataPath + "csv_rwt_hf.root").c_str()));
-    unique_ptr<TFile> dataFileLF(TFile::Open((dataPath + "csv_rwt_lf.root").c_str()));
+    unique_ptr<TFile> dataFileHF(TFile::Open(fileNameHF.c_str()));
+    unique_ptr<TFile> dataFileLF(TFile::Open(fileNameLF.c_str()));
     
     if (not dataFileHF or dataFileHF->IsZombie())
-        throw runtime_error(string("Data file \"") + dataPath +
-         "csv_rwt_hf.root\" does not exist or is corrupted.");
+        throw runtime_error(string("Data file \"") + fileNameHF +
+         "\" does not exist or is corrupted.");
     
     if (not dataFileLF or dataFileLF->IsZombie())
-        throw runtime_error(string("Data file \"") + dataPath +
-         "csv_rwt_lf.root\" does not exist or is corrupted.");
-    
+        throw runtime_error(string("Data file \"") + fileNameLF +
+         "\" does not exist or is corrupted.");
+    
+    
+    // Variations available for each flavour
+    VariationSuffix const variationsBottom[] = {{SystType::Nominal, SystDirection::Up, ""},
+     {SystType::JEC, SystDirection::Up, "_JESUp"}, {SystType::JEC, SystDirection::Down, "_JESDown"},
+     {SystType::BTagPurityHF, SystDirection::Up, "_LFUp"},
+     {SystType::BTagPurityHF, SystDirection::Down, "_LFDown"},
+     {SystType::BTagStatHF1, SystDirection::Up, "_Stats1Up"},
+     {SystType::BTagStatHF1, SystDirection::Down, "_Stats1Down"},
+     {SystType::BTagStatHF2, SystDirection::Up, "_Stats2Up"},
+     {SystType::BTagStatHF2, SystDirection::Down, "_Stats2Down"}};
+    
+    VariationSuffix const variationsCharm[] = {{SystType::Nominal, SystDirection::Up, ""},
+     {SystType::BTagCharmUnc1, SystDirection::Up, "_cErr1Up"},
+     {SystType::BTagCharmUnc1, SystDirection::Down, "_cErr1Down"},
+     {SystType::BTagCharmUnc2, SystDirection::Up, "_cErr2Up"},
+     {SystType::BTagCharmUnc2, SystDirection::Down, "_cErr2Down"}};
+    
+    VariationSuffix const variationsLight[] = {{SystType::Nominal, SystDirection::Up, ""},
+     {SystType::JEC, SystDirection::Up, "_JESUp"}, {SystType::JEC, SystDirection::Down, "_JESDown"},
+     {SystType::BTagPurityLF, SystDirection::Up, "_HFUp"},
+     {SystType::BTagPurityLF, SystDirection::Down, "_HFDown"},
+     {SystType::BTagStatLF1, SystDirection::Up, "_Stats1Up"},
+     {SystType::BTagStatLF1, SystDirection::Down, "_Stats1Down"},
+     {SystType::BTagStatLF2, SystDirection::Up, "_Stats2Up"},
+     {SystType::BTagStatLF2, SystDirection::Down, "_Stats2Down"}};
+    
+    
+    // Read histograms for all variations, flavour classes, and bins in pt and pseudorapidity.
+    //Histograms for heavy flavours do not depend on pseudorapidity and are put into the first bin.
+    //The histograms are owned by the data files and are only used until the end of the constructor
+    TH1D const *histograms[nVariations][nFlavourClasses][nPtBinsHF][nEtaBinsLF] = {};
+    unsigned const bottom = GetFlavourClass(5), charm = GetFlavourClass(4),
+     light = GetFlavourClass(0);
     
-    // Read histograms for heavy flavours
     for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
     {
         ostringstream nameFragment;
         nameFragment << "csv_ratio_Pt" << iPt << "_Eta0_final";
         
-        weightsBottom[EncodeSyst(SystType::Nominal, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get(nameFragment.str().c_str())));
-        weightsBottom[EncodeSyst(SystType::JEC, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_JESUp").c_str())));
-        weightsBottom[EncodeSyst(SystType::JEC, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_JESDown").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagPurityHF, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_LFUp").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagPurityHF, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_LFDown").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagStatHF1, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_Stats1Up").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagStatHF1, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_Stats1Down").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagStatHF2, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_Stats2Up").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagStatHF2, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_Stats2Down").c_str())));
+        for (auto const &v: variationsBottom)
+            histograms[EncodeSyst(v.type, v.direction)][bottom][iPt][0] =
+             ReadHistogram(*dataFileHF, nameFragment.str() + v.suffix);
         
-        weightsCharm[EncodeSyst(SystType::Nominal, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str()).c_str())));
-        weightsCharm[EncodeSyst(SystType::BTagCharmUnc1, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str() + "_cErr1Up").c_str())));
-        weightsCharm[EncodeSyst(SystType::BTagCharmUnc1, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str() + "_cErr1Down").c_str())));
-        weightsCharm[EncodeSyst(SystType::BTagCharmUnc2, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str() + "_cErr2Up").c_str())));
-        weightsCharm[EncodeSyst(SystType::BTagCharmUnc2, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str() + "_cErr2Down").c_str())));
+        for (auto const &v: variationsCharm)
+            histograms[EncodeSyst(v.type, v.direction)][charm][iPt][0] =
+             ReadHistogram(*dataFileHF, "c_" + nameFragment.str() + v.suffix);
     }
     
-    
-    // Make sure all histograms for heavy flavours have been read
-    for (auto const &wp: weightsBottom)
-        for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
-            if (not wp.second[iPt])
-            {
-                ostringstream ost;
-                ost << "Cannot find histogram for b quarks, systematical variation #" <<
-                 unsigned(wp.first) << ", pt bin #" << iPt << ".";
-                 
-                throw runtime_error(ost.str());
-            }
-    
-    for (auto const &wp: weightsCharm)
-        for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
-            if (not wp.second[iPt])
-            {
-                ostringstream ost;
-                ost << "Cannot find histogram for c quarks, systematical variation #" <<
-                 unsigned(wp.first) << ", pt bin #" << iPt << ".";
-                 
-                throw runtime_error(ost.str());
-            }
-    
-    
-    // Disentangle the histograms for heavy flavours from their parent file, so that the histograms
-    //will not be deleted when the file is closed
-    for (auto const &wp: weightsBottom)
-        for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
-            wp.second[iPt]->SetDirectory(nullptr);
-    
-    for (auto const &wp: weightsCharm)
-        for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
-                wp.second[iPt]->SetDirectory(nullptr);
-    
-    
-    // Read histograms for light flavours
     for (unsigned iPt = 0; iPt < nPtBinsLF; ++iPt)
         for (unsigned iEta = 0; iEta < nEtaBinsLF; ++iEta)
         {
             ostringstream nameFragment;
             nameFragment << "csv_ratio_Pt" << iPt << "_Eta" << iEta << "_final";
             
-            weightsLight[EncodeSyst(SystType::Nominal, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get(nameFragment.str().c_str())));
-            weightsLight[EncodeSyst(SystType::JEC, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_JESUp").c_str())));
-            weightsLight[EncodeSyst(SystType::JEC, SystDirection::Down)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_JESDown").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagPurityLF, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_HFUp").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagPurityLF, SystDirection::Down)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_HFDown").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagStatLF1, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_Stats1Up").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagStatLF1, SystDirection::Down)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_Stats1Down").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagStatLF2, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_Stats2Up").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagStatLF2, SystDirection::Down)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_Stats2Down").c_str())));
+            for (auto const &v: variationsLight)
+                histograms[EncodeSyst(v.type, v.direction)][light][iPt][iEta] =
+                 ReadHistogram(*dataFileLF, nameFragment.str() + v.suffix);
         }
     
     
-    // Make sure all histograms for light flavours have been read
-    for (auto const &wp: weightsLight)
-        for (unsigned iPt = 0; iPt < nPtBinsLF; ++iPt)
-            for (unsigned iEta = 0; iEta < nEtaBinsLF; ++iEta)
-            {
-                if (not wp.second[iPt][iEta])
-                {
-                    ostringstream ost;
-                    ost << "Cannot find histogram for light-flavour quarks, systematical " <<
-                     "variation #" << unsigned(wp.first) << ", pt bin #" << iPt << ".";
-                     
-                    throw runtime_error(ost.str());
-                }
-            }
+    // Find the number of edges of bins in CSV discriminator needed to describe all histograms
+    nCSVEdges = 0;
     
+    for (auto const &byFlavour: histograms)
+        for (auto const &byPt: byFlavour)
+            for (auto const &byEta: byPt)
+                for (TH1D const *hist: byEta)
+                    if (hist)
+                        nCSVEdges = max(nCSVEdges, unsigned(hist->GetNbinsX()) + 1);
     
-    // Disentangle the histograms for light flavours from their parent file
-    for (auto const &wp: weightsLight)
-        for (unsigned iPt = 0; iPt < nPtBinsLF; ++iPt)
-            for (unsigned iEta = 0; iEta < nEtaBinsLF; ++iEta)
-                wp.second[iPt][iEta]->SetDirectory(nullptr);
+    
+    // Fill the lookup table
+    unsigned const sliceSize = 2 * nCSVEdges + 1;
+    unsigned const nominalCode = EncodeSyst(SystType::Nominal, SystDirection::Up);
+    table.resize(nSlices * sliceSize);
+    
+    for (unsigned systCode = 0; systCode < nVariations; ++systCode)
+        for (unsigned flavourClass = 0; flavourClass < nFlavourClasses; ++flavourClass)
+            for (unsigned iPt = 0; iPt <= nPtBinsHF; ++iPt)
+                for (unsigned iEta = 0; iEta <= nEtaBinsLF; ++iEta)
+                {
+                    double *slice =
+                     table.data() + GetSliceIndex(systCode, flavourClass, iPt, iEta) * sliceSize;
+                    fill(slice, slice + nCSVEdges, numeric_limits<double>::infinity());
+                    
+                    
+                    // Jets outside of the supported range get unit weights
+                    if (iPt == 0 or iEta == nEtaBinsLF)
+                    {
+                        fill(slice + nCSVEdges, slice + sliceSize, 1.);
+                        continue;
+                    }
+                    
+                    
+                    // Choose the histogram. The pt range for light flavours is shorter, and the
+                    //last bin is used above it. If the variation is not relevant for the flavour,
+                    //the nominal histogram is used
+                    unsigned const iPtHist =
+                     (flavourClass == light) ? min(iPt - 1, nPtBinsLF - 1) : iPt - 1;
+                    unsigned const iEtaHist = (flavourClass == light) ? iEta : 0;
+                    TH1D const *hist = histograms[systCode][flavourClass][iPtHist][iEtaHist];
+                    
+                    if (not hist)
+                        hist = histograms[nominalCode][flavourClass][iPtHist][iEtaHist];
+                    
+                    
+                    // Copy the binning and the weights, including the underflow and the overflow
+                    unsigned const nBins = hist->GetNbinsX();
+                    
+                    for (unsigned bin = 1; bin <= nBins + 1; ++bin)
+                        slice[bin - 1] = hist->GetXaxis()->GetBinLowEdge(bin);
+                    
+                    for (unsigned bin = 0; bin <= nBins + 1; ++bin)
+                        slice[nCSVEdges + bin] = hist->GetBinContent(bin);
+                }
 }
 
 
 double CSVReweighter::CalculateJetWeight(Jet const &jet,
  SystType systType, SystDirection systDirection) const
 {
-    // Find pt and eta bins into which the given jet falls
-    int iPt = -1, iEta = -1;
-    double const pt = jet.Pt();
-    double const absEta = fabs(jet.Eta());
+    return CalculateJetWeight(jet.Pt(), jet.Eta(), jet.BTag(), jet.Flavour(), systType,
+     systDirection);
+}
+
+
+double CSVReweighter::CalculateJetWeight(Jet const &jet) const
+{
+    return CalculateJetWeight(jet, SystType::Nominal, SystDirection::Up);
+}
+
+
+double CSVReweighter::CalculateJetWeight(double pt, double eta, double csv, int flavour,
+ SystType systType, SystDirection systDirection) const
+{
+    // Locate the slice of the table. Mismatched variations and the Down direction of the Nominal
+    //type are mapped to the nominal weights when the table is filled
+    unsigned iPt, iEta;
+    FindPtEtaBins(pt, eta, iPt, iEta);
+    
+    double const *slice = table.data() + (2 * nCSVEdges + 1) *
+     GetSliceIndex(EncodeSyst(systType, systDirection), GetFlavourClass(flavour), iPt, iEta);
+    
+    return LookUpWeight(slice, csv);
+}
+
+
+void CSVReweighter::CalculateJetWeights(double pt, double eta, double csv, int flavour,
+ SystWeights &weights) const noexcept
+{
+    unsigned iPt, iEta;
+    FindPtEtaBins(pt, eta, iPt, iEta);
+    unsigned const flavourClass = GetFlavourClass(flavour);
     
-    for (double const &cut: {20., 30., 40., 60., 100., 160.})
+    for (unsigned systCode = 0; systCode < nVariations; ++systCode)
     {
-        if (pt < cut)
-            break;
-        
-        ++iPt;
+        double const *slice = table.data() +
+         (2 * nCSVEdges + 1) * GetSliceIndex(systCode, flavourClass, iPt, iEta);
+        weights[systCode] = LookUpWeight(slice, csv);
     }
+}
+
+
+bool CSVReweighter::LoadCache(string const &fileName, uint64_t const *stamps)
+{
+    ifstream in(fileName, ios::binary);
+    
+    // A missing file is not an error: the cache is to be created
+    if (not in)
+        return false;
     
-    for (double const &cut: {0., 0.8, 1.6, 2.4})
+    auto read = [&in](void *dst, size_t nBytes)
     {
-        if (absEta < cut)
-            break;
-        
-        ++iEta;
-    }
+        in.read(static_cast<char *>(dst), nBytes);
+    };
     
     
-    // If the jet is out of the supported range, return a unit weight
-    if (iPt < 0 or iPt >= int(nPtBinsHF) or iEta < 0 or iEta >= int(nEtaBinsLF))
-        return 1.;
+    // Check the header. The cache must have been produced from the same data files by the same
+    //version of the code. Otherwise it is ignored and will be overwritten
+    char fileMagic[sizeof(magic)];
+    uint32_t fileVersion, fileNSlices, fileNCSVEdges;
+    uint64_t fileStamps[4];
     
+    read(fileMagic, sizeof(fileMagic));
+    read(&fileVersion, sizeof(fileVersion));
+    read(fileStamps, sizeof(fileStamps));
+    read(&fileNSlices, sizeof(fileNSlices));
+    read(&fileNCSVEdges, sizeof(fileNCSVEdges));
     
-    // Encode the requested systematics. Not that if the type is Nominal, only Up variation is
-    //expected
-    if (systType == SystType::Nominal and systDirection == SystDirection::Down)
-        systDirection = SystDirection::Up;
+    if (not in or memcmp(fileMagic, magic, sizeof(magic)) != 0 or fileVersion != version or
+     memcmp(fileStamps, stamps, sizeof(fileStamps)) != 0 or fileNSlices != nSlices)
+        return false;
     
-    SystCode systCode = EncodeSyst(systType, systDirection);
     
+    // Make sure the file has the expected size before allocating memory for the table
+    streamoff const headerSize = in.tellg();
+    streamoff const tableSize = streamoff(nSlices) * (2 * fileNCSVEdges + 1) * sizeof(double);
+    in.seekg(0, ios::end);
     
-    // Calculate the per-jet weight depending on the jet flavour
-    double const csv = jet.BTag();
+    if (not in or in.tellg() != headerSize + tableSize)
+        return false;
     
-    switch (abs(jet.Flavour()))
+    in.seekg(headerSize);
+    table.resize(tableSize / sizeof(double));
+    read(table.data(), tableSize);
+    
+    if (not in)
     {
-        case 5:  // b-quark jets
-        {
-            // Check for mismatched systematical variation
-            if (weightsBottom.find(systCode) == weightsBottom.end())
-                systCode = EncodeSyst(SystType::Nominal, SystDirection::Up);
-            
-            int const bin = (csv >= 0.) ? weightsBottom[systCode][iPt]->FindFixBin(csv) : 1;
-            return weightsBottom[systCode][iPt]->GetBinContent(bin);
-            
-            break;
-        }
-        
-        case 4:  // c-quark jets
-        {
-            // Check for mismatched systematical variation
-            if (weightsCharm.find(systCode) == weightsCharm.end())
-                systCode = EncodeSyst(SystType::Nominal, SystDirection::Up);
-            
-            int const bin = (csv >= 0.) ? weightsCharm[systCode][iPt]->FindFixBin(csv) : 1;
-            return weightsCharm[systCode][iPt]->GetBinContent(bin);
-            
-            break;
-        }
-        
-        default:  // light-flavour jets
-        {
-            // The pt range for light-flavour is different. Clip the pt accordingly
-            if (iPt > 3)
-                iPt = 3;
-            
-            // Check for mismatched systematical variation
-            if (weightsLight.find(systCode) == weightsLight.end())
-                systCode = EncodeSyst(SystType::Nominal, SystDirection::Up);
-            
-            int const bin = (csv >= 0.) ? weightsLight[systCode][iPt][iEta]->FindFixBin(csv) : 1;
-            return weightsLight[systCode][iPt][iEta]->GetBinContent(bin);
-            
-            break;
-        }
+        table.clear();
+        return false;
     }
+    
+    nCSVEdges = fileNCSVEdges;
+    return true;
 }
 
 
-double CSVReweighter::CalculateJetWeight(Jet const &jet) const
+void CSVReweighter::SaveCache(string const &fileName, uint64_t const *stamps) const
 {
-    return CalculateJetWeight(jet, SystType::Nominal, SystDirection::Up);
+    // Write into a temporary file, which then replaces the cache, so that other processes never
+    //read a partially written file. The cache is optional, and failures are ignored, e.g. when
+    //the data directory is read-only
+    ostringstream tmpFileName;
+    tmpFileName << fileName << ".tmp" << getpid();
+    ofstream out(tmpFileName.str(), ios::binary | ios::trunc);
+    
+    if (not out)
+        return;
+    
+    auto write = [&out](void const *src, size_t nBytes)
+    {
+        out.write(static_cast<char const *>(src), nBytes);
+    };
+    
+    uint32_t const fileNSlices = nSlices, fileNCSVEdges = nCSVEdges;
+    write(magic, sizeof(magic));
+    write(&version, sizeof(version));
+    write(stamps, 4 * sizeof(uint64_t));
+    write(&fileNSlices, sizeof(fileNSlices));
+    write(&fileNCSVEdges, sizeof(fileNCSVEdges));
+    write(table.data(), table.size() * sizeof(double));
+    
+    out.close();
+    
+    if (out.fail() or rename(tmpFileName.str().c_str(), fileName.c_str()) != 0)
+        remove(tmpFileName.str().c_str());
 }
 
 
 CSVReweighter::SystCode CSVReweighter::EncodeSyst(SystType systType, SystDirection systDirection)
 {
-    return 2 * unsigned(systType) + unsigned(systDirection);
+    return SystWeights::GetIndex(systType, systDirection);
+}
+
+
+unsigned CSVReweighter::GetFlavourClass(int flavour) noexcept
+{
+    int const absFlavour = abs(flavour);
+    return (absFlavour == 5) ? 0 : ((absFlavour == 4) ? 1 : 2);
+}
+
+
+unsigned CSVReweighter::GetSliceIndex(SystCode systCode, unsigned flavourClass, unsigned iPt,
+ unsigned iEta) noexcept
+{
+    return ((systCode * nFlavourClasses + flavourClass) * (nPtBinsHF + 1) + iPt) *
+     (nEtaBinsLF + 1) + iEta;
+}
+
+
+double CSVReweighter::LookUpWeight(double const *slice, double csv) const noexcept
+{
+    // Count the edges that the value has passed. Jets with negative values, e.g. those without a
+    //discriminator, are assigned to the first bin
+    unsigned iCSV = 0;
+    
+    for (unsigned i = 0; i < nCSVEdges; ++i)
+        iCSV += (csv >= slice[i]);
+    
+    return slice[nCSVEdges + ((csv >= 0.) ? iCSV : 1)];
+}
+
+
+void CSVReweighter::FindPtEtaBins(double pt, double eta, unsigned &iPt, unsigned &iEta) noexcept
+{
+    // Count the edges that the jet has passed. Bin 0 in pt and the last bin in eta correspond to
+    //jets out of the supported range, which get unit weights from the table
+    iPt = 0;
+    iEta = 0;
+    double const absEta = fabs(eta);
+    
+    for (double const edge: ptEdges)
+        iPt += (pt >= edge);
+    
+    for (double const edge: etaEdges)
+        iEta += (absEta >= edge);
 }
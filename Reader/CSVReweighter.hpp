@@ -3,10 +3,10 @@
 #include <PhysicsObjects.hpp>
 #include <Systematics.hpp>
 
-#include <TH1D.h>
-
+#include <vector>
+#include <string>
 #include <memory>
-#include <map>
+#include <cstdint>
 
 
 /**
@@ -19,6 +19,11 @@
  * SystType enumeration start with BTag prefix), the CSV weights are also affected by the JEC
  * systematics. More details about the reweighting method and its systematics can be found in the
  * supporting AN [2].
+ * 
+ * The histograms are compiled into a lookup table, which is not modified afterwards. The table is
+ * saved into a cache file next to the histograms, and later instances load it from there instead
+ * of reading the histograms, as long as the data files do not change. Within a process a single
+ * shared instance, returned by GetInstance, should normally be used.
  * [1] https://twiki.cern.ch/twiki/bin/viewauth/CMS/BTagShapeCalibration
  * [2] http://cms.cern.ch/iCMS/jsp/db_notes/noteInfo.jsp?cmsnoteid=CMS%20AN-2013/130
  */
@@ -36,11 +41,22 @@ public:
     /**
      * \brief Constructor
      * 
-     * Reads histograms with the weights from data files. Throws exceptions if the files are not
-     * found or do not contain required histograms.
+     * Loads the lookup table from the cache file if it has been produced from the current data
+     * files. Otherwise reads histograms with the weights from the data files, compiles them into
+     * the table, and tries to update the cache; failures to write the cache are ignored. Throws
+     * exceptions if the data files are not found or do not contain required histograms.
      */
     CSVReweighter();
     
+public:
+    /**
+     * \brief Returns the instance shared within the process
+     * 
+     * The instance is created at the first call and is kept until the end of the process. The
+     * method is thread-safe.
+     */
+    static std::shared_ptr<CSVReweighter const> GetInstance();
+    
 public:
     /**
      * \brief Calculates per-jet CSV weight
@@ -56,11 +72,63 @@ public:
     /// A short-cut to calculate nominal per-jet CSV weight
     double CalculateJetWeight(Jet const &jet) const;
     
+    /**
+     * \brief Calculates per-jet CSV weight from properties of the jet
+     * 
+     * Equivalent to the first version of the method. Allows to avoid the construction of a Jet
+     * object.
+     */
+    double CalculateJetWeight(double pt, double eta, double csv, int flavour, SystType systType,
+     SystDirection systDirection) const;
+    
+    /**
+     * \brief Calculates per-jet CSV weights for all systematical variations at once
+     * 
+     * The weight for each variation is the same as computed by CalculateJetWeight, but the bins
+     * in pt and pseudorapidity are only found once.
+     */
+    void CalculateJetWeights(double pt, double eta, double csv, int flavour,
+     SystWeights &weights) const noexcept;
+    
 private:
     /// Combines type of systematics and direction of the variation into a single code
     static SystCode EncodeSyst(SystType systType, SystDirection systDirection);
     
 private:
+    /// Reads histograms from the data files and fills the lookup table
+    void ReadHistograms(std::string const &fileNameHF, std::string const &fileNameLF);
+    
+    /**
+     * \brief Loads the lookup table from the cache file
+     * 
+     * The given array contains the sizes and the modification times of the two data files. If
+     * the cache does not exist, does not match them, or is damaged, returns false.
+     */
+    bool LoadCache(std::string const &fileName, std::uint64_t const *stamps);
+    
+    /// Saves the lookup table into the cache file. See documentation for LoadCache
+    void SaveCache(std::string const &fileName, std::uint64_t const *stamps) const;
+    
+    /// Index of the flavour class (b, c, or light-flavour jets) of a jet with the given flavour
+    static unsigned GetFlavourClass(int flavour) noexcept;
+    
+    /// Returns index of the slice for the given variation, flavour class, and bins in pt and eta
+    static unsigned GetSliceIndex(SystCode systCode, unsigned flavourClass, unsigned iPt,
+     unsigned iEta) noexcept;
+    
+    /// Finds the bin in CSV discriminator in the given slice and returns the weight
+    double LookUpWeight(double const *slice, double csv) const noexcept;
+    
+    /// Finds the bins in pt and pseudorapidity. See documentation for nSlices
+    static void FindPtEtaBins(double pt, double eta, unsigned &iPt, unsigned &iEta) noexcept;
+    
+private:
+    /// Magic sequence at the start of the cache file
+    static char const magic[8];
+    
+    /// Version of the format of the cache file
+    static std::uint32_t const version = 1;
+    
     /// Number of bins in pt in histograms for heavy-flavour jets
     static unsigned const nPtBinsHF = 6;
     
@@ -70,12 +138,41 @@ private:
     /// Number of bins in absolute pseudorapidity in histograms for light-flavour jets
     static unsigned const nEtaBinsLF = 3;
     
-    /// Histograms with weights for b-quark jets
-    mutable std::map<SystCode, std::unique_ptr<TH1D>[nPtBinsHF]> weightsBottom;
+    /// Lower edges of bins in pt, in GeV
+    static constexpr double ptEdges[nPtBinsHF] = {20., 30., 40., 60., 100., 160.};
+    
+    /// Upper edges of bins in absolute pseudorapidity
+    static constexpr double etaEdges[nEtaBinsLF] = {0.8, 1.6, 2.4};
     
-    /// Histograms with weights for c-quark jets
-    mutable std::map<SystCode, std::unique_ptr<TH1D>[nPtBinsHF]> weightsCharm;
+    /// Number of codes of systematical variations
+    static unsigned const nVariations = SystWeights::size;
     
-    /// Histograms with weights for light-flavour jets
-    mutable std::map<SystCode, std::unique_ptr<TH1D>[nPtBinsLF][nEtaBinsLF]> weightsLight;
+    /// Number of flavour classes: b-quark, c-quark, and light-flavour jets
+    static unsigned const nFlavourClasses = 3;
+    
+    /**
+     * \brief Number of slices in the lookup table
+     * 
+     * A slice is included for each variation, flavour class, bin in pt, and bin in pseudorapidity.
+     * There is one additional bin in pt for jets below the first edge and one additional bin in
+     * pseudorapidity for jets beyond the last edge; their slices contain unit weights.
+     */
+    static unsigned const nSlices =
+     nVariations * nFlavourClasses * (nPtBinsHF + 1) * (nEtaBinsLF + 1);
+    
+    /// Maximal number of edges of bins in CSV discriminator among all slices
+    unsigned nCSVEdges;
+    
+    /**
+     * \brief Lookup table with the weights
+     * 
+     * Consists of nSlices slices of 2 * nCSVEdges + 1 elements. A slice starts with the edges of
+     * bins in CSV discriminator, padded with infinities, followed by the weights in all bins,
+     * including the underflow and the overflow. Slices for variations not relevant for the
+     * flavour class repeat the nominal weights, and so do the slices for bins in pseudorapidity of
+     * heavy-flavour jets and for bins in pt of light-flavour jets above the range of the
+     * histograms. The table is not modified after the construction, which makes the reweighter
+     * safe to use from many threads.
+     */
+    std::vector<double> table;
 };
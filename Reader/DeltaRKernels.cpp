@@ -0,0 +1,70 @@
+#include <DeltaRKernels.hpp>
+
+#include <TMath.h>
+
+#include <cmath>
+
+
+using namespace std;
+
+
+/**
+ * \brief Computes squared dR distances between an object and each object of a collection
+ * 
+ * The loop has no branches and no function calls other than fabs, so that it can be vectorised.
+ */
+static void DeltaR2Row(float eta, float phi, float const *__restrict__ etas,
+ float const *__restrict__ phis, unsigned n, float *__restrict__ dR2) noexcept
+{
+    float const pi = TMath::Pi();
+    
+    for (unsigned j = 0; j < n; ++j)
+    {
+        float const dEta = eta - etas[j];
+        float const dPhi = pi - fabs(fabs(phi - phis[j]) - pi);
+        dR2[j] = dEta * dEta + dPhi * dPhi;
+    }
+}
+
+
+void DeltaRKernels::Matrix(float const *eta1, float const *phi1, unsigned n1, float const *eta2,
+ float const *phi2, unsigned n2, float *dR) noexcept
+{
+    for (unsigned i = 0; i < n1; ++i)
+    {
+        float *row = dR + i * n2;
+        DeltaR2Row(eta1[i], phi1[i], eta2, phi2, n2, row);
+        
+        for (unsigned j = 0; j < n2; ++j)
+            row[j] = sqrt(row[j]);
+    }
+}
+
+
+void DeltaRKernels::MarkOverlaps(float const *eta1, float const *phi1, unsigned n1,
+ float const *eta2, float const *phi2, unsigned n2, float maxDR,
+ unsigned char *overlaps) noexcept
+{
+    for (unsigned j = 0; j < n2; ++j)
+        overlaps[j] = 0;
+    
+    
+    // The second collection is processed in chunks of a fixed size, which avoids allocating
+    //memory. The squared distances are compared with the squared threshold
+    unsigned const chunkSize = 64;
+    float dR2[chunkSize];
+    float const maxDR2 = maxDR * maxDR;
+    
+    for (unsigned start = 0; start < n2; start += chunkSize)
+    {
+        unsigned const length = (n2 - start < chunkSize) ? n2 - start : chunkSize;
+        
+        for (unsigned i = 0; i < n1; ++i)
+        {
+            DeltaR2Row(eta1[i], phi1[i], eta2 + start, phi2 + start, length, dR2);
+            
+            for (unsigned j = 0; j < length; ++j)
+                overlaps[start + j] |= (dR2[j] < maxDR2);
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+
+/**
+ * \class DeltaRKernels
+ * \brief Batched computation of angular distances between two collections of objects
+ * 
+ * The methods operate on columns of pseudorapidities and azimuthal angles, as stored in the read
+ * buffers, and evaluate all pairs formed by an object of the first collection and an object of the
+ * second one. The difference in azimuthal angle is brought into the range [0, pi] without branches,
+ * using the identity |dPhi| -> pi - ||dPhi| - pi|, so that the inner loops are vectorised by the
+ * compiler. The identity requires that all azimuthal angles are in the range [-pi, pi], which is
+ * the case for the angles stored in the source trees and computed with atan2.
+ */
+class DeltaRKernels
+{
+public:
+    /**
+     * \brief Computes the matrix of dR distances
+     * 
+     * The distance between the i-th object of the first collection and the j-th object of the
+     * second collection is written to element dR[i * n2 + j].
+     */
+    static void Matrix(float const *eta1, float const *phi1, unsigned n1, float const *eta2,
+     float const *phi2, unsigned n2, float *dR) noexcept;
+    
+    /**
+     * \brief Finds objects of the second collection that overlap with the first one
+     * 
+     * Element overlaps[j] is set to 1 if the j-th object of the second collection is closer than
+     * maxDR to any object of the first collection, and to 0 otherwise. The square root is not
+     * computed.
+     */
+    static void MarkOverlaps(float const *eta1, float const *phi1, unsigned n1,
+     float const *eta2, float const *phi2, unsigned n2, float maxDR,
+     unsigned char *overlaps) noexcept;
+};
@@ -0,0 +1,190 @@
+#include <EntryListFile.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+
+
+using namespace std;
+
+
+// Static data members
+char const EntryListFile::magic[8] = {'C', 'M', 'S', 'D', 'A', 'S', 'E', 'L'};
+uint32_t const EntryListFile::version;
+
+
+EntryListFile::EntryListFile(string const &fileName_):
+    fileName(fileName_)
+{
+    Load();
+}
+
+
+string EntryListFile::MakeKey(string const &selection, SystType systType /*= SystType::Nominal*/,
+ SystDirection systDirection /*= SystDirection::Up*/)
+{
+    // Combine the arguments into a single string and compute its 64-bit FNV-1a hash. Unlike
+    //std::hash, it does not depend on the implementation of the standard library
+    ostringstream description;
+    description << selection << '\n' << int(systType) << '\n' << int(systDirection);
+    
+    uint64_t hash = 14695981039346656037ull;
+    
+    for (char const c: description.str())
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    
+    ostringstream key;
+    key << hex << setw(16) << setfill('0') << hash;
+    return key.str();
+}
+
+
+shared_ptr<EntryListFile::EntryList const> EntryListFile::Find(string const &key,
+ string const &treeName, unsigned long nEntries) const
+{
+    lock_guard<mutex> lock(listsMutex);
+    auto const res = lists.find({key, treeName});
+    
+    if (res == lists.end() or res->second.nEntries != nEntries)
+        return nullptr;
+    
+    return res->second.entries;
+}
+
+
+void EntryListFile::AddEntry(string const &key, string const &treeName, unsigned long nEntries,
+ Long64_t entry)
+{
+    lock_guard<mutex> lock(listsMutex);
+    StoredList &list = recordedLists[{key, treeName}];
+    
+    if (not list.entries)
+        list = {nEntries, make_shared<EntryList>()};
+    
+    list.entries->push_back(entry);
+}
+
+
+void EntryListFile::Save()
+{
+    // Replace the loaded lists with the recorded ones. Entries in the latter are sorted and
+    //duplicates are removed since several readers could process overlapping entries
+    for (auto &r: recordedLists)
+    {
+        EntryList &entries = *r.second.entries;
+        sort(entries.begin(), entries.end());
+        entries.erase(unique(entries.begin(), entries.end()), entries.end());
+        
+        lists[r.first] = r.second;
+    }
+    
+    recordedLists.clear();
+    
+    
+    // Write into a temporary file, which then replaces the target one. In this way an interrupted
+    //write does not destroy the lists saved before
+    string const tmpFileName(fileName + ".tmp");
+    ofstream out(tmpFileName, ios::binary | ios::trunc);
+    
+    if (not out)
+        throw runtime_error(string("Cannot create file \"") + tmpFileName + "\".");
+    
+    auto writeString = [&out](string const &s)
+    {
+        uint32_t const length = s.size();
+        out.write(reinterpret_cast<char const *>(&length), sizeof(length));
+        out.write(s.data(), length);
+    };
+    
+    uint32_t const nLists = lists.size();
+    out.write(magic, sizeof(magic));
+    out.write(reinterpret_cast<char const *>(&version), sizeof(version));
+    out.write(reinterpret_cast<char const *>(&nLists), sizeof(nLists));
+    
+    for (auto const &l: lists)
+    {
+        writeString(l.first.first);
+        writeString(l.first.second);
+        
+        uint64_t const nEntries = l.second.nEntries;
+        uint64_t const nStored = l.second.entries->size();
+        out.write(reinterpret_cast<char const *>(&nEntries), sizeof(nEntries));
+        out.write(reinterpret_cast<char const *>(&nStored), sizeof(nStored));
+        out.write(reinterpret_cast<char const *>(l.second.entries->data()),
+         nStored * sizeof(Long64_t));
+    }
+    
+    out.close();
+    
+    if (out.fail() or rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+        throw runtime_error(string("Failed to write file \"") + fileName + "\".");
+}
+
+
+void EntryListFile::Load()
+{
+    ifstream in(fileName, ios::binary);
+    
+    // A missing file is not an error: it will be created when the lists are saved
+    if (not in)
+        return;
+    
+    auto read = [this, &in](void *dst, size_t nBytes)
+    {
+        if (not in.read(static_cast<char *>(dst), nBytes))
+            throw runtime_error(string("File \"") + fileName + "\" is corrupted.");
+    };
+    
+    auto readString = [&read]()
+    {
+        uint32_t length;
+        read(&length, sizeof(length));
+        
+        string s(length, '\0');
+        read(&s[0], length);
+        return s;
+    };
+    
+    
+    // Check the header
+    char fileMagic[sizeof(magic)];
+    uint32_t fileVersion, nLists;
+    read(fileMagic, sizeof(fileMagic));
+    read(&fileVersion, sizeof(fileVersion));
+    read(&nLists, sizeof(nLists));
+    
+    if (memcmp(fileMagic, magic, sizeof(magic)) != 0 or fileVersion != version)
+    {
+        ostringstream ost;
+        ost << "File \"" << fileName << "\" is not an entry list file of version " << version <<
+         ".";
+        throw runtime_error(ost.str());
+    }
+    
+    
+    // Read the lists
+    for (unsigned i = 0; i < nLists; ++i)
+    {
+        string const key(readString());
+        string const treeName(readString());
+        
+        uint64_t nEntries, nStored;
+        read(&nEntries, sizeof(nEntries));
+        read(&nStored, sizeof(nStored));
+        
+        if (nStored > nEntries)
+            throw runtime_error(string("File \"") + fileName + "\" is corrupted.");
+        
+        auto entries = make_shared<EntryList>(nStored);
+        read(entries->data(), nStored * sizeof(Long64_t));
+        
+        lists[{key, treeName}] = {nEntries, entries};
+    }
+}
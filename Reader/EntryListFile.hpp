@@ -0,0 +1,129 @@
+#pragma once
+
+#include <Systematics.hpp>
+
+#include <Rtypes.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <cstdint>
+
+
+/**
+ * \class EntryListFile
+ * \brief A sidecar file with lists of entries that have passed a selection
+ * 
+ * Lists are stored per tree and identified by a key, which is normally constructed with the method
+ * MakeKey from a description of the selection and the systematical variation. A Reader can record
+ * the entries that pass the selection in one run (see Reader::RecordEntryList) and read only these
+ * entries in the following runs (see Reader::SetEntryList). This is profitable for trees in which
+ * a small fraction of events passes the selection.
+ * 
+ * Each list remembers the number of entries in the tree it was recorded for. If the tree has been
+ * modified and contains a different number of entries, the list is ignored. Lists recorded in the
+ * current run become available for reading only after the file has been saved and loaded again.
+ * All methods except for Save are thread-safe.
+ * 
+ * The layout of the file is the following (all numbers use the native byte order):
+ * 
+ *   header:  char magic[8], uint32 version, uint32 nLists
+ *   list:    uint32 length of key, key, uint32 length of tree name, tree name, uint64 nEntries in
+ *            the tree, uint64 number of stored entries, uint64 indices of stored entries
+ */
+class EntryListFile
+{
+public:
+    /// Indices of selected entries, in the increasing order
+    typedef std::vector<Long64_t> EntryList;
+    
+public:
+    /**
+     * \brief Constructor from the name of the file
+     * 
+     * If the file exists, lists are loaded from it; otherwise the object starts empty. An exception
+     * is thrown if the file exists but is not valid.
+     */
+    EntryListFile(std::string const &fileName);
+    
+    /// Copy constructor is disabled
+    EntryListFile(EntryListFile const &) = delete;
+    
+    /// Assignment operator is disabled
+    EntryListFile &operator=(EntryListFile const &) = delete;
+    
+public:
+    /**
+     * \brief Constructs a key from a description of the selection and the systematical variation
+     * 
+     * The description can be any string that changes whenever the selection changes, e.g. a list of
+     * its cuts. The key is a hash of the arguments and is stable between runs and platforms.
+     */
+    static std::string MakeKey(std::string const &selection, SystType systType = SystType::Nominal,
+     SystDirection systDirection = SystDirection::Up);
+    
+    /**
+     * \brief Finds the list for the given key and tree
+     * 
+     * Returns a null pointer if there is no such list or if it was recorded for a tree with a
+     * different number of entries.
+     */
+    std::shared_ptr<EntryList const> Find(std::string const &key, std::string const &treeName,
+     unsigned long nEntries) const;
+    
+    /**
+     * \brief Records that an entry of the given tree has passed the selection
+     * 
+     * Entries can be added in any order and several times. The recorded lists replace the loaded
+     * ones with the same key and tree when the file is saved.
+     */
+    void AddEntry(std::string const &key, std::string const &treeName, unsigned long nEntries,
+     Long64_t entry);
+    
+    /**
+     * \brief Writes all lists into the file
+     * 
+     * The file is replaced atomically. An exception is thrown in case of a write error.
+     */
+    void Save();
+    
+private:
+    /// Lists are identified by the key and the name of the tree
+    typedef std::pair<std::string, std::string> ListID;
+    
+    /// A list of entries together with the size of the tree
+    struct StoredList
+    {
+        /// Number of entries in the tree
+        unsigned long nEntries;
+        
+        /// Selected entries
+        std::shared_ptr<EntryList> entries;
+    };
+    
+private:
+    /// Reads lists from the file
+    void Load();
+    
+private:
+    /// Magic sequence at the start of the file
+    static char const magic[8];
+    
+    /// Version of the format
+    static std::uint32_t const version = 1;
+    
+    /// Name of the file
+    std::string fileName;
+    
+    /// Lists loaded from the file
+    std::map<ListID, StoredList> lists;
+    
+    /// Lists recorded in the current run, not necessarily sorted
+    std::map<ListID, StoredList> recordedLists;
+    
+    /// Mutex to protect the lists
+    mutable std::mutex listsMutex;
+};
@@ -0,0 +1,62 @@
+#include <EventArena.hpp>
+
+#include <cstdint>
+
+
+using namespace std;
+
+
+EventArena::EventArena(size_t initialSize /*= 1 << 16*/):
+    block(new char[initialSize]), blockSize(initialSize), used(0), overflowSize(0)
+{}
+
+
+void *EventArena::Allocate(size_t size, size_t alignment /*= alignof(max_align_t)*/)
+{
+    // Try to place the object in the main block
+    uintptr_t const base = reinterpret_cast<uintptr_t>(block.get());
+    size_t const offset = ((base + used + alignment - 1) & ~uintptr_t(alignment - 1)) - base;
+    
+    if (offset + size <= blockSize)
+    {
+        used = offset + size;
+        return block.get() + offset;
+    }
+    
+    
+    // Otherwise allocate a separate chunk. Its size is included in the block after the next reset
+    size_t const chunkSize = size + alignment;
+    overflowChunks.emplace_back(new char[chunkSize]);
+    overflowSize += chunkSize;
+    
+    uintptr_t const chunk = reinterpret_cast<uintptr_t>(overflowChunks.back().get());
+    return reinterpret_cast<void *>((chunk + alignment - 1) & ~uintptr_t(alignment - 1));
+}
+
+
+void EventArena::Reset()
+{
+    if (not overflowChunks.empty())
+    {
+        // Leave some room for growth so that the block does not need to be enlarged often
+        blockSize = 2 * (blockSize + overflowSize);
+        block.reset(new char[blockSize]);
+        
+        overflowChunks.clear();
+        overflowSize = 0;
+    }
+    
+    used = 0;
+}
+
+
+size_t EventArena::GetUsedSize() const noexcept
+{
+    return used + overflowSize;
+}
+
+
+size_t EventArena::GetBlockSize() const noexcept
+{
+    return blockSize;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+
+
+/**
+ * \class EventArena
+ * \brief A memory pool for temporaries of the analysis code that live for one event
+ * 
+ * Memory is handed out sequentially from a single block and is never freed individually; instead
+ * the whole arena is reset at once, which the Reader does before each event. If the block gets
+ * exhausted, additional chunks are allocated on the heap, and at the next reset they are merged
+ * into a single larger block. In this way the heap is only used in the first events, until the
+ * block grows large enough for the busiest event.
+ * 
+ * Containers are placed in the arena with ArenaAllocator, e.g. ArenaVector<double>. Objects
+ * allocated in the arena must not be used after the reset. Their destructors are called as
+ * usual, but the memory is only reclaimed by the reset.
+ */
+class EventArena
+{
+public:
+    /// Constructor with the initial size of the block, in bytes
+    EventArena(std::size_t initialSize = 1 << 16);
+    
+    /// Copy constructor is disabled
+    EventArena(EventArena const &) = delete;
+    
+    /// Assignment operator is disabled
+    EventArena &operator=(EventArena const &) = delete;
+    
+public:
+    /**
+     * \brief Returns memory of the given size and alignment
+     * 
+     * The alignment must be a power of two.
+     */
+    void *Allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+    
+    /**
+     * \brief Makes all memory available again
+     * 
+     * If additional chunks have been allocated since the previous reset, the block is enlarged to
+     * hold their content as well.
+     */
+    void Reset();
+    
+    /// Returns the number of bytes handed out since the last reset, including padding
+    std::size_t GetUsedSize() const noexcept;
+    
+    /// Returns the size of the main block, in bytes
+    std::size_t GetBlockSize() const noexcept;
+    
+private:
+    /// Main block of memory
+    std::unique_ptr<char[]> block;
+    
+    /// Size of the main block
+    std::size_t blockSize;
+    
+    /// Number of bytes used in the main block
+    std::size_t used;
+    
+    /// Additional chunks allocated after the main block has been exhausted
+    std::vector<std::unique_ptr<char[]>> overflowChunks;
+    
+    /// Total size of the additional chunks
+    std::size_t overflowSize;
+};
+
+
+/**
+ * \class ArenaAllocator
+ * \brief An allocator that takes memory from an EventArena
+ * 
+ * Deallocation does nothing. Meant to be used with standard containers through ArenaVector.
+ */
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+    
+public:
+    /// Constructor from the arena
+    ArenaAllocator(EventArena &arena_) noexcept:
+        arena(&arena_)
+    {}
+    
+    /// Conversion from an allocator for another type
+    template<typename U>
+    ArenaAllocator(ArenaAllocator<U> const &src) noexcept:
+        arena(src.GetArena())
+    {}
+    
+public:
+    /// Allocates memory for n objects
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+    
+    /// Does nothing since the memory is reclaimed when the arena is reset
+    void deallocate(T *, std::size_t) noexcept
+    {}
+    
+    /// Returns the underlying arena
+    EventArena *GetArena() const noexcept
+    {
+        return arena;
+    }
+    
+private:
+    /// Arena that provides the memory
+    EventArena *arena;
+};
+
+
+/// Allocators are equal if they use the same arena
+template<typename T, typename U>
+bool operator==(ArenaAllocator<T> const &lhs, ArenaAllocator<U> const &rhs) noexcept
+{
+    return (lhs.GetArena() == rhs.GetArena());
+}
+
+
+template<typename T, typename U>
+bool operator!=(ArenaAllocator<T> const &lhs, ArenaAllocator<U> const &rhs) noexcept
+{
+    return not (lhs == rhs);
+}
+
+
+/// A vector whose elements are stored in an EventArena
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,46 @@
+#include <EventBatch.hpp>
+
+
+/// Visitor that removes all elements from columns
+struct ColumnClearer
+{
+    template<typename Field, typename T>
+    void operator()(Field const &, std::vector<T> &column) const
+    {
+        column.clear();
+    }
+};
+
+
+void LeptonColumns::Clear()
+{
+    offsets.assign(1, 0);
+    BranchSchema::ForEachLeptonField(ColumnClearer(), *this);
+}
+
+
+void JetColumns::Clear()
+{
+    offsets.assign(1, 0);
+    BranchSchema::ForEachJetField(ColumnClearer(), *this);
+}
+
+
+EventBatch::EventBatch():
+    nEvents(0)
+{
+    Clear();
+}
+
+
+void EventBatch::Clear()
+{
+    nEvents = 0;
+    
+    leptons.Clear();
+    jets.Clear();
+    jetsJECUp.Clear();
+    jetsJECDown.Clear();
+    
+    BranchSchema::ForEachEventField(ColumnClearer(), *this);
+}
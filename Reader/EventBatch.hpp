@@ -0,0 +1,68 @@
+#pragma once
+
+#include <BranchSchema.hpp>
+
+#include <vector>
+
+
+/**
+ * \struct LeptonColumns
+ * \brief Properties of leptons in a batch of events, stored column-wise
+ * 
+ * Leptons of event i occupy positions [offsets[i], offsets[i + 1]) in all columns. Within each
+ * event they are ordered in pt, in the decreasing order.
+ */
+struct LeptonColumns: public LeptonFields<ColumnStorage>
+{
+    /// Removes all leptons and sets the offset of the first event
+    void Clear();
+    
+    /// Offsets of the first lepton of each event; there is one more offset than events
+    std::vector<unsigned> offsets;
+};
+
+
+/**
+ * \struct JetColumns
+ * \brief Properties of jets in a batch of events, stored column-wise
+ * 
+ * Jets of event i occupy positions [offsets[i], offsets[i + 1]) in all columns. Within each event
+ * they are ordered in pt, in the decreasing order.
+ */
+struct JetColumns: public JetFields<ColumnStorage>
+{
+    /// Removes all jets and sets the offset of the first event
+    void Clear();
+    
+    /// Offsets of the first jet of each event; there is one more offset than events
+    std::vector<unsigned> offsets;
+};
+
+
+/**
+ * \struct EventBatch
+ * \brief A block of events in the struct-of-arrays layout
+ * 
+ * Filled by Reader::ReadBatch. Collections of objects are described by LeptonColumns and
+ * JetColumns, while per-event quantities, inherited from EventFields, are stored in vectors with
+ * one element per event. The JEC-varied collections are empty in case of data, and the raw weight
+ * equals 1. The raw weight does not include the reweighting for b-tagging, which can be evaluated
+ * with the CSVReweighter.
+ */
+struct EventBatch: public EventFields<ColumnStorage>
+{
+    /// Constructor without parameters
+    EventBatch();
+    
+    /// Removes all events
+    void Clear();
+    
+    /// Number of events in the batch
+    unsigned nEvents;
+    
+    /// Leptons
+    LeptonColumns leptons;
+    
+    /// Jets, nominal and with JEC variations
+    JetColumns jets, jetsJECUp, jetsJECDown;
+};
@@ -0,0 +1,675 @@
+#include <EventLoop.hpp>
+
+#include <TFile.h>
+#include <TTree.h>
+#include <TThread.h>
+#include <TNamed.h>
+
+#include <thread>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+
+
+using namespace std;
+
+
+EventLoop::EventLoop(string const &srcFileName_, list<Group> const &groups_,
+ HistBooker const &booker_, EventProcessor const &processor_):
+    srcFileName(srcFileName_), groups(groups_.begin(), groups_.end()),
+    booker(booker_), processor(processor_),
+    nThreads(1), chunkSize(100000), shardIndex(0), nShards(1), checkpointInterval(10.),
+    reportProgress(false), nEntriesDone(0), processingFinished(false), runTime(0.)
+{}
+
+
+void EventLoop::SetNumThreads(unsigned nThreads_)
+{
+    nThreads = nThreads_;
+    
+    if (nThreads == 0)
+        nThreads = max(thread::hardware_concurrency(), 1u);
+}
+
+
+void EventLoop::SetChunkSize(unsigned long chunkSize_)
+{
+    chunkSize = max(chunkSize_, 1ul);
+}
+
+
+void EventLoop::SetReaderConfigurator(ReaderConfigurator const &configurator_)
+{
+    configurator = configurator_;
+}
+
+
+void EventLoop::SetShard(unsigned index, unsigned nShards_)
+{
+    if (index >= nShards_)
+    {
+        ostringstream ost;
+        ost << "Shard index " << index << " is out of range for " << nShards_ << " shards.";
+        throw runtime_error(ost.str());
+    }
+    
+    shardIndex = index;
+    nShards = nShards_;
+}
+
+
+void EventLoop::SetCheckpoint(string const &fileName, double interval /*= 10.*/)
+{
+    checkpointFileName = fileName;
+    checkpointInterval = chrono::duration<double>(interval);
+}
+
+
+void EventLoop::SetProgressReport(bool on /*= true*/)
+{
+    reportProgress = on;
+}
+
+
+void EventLoop::Run()
+{
+    auto const start = chrono::steady_clock::now();
+    
+    
+    // Make ROOT aware that it is used from several threads
+    TThread::Initialize();
+    
+    
+    // Split the trees and set up the merging of results. Chunks processed before an interruption
+    //are restored from the checkpoint. Empty histograms are added as the first leaf of each tree
+    //by the first shard
+    PlanChunks();
+    
+    results.clear();
+    mergeTrees.clear();
+    
+    for (unsigned iGroup = 0; iGroup < groups.size(); ++iGroup)
+        mergeTrees.emplace_back(nLeaves[iGroup]);
+    
+    if (not checkpointFileName.empty())
+        readerDescription = DescribeReaders();
+    
+    RestoreCheckpoint();
+    
+    for (unsigned iGroup = 0; iGroup < groups.size(); ++iGroup)
+        if (shardIndex == 0 and not mergeTrees[iGroup].Covers(0))
+            mergeTrees[iGroup].Add(0, 0, booker(groups[iGroup].name));
+    
+    
+    // Process the chunks
+    FillWorkQueues();
+    workerException = nullptr;
+    lastCheckpoint = chrono::steady_clock::now();
+    stats = ReaderStats();
+    nEntriesDone = 0;
+    
+    thread progressThread;
+    
+    if (reportProgress)
+    {
+        unsigned long totalEntries = 0;
+        
+        for (auto const &queue: workQueues)
+            totalEntries += queue->nEntries;
+        
+        processingFinished = false;
+        progressThread = thread(&EventLoop::ReportProgress, this, totalEntries);
+    }
+    
+    vector<thread> workers;
+    
+    for (unsigned i = 0; i < nThreads; ++i)
+        workers.emplace_back(&EventLoop::ProcessChunks, this, i);
+    
+    for (auto &w: workers)
+        w.join();
+    
+    if (progressThread.joinable())
+    {
+        {
+            lock_guard<mutex> lock(progressMutex);
+            processingFinished = true;
+        }
+        
+        progressCondition.notify_all();
+        progressThread.join();
+    }
+    
+    runTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    
+    if (workerException)
+    {
+        // Save the processed chunks. A failure to do so must not hide the original error
+        if (not checkpointFileName.empty())
+        {
+            try
+            {
+                WriteCheckpoint();
+            }
+            catch (...)
+            {}
+        }
+        
+        rethrow_exception(workerException);
+    }
+    
+    if (not checkpointFileName.empty())
+        remove(checkpointFileName.c_str());
+    
+    
+    // With a single shard, all histograms have been merged
+    if (nShards == 1)
+        for (auto &tree: mergeTrees)
+            results.emplace_back(tree.TakeResult());
+}
+
+
+EventLoop::HistSet const &EventLoop::GetHists(string const &groupName) const
+{
+    for (unsigned iGroup = 0; iGroup < groups.size(); ++iGroup)
+        if (groups[iGroup].name == groupName and iGroup < results.size())
+            return results[iGroup];
+    
+    throw runtime_error(string("No results for group \"") + groupName + "\".");
+}
+
+
+ReaderStats const &EventLoop::GetStats() const noexcept
+{
+    return stats;
+}
+
+
+double EventLoop::GetRunTime() const noexcept
+{
+    return runTime;
+}
+
+
+void EventLoop::Write(TDirectory &outDirectory) const
+{
+    // Partial results of a shard are stored together with the structure of the merge trees
+    if (nShards > 1)
+    {
+        for (unsigned iGroup = 0; iGroup < mergeTrees.size(); ++iGroup)
+        {
+            TDirectory *groupDirectory = outDirectory.mkdir(
+             ("group" + to_string(iGroup)).c_str(), groups[iGroup].name.c_str());
+            mergeTrees[iGroup].Write(*groupDirectory);
+        }
+        
+        return;
+    }
+    
+    
+    outDirectory.cd();
+    
+    for (auto const &hists: results)
+        for (auto const &h: hists)
+            h->Write();
+}
+
+
+void EventLoop::PlanChunks()
+{
+    chunks.clear();
+    nLeaves.assign(groups.size(), 1);
+    
+    
+    // A flat event file is split along its blocks
+    if (FlatEventFile::IsFlatFile(srcFileName))
+    {
+        flatFile.reset(new FlatEventFile(srcFileName));
+        
+        for (unsigned iGroup = 0; iGroup < groups.size(); ++iGroup)
+            for (auto const &treeName: groups[iGroup].treeNames)
+            {
+                vector<unsigned long> blockEnds;
+                
+                for (auto const &block: flatFile->GetTree(treeName).blocks)
+                    blockEnds.push_back(block.firstEntry + block.nEvents);
+                
+                AddChunks(iGroup, treeName, blockEnds);
+            }
+        
+        return;
+    }
+    
+    flatFile.reset();
+    
+    
+    // Otherwise split the ROOT trees along their clusters
+    unique_ptr<TFile> srcFile(TFile::Open(srcFileName.c_str()));
+    
+    if (not srcFile or srcFile->IsZombie())
+        throw runtime_error(string("The source file \"") + srcFileName +
+         "\" does not exist or is corrupted.");
+    
+    for (unsigned iGroup = 0; iGroup < groups.size(); ++iGroup)
+        for (auto const &treeName: groups[iGroup].treeNames)
+        {
+            unique_ptr<TTree> tree(dynamic_cast<TTree *>(srcFile->Get(treeName.c_str())));
+            
+            if (not tree)
+            {
+                ostringstream ost;
+                ost << "Cannot find tree \"" << treeName << "\" in file \"" << srcFileName <<
+                 "\".";
+                throw runtime_error(ost.str());
+            }
+            
+            Long64_t const nEntries = tree->GetEntries();
+            TTree::TClusterIterator clusterIt = tree->GetClusterIterator(0);
+            vector<unsigned long> clusterEnds;
+            
+            while (clusterIt() < nEntries)
+                clusterEnds.push_back(min(clusterIt.GetNextEntry(), nEntries));
+            
+            AddChunks(iGroup, treeName, clusterEnds);
+        }
+}
+
+
+void EventLoop::AddChunks(unsigned iGroup, string const &treeName,
+ vector<unsigned long> const &clusterEnds)
+{
+    // Accumulate whole clusters until the target size is reached
+    vector<Chunk> treeChunks;
+    unsigned long chunkStart = 0;
+    
+    for (unsigned i = 0; i < clusterEnds.size(); ++i)
+    {
+        unsigned long const clusterEnd = clusterEnds[i];
+        
+        if (clusterEnd - chunkStart >= chunkSize or i + 1 == clusterEnds.size())
+        {
+            treeChunks.push_back({iGroup, treeName, chunkStart, clusterEnd,
+             nLeaves[iGroup] + treeChunks.size()});
+            chunkStart = clusterEnd;
+        }
+    }
+    
+    nLeaves[iGroup] += treeChunks.size();
+    
+    
+    // Keep the slice of the current shard
+    unsigned long const n = treeChunks.size();
+    
+    for (unsigned long i = n * shardIndex / nShards; i < n * (shardIndex + 1) / nShards; ++i)
+        chunks.push_back(treeChunks[i]);
+}
+
+
+void EventLoop::FillWorkQueues()
+{
+    workQueues.clear();
+    
+    for (unsigned i = 0; i < nThreads; ++i)
+    {
+        workQueues.emplace_back(new WorkQueue);
+        workQueues.back()->nEntries = 0;
+    }
+    
+    
+    // Split the ordered list of chunks into contiguous blocks with similar numbers of entries. This
+    //way each thread starts with its own trees and can reuse its reader for consecutive chunks
+    unsigned long totalEntries = 0;
+    
+    for (auto const &c: chunks)
+        totalEntries += c.lastEntry - c.firstEntry;
+    
+    unsigned long cumEntries = 0;
+    
+    for (unsigned iChunk = 0; iChunk < chunks.size(); ++iChunk)
+    {
+        // Skip chunks restored from a checkpoint
+        if (mergeTrees[chunks[iChunk].group].Covers(chunks[iChunk].leaf))
+            continue;
+        
+        unsigned long const size = chunks[iChunk].lastEntry - chunks[iChunk].firstEntry;
+        
+        // The block is chosen by the middle of the chunk
+        unsigned const iThread = min<unsigned long>(
+         (2 * cumEntries + size) * nThreads / (2 * max(totalEntries, 1ul)), nThreads - 1);
+        
+        workQueues[iThread]->chunks.push_back(iChunk);
+        workQueues[iThread]->nEntries += size;
+        cumEntries += size;
+    }
+}
+
+
+bool EventLoop::TakeChunk(unsigned iThread, unsigned &iChunk)
+{
+    // Try the own queue first
+    {
+        WorkQueue &queue = *workQueues[iThread];
+        lock_guard<mutex> lock(queue.mutex);
+        
+        if (not queue.chunks.empty())
+        {
+            iChunk = queue.chunks.front();
+            queue.chunks.pop_front();
+            queue.nEntries -= chunks[iChunk].lastEntry - chunks[iChunk].firstEntry;
+            return true;
+        }
+    }
+    
+    
+    // Steal from the busiest queue. Since the numbers of entries are read without locking all
+    //queues at once, the choice can be outdated, in which case another attempt is made
+    while (true)
+    {
+        unsigned iVictim = iThread;
+        unsigned long maxEntries = 0;
+        
+        for (unsigned i = 0; i < workQueues.size(); ++i)
+        {
+            lock_guard<mutex> lock(workQueues[i]->mutex);
+            
+            if (workQueues[i]->nEntries > maxEntries)
+            {
+                iVictim = i;
+                maxEntries = workQueues[i]->nEntries;
+            }
+        }
+        
+        if (maxEntries == 0)  // no work left anywhere
+            return false;
+        
+        WorkQueue &victim = *workQueues[iVictim];
+        lock_guard<mutex> lock(victim.mutex);
+        
+        if (victim.chunks.empty())
+            continue;
+        
+        iChunk = victim.chunks.back();
+        victim.chunks.pop_back();
+        victim.nEntries -= chunks[iChunk].lastEntry - chunks[iChunk].firstEntry;
+        return true;
+    }
+}
+
+
+void EventLoop::ProcessChunks(unsigned iThread)
+{
+    shared_ptr<TFile> srcFile;
+    unique_ptr<Reader> reader;
+    string readerTreeName;
+    ReaderStats threadStats;
+    
+    try
+    {
+        if (not flatFile)
+        {
+            lock_guard<mutex> lock(rootMutex);
+            srcFile.reset(TFile::Open(srcFileName.c_str()));
+        }
+        
+        
+        while (true)
+        {
+            // Get the next chunk. Stop if another thread has failed
+            unsigned iChunk;
+            
+            if (not TakeChunk(iThread, iChunk))
+                break;
+            
+            {
+                lock_guard<mutex> lock(mergeMutex);
+                
+                if (workerException)
+                    break;
+            }
+            
+            Chunk const &chunk = chunks[iChunk];
+            Group const &group = groups[chunk.group];
+            HistSet hists;
+            
+            
+            // Set up the reader and book histograms. Consecutive chunks of the same tree reuse
+            //the reader
+            {
+                lock_guard<mutex> lock(rootMutex);
+                
+                if (not reader or readerTreeName != chunk.treeName)
+                {
+                    if (reader)
+                        threadStats.Merge(reader->GetStats());
+                    
+                    if (flatFile)
+                        reader.reset(new Reader(flatFile, chunk.treeName, group.isMC));
+                    else
+                        reader.reset(new Reader(srcFile, chunk.treeName, group.isMC));
+                    
+                    readerTreeName = chunk.treeName;
+                    
+                    if (configurator)
+                        configurator(*reader);
+                }
+                
+                reader->SetEntryRange(chunk.firstEntry, chunk.lastEntry);
+                hists = booker(group.name);
+            }
+            
+            
+            // Process the events
+            while (reader->ReadNextEvent())
+                processor(*reader, hists);
+            
+            StoreChunkResult(iChunk, move(hists));
+        }
+        
+        if (reader)
+            threadStats.Merge(reader->GetStats());
+    }
+    catch (...)
+    {
+        lock_guard<mutex> lock(mergeMutex);
+        
+        if (not workerException)
+            workerException = current_exception();
+    }
+    
+    
+    // Closing the file modifies global state of ROOT
+    {
+        lock_guard<mutex> lock(rootMutex);
+        reader.reset();
+        srcFile.reset();
+    }
+    
+    
+    // Add the counters of this thread to the total
+    lock_guard<mutex> lock(mergeMutex);
+    stats.Merge(threadStats);
+}
+
+
+void EventLoop::StoreChunkResult(unsigned iChunk, HistSet &&hists)
+{
+    lock_guard<mutex> lock(mergeMutex);
+    
+    Chunk const &chunk = chunks[iChunk];
+    mergeTrees[chunk.group].Add(0, chunk.leaf, move(hists));
+    nEntriesDone += chunk.lastEntry - chunk.firstEntry;
+    
+    
+    // Save the progress if enough time has passed. The interval is counted from the end of the
+    //previous write, so that the overhead stays bounded even if writing is slow
+    if (not checkpointFileName.empty() and
+     chrono::steady_clock::now() - lastCheckpoint >= checkpointInterval)
+    {
+        WriteCheckpoint();
+        lastCheckpoint = chrono::steady_clock::now();
+    }
+}
+
+
+string EventLoop::DescribeChunks() const
+{
+    ostringstream description;
+    description << srcFileName << '\n' << chunkSize << '\n' << shardIndex << '/' << nShards << '\n';
+    
+    for (unsigned iGroup = 0; iGroup < groups.size(); ++iGroup)
+    {
+        description << groups[iGroup].name << ':';
+        
+        for (auto const &treeName: groups[iGroup].treeNames)
+            description << ' ' << treeName;
+        
+        description << "; " << nLeaves[iGroup] << " leaves\n";
+    }
+    
+    description << readerDescription;
+    return description.str();
+}
+
+
+string EventLoop::DescribeReaders()
+{
+    if (not configurator or chunks.empty())
+        return "";
+    
+    
+    // Readers for all chunks are configured in the same way, so any of them can be used
+    Chunk const &chunk = chunks.front();
+    bool const isMC = groups[chunk.group].isMC;
+    unique_ptr<Reader> reader;
+    shared_ptr<TFile> srcFile;
+    
+    if (flatFile)
+        reader.reset(new Reader(flatFile, chunk.treeName, isMC));
+    else
+    {
+        srcFile.reset(TFile::Open(srcFileName.c_str()));
+        
+        if (not srcFile or srcFile->IsZombie())
+            throw runtime_error(string("The source file \"") + srcFileName +
+             "\" does not exist or is corrupted.");
+        
+        reader.reset(new Reader(srcFile, chunk.treeName, isMC));
+    }
+    
+    configurator(*reader);
+    string const description(reader->DescribeSelection());
+    
+    
+    // The reader must be destroyed before the file it reads
+    reader.reset();
+    return description;
+}
+
+
+void EventLoop::WriteCheckpoint()
+{
+    // Creating a file touches global state of ROOT
+    lock_guard<mutex> lock(rootMutex);
+    
+    string const tmpFileName(checkpointFileName + ".tmp");
+    
+    {
+        unique_ptr<TFile> file(TFile::Open(tmpFileName.c_str(), "recreate"));
+        
+        if (not file or file->IsZombie())
+            throw runtime_error(string("Cannot create file \"") + tmpFileName + "\".");
+        
+        TNamed const description("chunks", DescribeChunks().c_str());
+        file->WriteTObject(&description);
+        
+        for (unsigned iGroup = 0; iGroup < mergeTrees.size(); ++iGroup)
+            mergeTrees[iGroup].Write(*file->mkdir(("group" + to_string(iGroup)).c_str()));
+        
+        file->Close();
+    }
+    
+    if (rename(tmpFileName.c_str(), checkpointFileName.c_str()) != 0)
+        throw runtime_error(string("Failed to write file \"") + checkpointFileName + "\".");
+}
+
+
+void EventLoop::RestoreCheckpoint()
+{
+    if (checkpointFileName.empty())
+        return;
+    
+    
+    // A missing file is not an error: the run starts from the beginning
+    if (not ifstream(checkpointFileName))
+        return;
+    
+    unique_ptr<TFile> file(TFile::Open(checkpointFileName.c_str()));
+    
+    if (not file or file->IsZombie())
+        throw runtime_error(string("Checkpoint file \"") + checkpointFileName +
+         "\" is corrupted.");
+    
+    
+    // Make sure the checkpoint has been written for the same chunks
+    unique_ptr<TNamed> description(dynamic_cast<TNamed *>(file->Get("chunks")));
+    
+    if (not description or description->GetTitle() != DescribeChunks())
+        throw runtime_error(string("Checkpoint file \"") + checkpointFileName +
+         "\" has been written by a different job. Remove it to start from the beginning.");
+    
+    
+    for (unsigned iGroup = 0; iGroup < mergeTrees.size(); ++iGroup)
+    {
+        TDirectory *groupDirectory = file->GetDirectory(("group" + to_string(iGroup)).c_str());
+        
+        if (not groupDirectory)
+            throw runtime_error(string("Checkpoint file \"") + checkpointFileName +
+             "\" is corrupted.");
+        
+        mergeTrees[iGroup].Read(*groupDirectory);
+    }
+}
+
+
+void EventLoop::ReportProgress(unsigned long totalEntries)
+{
+    auto const start = chrono::steady_clock::now();
+    unique_lock<mutex> lock(progressMutex);
+    
+    
+    // Print a line once per second, overwriting the previous one. The rate is averaged over the
+    //whole run since the progress advances by chunks
+    while (true)
+    {
+        bool const finished =
+         progressCondition.wait_for(lock, chrono::seconds(1), [this]{return processingFinished;});
+        
+        unsigned long const nDone = nEntriesDone;
+        double const elapsed =
+         chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double const rate = (elapsed > 0. ? nDone / elapsed : 0.);
+        
+        ostringstream line;
+        line << fixed << "\rProcessed " << nDone << " / " << totalEntries << " entries (" <<
+         setprecision(1) << (totalEntries > 0 ? 100. * nDone / totalEntries : 100.) << "%), " <<
+         setprecision(0) << rate << " entries/s";
+        
+        if (finished)
+        {
+            line << ", done in " << setprecision(1) << elapsed << " s";
+            cerr << line.str() << endl;
+            break;
+        }
+        
+        if (rate > 0.)
+        {
+            unsigned long const eta = (totalEntries - nDone) / rate;
+            line << ", ETA " << eta / 60 << ":" << setw(2) << setfill('0') << eta % 60;
+        }
+        
+        cerr << line.str() << "    " << flush;
+    }
+}
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <Reader.hpp>
+#include <Group.hpp>
+#include <FlatEventFile.hpp>
+#include <HistMergeTree.hpp>
+#include <ReaderStats.hpp>
+
+#include <TH1.h>
+#include <TDirectory.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
+
+
+/**
+ * \class EventLoop
+ * \brief Processes groups of trees with several threads and merges the filled histograms
+ * 
+ * Each tree is split into chunks of entries aligned with the clusters of the tree. The chunks of
+ * all groups are processed by a pool of threads. Every thread opens its own copy of the source file
+ * and reads it with its own Reader. Initially each thread is given a contiguous block of chunks
+ * with about the same total number of entries. A thread that has run out of work steals chunks from
+ * the end of the block of the thread with the largest amount of remaining work, so that the wall
+ * time is bounded by the total amount of work rather than by the largest group or tree. Each chunk
+ * fills its own set of histograms, booked by a user-supplied function, and the histograms of all
+ * chunks of a group are added together following a fixed binary tree over the chunks (see
+ * HistMergeTree). Since neither the boundaries of the chunks nor the order of additions depend on
+ * the number of threads, the result is the same for any number of threads, including one.
+ * 
+ * A long run can be protected against crashes and preemption with the method SetCheckpoint. The
+ * merge trees are then periodically saved to a file, and a restarted run resumes from the chunks
+ * that have not been saved yet. Since restored histograms take the same places in the merge trees,
+ * the final result is identical to that of an uninterrupted run.
+ * 
+ * The work can also be split among several independent jobs with the method SetShard. Each job
+ * then processes a slice of chunks of every tree and writes partially merged histograms, which are
+ * combined by the program mergeShards into the same result as produced by a single job.
+ * 
+ * The source file can also be a FlatEventFile. It is recognised automatically and mapped into
+ * memory once, and all threads read it in place. Chunks are then aligned with its blocks.
+ */
+class EventLoop
+{
+public:
+    /// A set of histograms filled for one group or one chunk
+    typedef std::vector<std::unique_ptr<TH1>> HistSet;
+    
+    /// Function that books (empty) histograms for the group with the given name
+    typedef std::function<HistSet(std::string const &groupName)> HistBooker;
+    
+    /**
+     * \brief Function that processes the current event of the reader
+     * 
+     * It is called concurrently from several threads, each time with a different reader and set
+     * of histograms. Hence it must not modify any shared state.
+     */
+    typedef std::function<void(Reader &reader, HistSet &hists)> EventProcessor;
+    
+    /// Function that configures a freshly created reader, e.g. selects branches to be read
+    typedef std::function<void(Reader &reader)> ReaderConfigurator;
+    
+public:
+    /**
+     * \brief Constructor
+     * 
+     * Arguments are the name of the source file, groups of trees to be processed, a function to
+     * book histograms for a group, and a function to process an event.
+     */
+    EventLoop(std::string const &srcFileName, std::list<Group> const &groups,
+     HistBooker const &booker, EventProcessor const &processor);
+    
+public:
+    /**
+     * \brief Sets the number of threads
+     * 
+     * Zero means the number of concurrent threads supported by the hardware. By default it is 1.
+     */
+    void SetNumThreads(unsigned nThreads);
+    
+    /**
+     * \brief Sets the target number of entries in a chunk
+     * 
+     * Chunks are made of whole clusters, so the actual size is rounded up to the cluster boundary.
+     * The size should not be changed between runs whose results are to be compared bit by bit.
+     */
+    void SetChunkSize(unsigned long chunkSize);
+    
+    /// Sets a function to be applied to each reader after its creation
+    void SetReaderConfigurator(ReaderConfigurator const &configurator);
+    
+    /**
+     * \brief Restricts processing to the given shard out of nShards
+     * 
+     * The chunks of each tree are split into nShards contiguous slices of about the same size, and
+     * only the slice with the given index is processed. When there is more than one shard, the
+     * histograms of groups are not complete: the method GetHists cannot be used, and the method
+     * Write stores partially merged histograms to be combined later. By default there is a single
+     * shard. An exception is thrown if the index is out of range.
+     */
+    void SetShard(unsigned index, unsigned nShards);
+    
+    /**
+     * \brief Enables checkpointing into the file with the given name
+     * 
+     * When a chunk has been processed and at least the given number of seconds has passed since
+     * the last checkpoint, histograms of all processed chunks are written into the file. A
+     * checkpoint is also written if a worker thread fails. If the file exists when the method Run
+     * is called, processed chunks are restored from it and are not read again. The file is removed
+     * after a successful run. An exception is thrown by Run if the file has been written for a
+     * different source file, groups, chunk size, or shard, or with readers that apply a different
+     * selection (see Reader::DescribeSelection). Changes to the event processor and to the lepton
+     * preselection are not detected.
+     */
+    void SetCheckpoint(std::string const &fileName, double interval = 10.);
+    
+    /**
+     * \brief Enables or disables printing of the progress
+     * 
+     * When enabled, a line with the number of processed entries, the current rate, and the
+     * estimated remaining time is updated on the standard error once per second while Run is
+     * working. The progress advances by whole chunks. Disabled by default.
+     */
+    void SetProgressReport(bool on = true);
+    
+    /**
+     * \brief Processes all groups
+     * 
+     * Exceptions thrown in worker threads are rethrown by this method.
+     */
+    void Run();
+    
+    /**
+     * \brief Returns histograms for the group with the given name
+     * 
+     * Throws an exception if there is no such group.
+     */
+    HistSet const &GetHists(std::string const &groupName) const;
+    
+    /// Returns counters of reading and processing, summed over all readers used by Run
+    ReaderStats const &GetStats() const noexcept;
+    
+    /// Returns the wall time taken by the last call to Run, in seconds
+    double GetRunTime() const noexcept;
+    
+    /**
+     * \brief Writes histograms of all groups into the given directory, group by group
+     * 
+     * When processing one of several shards, each group is written instead into a subdirectory
+     * "group<i>", where i is the index of the group, as a partially merged HistMergeTree.
+     */
+    void Write(TDirectory &outDirectory) const;
+    
+private:
+    /// A range of entries in one tree
+    struct Chunk
+    {
+        /// Index of the group in the list of groups
+        unsigned group;
+        
+        /// Name of the tree
+        std::string treeName;
+        
+        /// Range of entries, [firstEntry, lastEntry)
+        unsigned long firstEntry, lastEntry;
+        
+        /// Index of the leaf in the merge tree of the group
+        unsigned long leaf;
+    };
+    
+    /**
+     * \brief Chunks assigned to a worker thread
+     * 
+     * The owner takes chunks from the front, while other threads steal them from the back.
+     */
+    struct WorkQueue
+    {
+        /// Indices of chunks to be processed
+        std::deque<unsigned> chunks;
+        
+        /// Total number of entries in the chunks
+        unsigned long nEntries;
+        
+        /// Mutex to protect the queue
+        std::mutex mutex;
+    };
+    
+private:
+    /// Splits all trees into chunks
+    void PlanChunks();
+    
+    /**
+     * \brief Adds chunks for the given tree
+     * 
+     * The boundaries of the chunks are chosen among the given ends of clusters of the tree. Only
+     * the chunks of the current shard are added, but all of them are counted as leaves of the
+     * merge tree.
+     */
+    void AddChunks(unsigned iGroup, std::string const &treeName,
+     std::vector<unsigned long> const &clusterEnds);
+    
+    /// Distributes chunks among the queues of the worker threads
+    void FillWorkQueues();
+    
+    /**
+     * \brief Provides the given worker thread with the next chunk to process
+     * 
+     * Takes the chunk from the own queue of the thread or, if it is empty, steals it from the queue
+     * with the largest number of remaining entries. Returns false if there are no chunks left.
+     */
+    bool TakeChunk(unsigned iThread, unsigned &iChunk);
+    
+    /// Body of worker threads. Processes chunks until there are none left
+    void ProcessChunks(unsigned iThread);
+    
+    /**
+     * \brief Saves histograms of a processed chunk
+     * 
+     * The histograms are added to the merge tree of the group and merged with all available
+     * siblings.
+     */
+    void StoreChunkResult(unsigned iChunk, HistSet &&hists);
+    
+    /**
+     * \brief Describes the splitting of work into chunks and the configuration of readers
+     * 
+     * A checkpoint can only be restored by a run with the same description.
+     */
+    std::string DescribeChunks() const;
+    
+    /**
+     * \brief Describes the selection applied by readers set up with the configurator
+     * 
+     * A reader for the first chunk is created and configured to obtain the description (see
+     * Reader::DescribeSelection). Returns an empty string if there is no configurator or no
+     * chunks.
+     */
+    std::string DescribeReaders();
+    
+    /**
+     * \brief Writes the merge trees into the checkpoint file
+     * 
+     * The file is first written under a temporary name, so that an interrupted write does not
+     * destroy the previous checkpoint. Must be called with the mutex mergeMutex locked or when no
+     * worker threads are running.
+     */
+    void WriteCheckpoint();
+    
+    /// Reads the merge trees from the checkpoint file if it exists
+    void RestoreCheckpoint();
+    
+    /// Body of the thread that prints the progress until the processing is finished
+    void ReportProgress(unsigned long totalEntries);
+    
+private:
+    /// Name of the source file
+    std::string srcFileName;
+    
+    /// The source file if it is a flat event file, shared by all threads. Null otherwise
+    std::shared_ptr<FlatEventFile> flatFile;
+    
+    /// Groups of trees to process
+    std::vector<Group> groups;
+    
+    /// Function to book histograms
+    HistBooker booker;
+    
+    /// Function to process an event
+    EventProcessor processor;
+    
+    /// Function to configure readers
+    ReaderConfigurator configurator;
+    
+    /// Number of threads
+    unsigned nThreads;
+    
+    /// Target number of entries in a chunk
+    unsigned long chunkSize;
+    
+    /// Index of the shard to process and the total number of shards
+    unsigned shardIndex, nShards;
+    
+    /// Name of the checkpoint file. Empty if checkpointing is disabled
+    std::string checkpointFileName;
+    
+    /// Description of the selection applied by readers, included in the checkpoints
+    std::string readerDescription;
+    
+    /// Minimal time between two checkpoints
+    std::chrono::duration<double> checkpointInterval;
+    
+    /// Time when the last checkpoint has been written
+    std::chrono::steady_clock::time_point lastCheckpoint;
+    
+    /// Indicates if the progress should be printed
+    bool reportProgress;
+    
+    /// Number of entries in the chunks processed in the current run
+    std::atomic<unsigned long> nEntriesDone;
+    
+    /// Flag that tells the thread printing the progress to stop, protected by progressMutex
+    bool processingFinished;
+    
+    /// Mutex and condition variable to stop the thread printing the progress
+    std::mutex progressMutex;
+    std::condition_variable progressCondition;
+    
+    /// Counters of all readers
+    ReaderStats stats;
+    
+    /// Wall time of the last run, in seconds
+    double runTime;
+    
+    /// Chunks of the current shard, ordered by group, tree, and entries
+    std::vector<Chunk> chunks;
+    
+    /**
+     * \brief Number of leaves in the merge tree of each group
+     * 
+     * It includes the chunks of all shards and an additional leaf 0 with empty histograms, which
+     * makes sure that each group has a result.
+     */
+    std::vector<unsigned long> nLeaves;
+    
+    /// Queues of chunks for each worker thread
+    std::vector<std::unique_ptr<WorkQueue>> workQueues;
+    
+    /// Partially merged histograms for each group
+    std::vector<HistMergeTree> mergeTrees;
+    
+    /// Merged histograms for each group. Filled only when there is a single shard
+    std::vector<HistSet> results;
+    
+    /// Mutex to protect merging of results
+    std::mutex mergeMutex;
+    
+    /**
+     * \brief Mutex to serialise creation of ROOT objects in worker threads
+     * 
+     * Opening files, getting trees, and booking histograms touch global state of ROOT.
+     */
+    std::mutex rootMutex;
+    
+    /// The first exception thrown in a worker thread
+    std::exception_ptr workerException;
+};
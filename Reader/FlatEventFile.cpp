@@ -0,0 +1,276 @@
+#include <FlatEventFile.hpp>
+#include <Reader.hpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <functional>
+
+
+using namespace std;
+
+
+// Static data members
+char const FlatEventFile::magic[8] = {'C', 'M', 'S', 'D', 'A', 'S', 'F', 'E'};
+uint32_t const FlatEventFile::version;
+
+
+/// Visitor that points fields of a block to consecutive columns of the given length
+struct ColumnLocator
+{
+    /// Returns the address of the next column of the given length
+    function<void const *(uint64_t)> const &column;
+    
+    /// Number of elements in each column
+    uint64_t length;
+    
+    template<typename Field, typename T>
+    void operator()(Field const &, T const *&field) const
+    {
+        field = static_cast<T const *>(column(length));
+    }
+};
+
+
+FlatEventFile::FlatEventFile(string const &fileName_):
+    fileName(fileName_), data(nullptr), size(0)
+{
+    // Map the whole file into memory
+    int const fd = open(fileName.c_str(), O_RDONLY);
+    
+    if (fd < 0)
+        throw runtime_error(string("Cannot open file \"") + fileName + "\".");
+    
+    struct stat fileStat;
+    
+    if (fstat(fd, &fileStat) != 0)
+    {
+        close(fd);
+        throw runtime_error(string("Cannot determine the size of file \"") + fileName + "\".");
+    }
+    
+    size = fileStat.st_size;
+    void *address = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    
+    if (address == MAP_FAILED)
+        throw runtime_error(string("Cannot map file \"") + fileName + "\" into memory.");
+    
+    data = static_cast<char const *>(address);
+    
+    
+    // Events are usually read sequentially
+    madvise(address, size, MADV_SEQUENTIAL);
+    
+    
+    // Parse the index. Unmap the file if it is not valid
+    try
+    {
+        ParseIndex();
+    }
+    catch (...)
+    {
+        munmap(const_cast<char *>(data), size);
+        throw;
+    }
+}
+
+
+FlatEventFile::~FlatEventFile()
+{
+    munmap(const_cast<char *>(data), size);
+}
+
+
+bool FlatEventFile::IsFlatFile(string const &fileName)
+{
+    ifstream file(fileName, ios::binary);
+    char buffer[sizeof(magic)];
+    
+    if (not file.read(buffer, sizeof(magic)))
+        return false;
+    
+    return (memcmp(buffer, magic, sizeof(magic)) == 0);
+}
+
+
+string const &FlatEventFile::GetName() const noexcept
+{
+    return fileName;
+}
+
+
+FlatEventFile::Tree const &FlatEventFile::GetTree(string const &name) const
+{
+    for (auto const &t: trees)
+        if (t.name == name)
+            return t;
+    
+    ostringstream ost;
+    ost << "Cannot find tree \"" << name << "\" in file \"" << fileName << "\".";
+    throw runtime_error(ost.str());
+}
+
+
+void FlatEventFile::ParseIndex()
+{
+    // A cursor that reads consecutive fields of the file and checks the bounds
+    size_t pos = 0;
+    
+    auto read = [this, &pos](void *dst, size_t nBytes)
+    {
+        if (pos > size or nBytes > size - pos)
+            ThrowCorrupted();
+        
+        memcpy(dst, data + pos, nBytes);
+        pos += nBytes;
+    };
+    
+    
+    // Check the header
+    char fileMagic[sizeof(magic)];
+    uint32_t fileVersion, reserved;
+    uint64_t indexOffset;
+    
+    read(fileMagic, sizeof(fileMagic));
+    read(&fileVersion, sizeof(fileVersion));
+    read(&reserved, sizeof(reserved));
+    read(&indexOffset, sizeof(indexOffset));
+    
+    if (memcmp(fileMagic, magic, sizeof(magic)) != 0)
+        throw runtime_error(string("File \"") + fileName + "\" is not a flat event file.");
+    
+    if (fileVersion != version)
+    {
+        ostringstream ost;
+        ost << "File \"" << fileName << "\" has version " << fileVersion << " of the format " <<
+         "while version " << version << " is supported.";
+        throw runtime_error(ost.str());
+    }
+    
+    
+    // Read the index of trees
+    pos = indexOffset;
+    uint32_t nTrees;
+    read(&nTrees, sizeof(nTrees));
+    
+    for (unsigned iTree = 0; iTree < nTrees; ++iTree)
+    {
+        Tree tree;
+        
+        uint32_t nameLength;
+        read(&nameLength, sizeof(nameLength));
+        
+        if (pos + nameLength > size)
+            ThrowCorrupted();
+        
+        tree.name.assign(data + pos, nameLength);
+        pos += nameLength;
+        
+        uint64_t nEntries;
+        uint32_t nBlocks;
+        read(&nEntries, sizeof(nEntries));
+        read(&nBlocks, sizeof(nBlocks));
+        tree.nEntries = nEntries;
+        
+        unsigned long firstEntry = 0;
+        
+        for (unsigned iBlock = 0; iBlock < nBlocks; ++iBlock)
+        {
+            uint64_t blockOffset, nEvents;
+            read(&blockOffset, sizeof(blockOffset));
+            read(&nEvents, sizeof(nEvents));
+            
+            
+            // Read the header of the block
+            size_t const indexPos = pos;
+            pos = blockOffset;
+            
+            if (blockOffset % 8 != 0)
+                ThrowCorrupted();
+            
+            uint64_t counts[5];  // events, leptons, jets, jets JEC up, jets JEC down
+            read(counts, sizeof(counts));
+            
+            if (counts[0] != nEvents)
+                ThrowCorrupted();
+            
+            
+            // Locate the columns. They are laid out one after another
+            function<void const *(uint64_t)> const column =
+             [this, &pos](uint64_t length) -> void const *
+            {
+                // All columns contain 4-byte numbers. The length is compared in a way that cannot
+                //overflow
+                if (pos > size or length > (size - pos) / 4)
+                    ThrowCorrupted();
+                
+                void const *address = data + pos;
+                pos += 4 * length;
+                return address;
+            };
+            
+            // The offsets of objects are used without further checks when events are loaded. They
+            //must start from zero, must not decrease, must end at the number of objects, and must
+            //give at most Reader::maxSize objects per event
+            auto offsetColumn = [&](uint64_t nObjects)
+            {
+                uint32_t const *offsets = static_cast<uint32_t const *>(column(nEvents + 1));
+                
+                if (offsets[0] != 0 or offsets[nEvents] != nObjects)
+                    ThrowCorrupted();
+                
+                for (uint64_t i = 0; i < nEvents; ++i)
+                    if (offsets[i + 1] < offsets[i] or
+                     offsets[i + 1] - offsets[i] > Reader::maxSize)
+                        ThrowCorrupted();
+                
+                return offsets;
+            };
+            
+            auto lepColumns = [&](LeptonBlock &l, uint64_t n)
+            {
+                l.offsets = offsetColumn(n);
+                BranchSchema::ForEachLeptonField(ColumnLocator{column, n}, l);
+            };
+            
+            auto jetColumns = [&](JetBlock &j, uint64_t n)
+            {
+                j.offsets = offsetColumn(n);
+                BranchSchema::ForEachJetField(ColumnLocator{column, n}, j);
+            };
+            
+            Block block;
+            block.firstEntry = firstEntry;
+            block.nEvents = nEvents;
+            
+            lepColumns(block.leptons, counts[1]);
+            jetColumns(block.jets, counts[2]);
+            jetColumns(block.jetsJECUp, counts[3]);
+            jetColumns(block.jetsJECDown, counts[4]);
+            
+            BranchSchema::ForEachEventField(ColumnLocator{column, nEvents}, block);
+            
+            tree.blocks.push_back(block);
+            firstEntry += nEvents;
+            pos = indexPos;
+        }
+        
+        if (firstEntry != tree.nEntries)
+            ThrowCorrupted();
+        
+        trees.emplace_back(move(tree));
+    }
+}
+
+
+void FlatEventFile::ThrowCorrupted() const
+{
+    throw runtime_error(string("File \"") + fileName + "\" is corrupted.");
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <BranchSchema.hpp>
+
+#include <Rtypes.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+/**
+ * \class FlatEventFile
+ * \brief A read-only, memory-mapped file with events stored in a flat columnar format
+ * 
+ * The file contains several trees, each split into blocks of events. A block is an uncompressed
+ * image of an EventBatch: leptons and jets of all events in the block are stored in contiguous
+ * columns together with the offsets of the first object of each event, and per-event quantities
+ * are stored in columns with one element per event. Objects are ordered in pt within each event.
+ * Files are created with the class FlatEventWriter.
+ * 
+ * The whole file is mapped into memory, and the columns are accessed in place without any copying
+ * or decoding. The layout of the file is the following (all numbers use the native byte order):
+ * 
+ *   header:  char magic[8], uint32 version, uint32 reserved, uint64 offset of the index
+ *   block:   uint64 nEvents, nLeptons, nJets, nJetsJECUp, nJetsJECDown; columns of leptons, jets
+ *            (nominal, JEC up, JEC down), and per-event quantities, each collection starting with
+ *            the offsets and followed by the fields in the order of BranchSchema
+ *   index:   uint32 nTrees; for each tree: uint32 length of name, name, uint64 nEntries,
+ *            uint32 nBlocks; for each block: uint64 offset, uint64 nEvents
+ * 
+ * Blocks start at offsets that are multiples of 8 bytes.
+ */
+class FlatEventFile
+{
+public:
+    /// Columns describing leptons in a block
+    struct LeptonBlock: public LeptonFields<PointerStorage>
+    {
+        /// Offsets of the first lepton of each event; there is one more offset than events
+        std::uint32_t const *offsets;
+    };
+    
+    /// Columns describing jets in a block
+    struct JetBlock: public JetFields<PointerStorage>
+    {
+        /// Offsets of the first jet of each event; there is one more offset than events
+        std::uint32_t const *offsets;
+    };
+    
+    /// A block of consecutive events in a tree. Per-event columns are inherited from EventFields
+    struct Block: public EventFields<PointerStorage>
+    {
+        /// Index of the first event of the block in the tree
+        unsigned long firstEntry;
+        
+        /// Number of events in the block
+        unsigned long nEvents;
+        
+        /// Leptons
+        LeptonBlock leptons;
+        
+        /// Jets, nominal and with JEC variations
+        JetBlock jets, jetsJECUp, jetsJECDown;
+    };
+    
+    /// Description of a tree
+    struct Tree
+    {
+        /// Name of the tree
+        std::string name;
+        
+        /// Total number of events
+        unsigned long nEntries;
+        
+        /// Blocks of events, ordered in entries
+        std::vector<Block> blocks;
+    };
+    
+public:
+    /// Signature at the beginning of each file
+    static char const magic[8];
+    
+    /// Version of the format
+    static std::uint32_t const version = 1;
+    
+public:
+    /**
+     * \brief Constructor from the name of the file
+     * 
+     * The file is mapped into memory and its index is parsed. An exception is thrown if the file
+     * cannot be opened or is not a valid flat event file.
+     */
+    FlatEventFile(std::string const &fileName);
+    
+    /// Copy constructor is disabled
+    FlatEventFile(FlatEventFile const &) = delete;
+    
+    /// Assignment operator is disabled
+    FlatEventFile &operator=(FlatEventFile const &) = delete;
+    
+    /// Destructor. Unmaps the file
+    ~FlatEventFile();
+    
+public:
+    /// Checks if the file with the given name starts with the signature of a flat event file
+    static bool IsFlatFile(std::string const &fileName);
+    
+    /// Returns the name of the file
+    std::string const &GetName() const noexcept;
+    
+    /**
+     * \brief Returns the tree with the given name
+     * 
+     * Throws an exception if there is no such tree.
+     */
+    Tree const &GetTree(std::string const &name) const;
+    
+private:
+    /// Parses the index and the headers of all blocks
+    void ParseIndex();
+    
+    /// Throws an exception reporting that the file is corrupted
+    [[noreturn]] void ThrowCorrupted() const;
+    
+private:
+    /// Name of the file
+    std::string fileName;
+    
+    /// Address of the mapped file
+    char const *data;
+    
+    /// Size of the file, in bytes
+    std::size_t size;
+    
+    /// Trees in the file
+    std::vector<Tree> trees;
+};
@@ -0,0 +1,164 @@
+#include <FlatEventWriter.hpp>
+#include <FlatEventFile.hpp>
+
+#include <stdexcept>
+
+
+using namespace std;
+
+
+/// Writes the content of a vector into the file
+template<typename T>
+static void WriteColumn(ofstream &out, vector<T> const &column)
+{
+    static_assert(sizeof(T) == 4, "FlatEventFile expects columns of 4-byte numbers.");
+    out.write(reinterpret_cast<char const *>(column.data()), column.size() * sizeof(T));
+}
+
+
+/// Visitor that writes columns one after another
+struct ColumnWriter
+{
+    /// Output stream
+    ofstream &out;
+    
+    template<typename Field, typename T>
+    void operator()(Field const &, vector<T> const &column) const
+    {
+        WriteColumn(out, column);
+    }
+};
+
+
+FlatEventWriter::FlatEventWriter(string const &fileName_):
+    fileName(fileName_), out(fileName, ios::binary | ios::trunc), treeOpen(false)
+{
+    if (not out)
+        throw runtime_error(string("Cannot create the output file \"") + fileName + "\".");
+    
+    
+    // Write the header. The offset of the index is not known yet and will be updated when the
+    //file is closed
+    uint32_t const version = FlatEventFile::version;
+    uint32_t const reserved = 0;
+    uint64_t const indexOffset = 0;
+    
+    out.write(FlatEventFile::magic, sizeof(FlatEventFile::magic));
+    out.write(reinterpret_cast<char const *>(&version), sizeof(version));
+    out.write(reinterpret_cast<char const *>(&reserved), sizeof(reserved));
+    out.write(reinterpret_cast<char const *>(&indexOffset), sizeof(indexOffset));
+}
+
+
+FlatEventWriter::~FlatEventWriter()
+{
+    // Exceptions must not escape the destructor. The user should call Close explicitly to be
+    //notified about write errors
+    try
+    {
+        if (out.is_open())
+            Close();
+    }
+    catch (...)
+    {}
+}
+
+
+void FlatEventWriter::BeginTree(string const &name)
+{
+    if (treeOpen)
+        EndTree();
+    
+    trees.push_back({name, {}});
+    treeOpen = true;
+}
+
+
+void FlatEventWriter::WriteBlock(EventBatch const &batch)
+{
+    if (not treeOpen)
+        throw logic_error("FlatEventWriter::WriteBlock: BeginTree has not been called.");
+    
+    if (batch.nEvents == 0)
+        return;
+    
+    
+    // Align the block at 8 bytes
+    while (out.tellp() % 8 != 0)
+        out.put(0);
+    
+    uint64_t const blockOffset = out.tellp();
+    trees.back().blocks.emplace_back(blockOffset, batch.nEvents);
+    
+    
+    // Write the header of the block
+    uint64_t const counts[5] = {batch.nEvents, batch.leptons.pt.size(), batch.jets.pt.size(),
+     batch.jetsJECUp.pt.size(), batch.jetsJECDown.pt.size()};
+    out.write(reinterpret_cast<char const *>(counts), sizeof(counts));
+    
+    
+    // Write the columns in the order expected by FlatEventFile
+    WriteColumn(out, batch.leptons.offsets);
+    BranchSchema::ForEachLeptonField(ColumnWriter{out}, batch.leptons);
+    
+    for (JetColumns const *j: {&batch.jets, &batch.jetsJECUp, &batch.jetsJECDown})
+    {
+        WriteColumn(out, j->offsets);
+        BranchSchema::ForEachJetField(ColumnWriter{out}, *j);
+    }
+    
+    BranchSchema::ForEachEventField(ColumnWriter{out}, batch);
+}
+
+
+void FlatEventWriter::EndTree()
+{
+    treeOpen = false;
+}
+
+
+void FlatEventWriter::Close()
+{
+    if (treeOpen)
+        EndTree();
+    
+    
+    // Write the index
+    uint64_t const indexOffset = out.tellp();
+    uint32_t const nTrees = trees.size();
+    out.write(reinterpret_cast<char const *>(&nTrees), sizeof(nTrees));
+    
+    for (auto const &t: trees)
+    {
+        uint32_t const nameLength = t.name.size();
+        out.write(reinterpret_cast<char const *>(&nameLength), sizeof(nameLength));
+        out.write(t.name.data(), nameLength);
+        
+        uint64_t nEntries = 0;
+        
+        for (auto const &b: t.blocks)
+            nEntries += b.second;
+        
+        uint32_t const nBlocks = t.blocks.size();
+        out.write(reinterpret_cast<char const *>(&nEntries), sizeof(nEntries));
+        out.write(reinterpret_cast<char const *>(&nBlocks), sizeof(nBlocks));
+        
+        for (auto const &b: t.blocks)
+        {
+            out.write(reinterpret_cast<char const *>(&b.first), sizeof(b.first));
+            out.write(reinterpret_cast<char const *>(&b.second), sizeof(b.second));
+        }
+    }
+    
+    
+    // Update the offset of the index in the header
+    out.seekp(sizeof(FlatEventFile::magic) + 2 * sizeof(uint32_t));
+    out.write(reinterpret_cast<char const *>(&indexOffset), sizeof(indexOffset));
+    
+    bool const failed = out.fail();
+    out.close();
+    
+    if (failed)
+        throw runtime_error(string("Failed to write file \"") + fileName + "\".");
+}
+
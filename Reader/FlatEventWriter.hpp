@@ -0,0 +1,83 @@
+#pragma once
+
+#include <EventBatch.hpp>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+
+/**
+ * \class FlatEventWriter
+ * \brief Writes batches of events into a file of the format read by the class FlatEventFile
+ * 
+ * The user is expected to call BeginTree, then WriteBlock for each batch of events, and EndTree for
+ * each tree. Each batch becomes a block in the file. The index of the trees is written when the
+ * file is closed.
+ */
+class FlatEventWriter
+{
+public:
+    /**
+     * \brief Constructor from the name of the output file
+     * 
+     * The file is recreated. An exception is thrown if it cannot be opened.
+     */
+    FlatEventWriter(std::string const &fileName);
+    
+    /// Copy constructor is disabled
+    FlatEventWriter(FlatEventWriter const &) = delete;
+    
+    /// Assignment operator is disabled
+    FlatEventWriter &operator=(FlatEventWriter const &) = delete;
+    
+    /// Destructor. Closes the file if it has not been closed yet
+    ~FlatEventWriter();
+    
+public:
+    /// Starts a new tree with the given name
+    void BeginTree(std::string const &name);
+    
+    /**
+     * \brief Writes the batch as a new block of the current tree
+     * 
+     * Objects in the batch must be ordered in pt, as is done by Reader::ReadBatch. Empty batches
+     * are ignored.
+     */
+    void WriteBlock(EventBatch const &batch);
+    
+    /// Completes the current tree
+    void EndTree();
+    
+    /**
+     * \brief Writes the index and closes the file
+     * 
+     * An exception is thrown if a write error has occurred.
+     */
+    void Close();
+    
+private:
+    /// Description of a tree to be put into the index
+    struct TreeIndex
+    {
+        /// Name of the tree
+        std::string name;
+        
+        /// Offsets and numbers of events of all blocks
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> blocks;
+    };
+    
+private:
+    /// Name of the output file
+    std::string fileName;
+    
+    /// Output stream
+    std::ofstream out;
+    
+    /// Index of all trees written so far. The last one is the current tree
+    std::vector<TreeIndex> trees;
+    
+    /// Indicates if a tree has been started and not completed
+    bool treeOpen;
+};
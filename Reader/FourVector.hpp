@@ -0,0 +1,296 @@
+#pragma once
+
+#include <TLorentzVector.h>
+#include <TMath.h>
+
+#include <cmath>
+
+
+/**
+ * \class BasicFourVector
+ * \brief A compact four-momentum stored in terms of pt, pseudorapidity, azimuthal angle, and mass
+ * 
+ * The template parameter is the type of the components, float or double. Unlike TLorentzVector,
+ * the class is trivially copyable, does not have a vtable, and takes 16 or 32 bytes. Pt, Eta,
+ * Phi, and M are plain accessors, while cartesian components are computed on demand. This suits
+ * the typical usage in the analysis, in which objects are sorted and selected by their pt and
+ * pseudorapidity and only a few of them enter an invariant mass.
+ * 
+ * Sums of four-vectors are computed in cartesian components and converted back. The mass of the
+ * sum follows the convention of TLorentzVector: it is negative if the squared mass is negative
+ * due to rounding. Explicit conversions to and from TLorentzVector and between the two precisions
+ * are provided. Single precision matches the source trees and halves the memory footprint, while
+ * double precision should be used in steps sensitive to rounding.
+ */
+template<typename T>
+class BasicFourVector
+{
+public:
+    /// Type of the components
+    typedef T Scalar;
+    
+public:
+    /// Constructor without parameters. All components are set to zero
+    BasicFourVector() noexcept;
+    
+    /// Constructor from pt, pseudorapidity, azimuthal angle, and mass
+    BasicFourVector(T pt, T eta, T phi, T m = 0) noexcept;
+    
+    /// Conversion from the other precision
+    template<typename U>
+    explicit BasicFourVector(BasicFourVector<U> const &src) noexcept;
+    
+    /// Constructor from a TLorentzVector
+    explicit BasicFourVector(TLorentzVector const &p4) noexcept;
+    
+public:
+    /// Creates a four-vector from cartesian components of the momentum and the energy
+    static BasicFourVector FromCartesian(T px, T py, T pz, T e) noexcept;
+    
+    /// Transverse momentum
+    T Pt() const noexcept;
+    
+    /// Pseudorapidity
+    T Eta() const noexcept;
+    
+    /// Azimuthal angle
+    T Phi() const noexcept;
+    
+    /// Mass
+    T M() const noexcept;
+    
+    /// Cartesian components of the momentum and energy
+    T Px() const noexcept;
+    T Py() const noexcept;
+    T Pz() const noexcept;
+    T E() const noexcept;
+    
+    /// Calculates dR distance to another four-vector
+    T DeltaR(BasicFourVector const &rhs) const noexcept;
+    
+    /// Adds another four-vector
+    BasicFourVector &operator+=(BasicFourVector const &rhs) noexcept;
+    
+    /// Converts to a TLorentzVector
+    explicit operator TLorentzVector() const noexcept;
+    
+    /// A short-cut for the conversion to TLorentzVector
+    TLorentzVector ToTLorentzVector() const noexcept;
+    
+private:
+    /// Transverse momentum, pseudorapidity, azimuthal angle, and mass
+    T pt, eta, phi, m;
+};
+
+
+/// Four-vectors in double and single precision
+typedef BasicFourVector<double> FourVector;
+typedef BasicFourVector<float> FourVectorF;
+
+
+/// Computes the sum of two four-vectors
+template<typename T>
+BasicFourVector<T> operator+(BasicFourVector<T> lhs, BasicFourVector<T> const &rhs) noexcept;
+
+
+/**
+ * \brief Computes the invariant mass of a pair of four-vectors
+ * 
+ * Equivalent to (lhs + rhs).M() but uses the stored components directly and needs no conversion
+ * of the sum back to pt, pseudorapidity, and azimuthal angle.
+ */
+template<typename T>
+T InvariantMass(BasicFourVector<T> const &lhs, BasicFourVector<T> const &rhs) noexcept;
+
+
+/**
+ * \brief Calculates dR distance between two directions
+ * 
+ * The difference in azimuthal angle is brought into the range [-pi, pi]. The computation is done
+ * with the type of the arguments.
+ */
+template<typename T>
+T DeltaR(T eta1, T phi1, T eta2, T phi2) noexcept;
+
+
+
+// Implementation of the methods is given here so that they can be inlined in the event loop
+
+template<typename T>
+inline BasicFourVector<T>::BasicFourVector() noexcept:
+    pt(0), eta(0), phi(0), m(0)
+{}
+
+
+template<typename T>
+inline BasicFourVector<T>::BasicFourVector(T pt_, T eta_, T phi_, T m_ /*= 0*/) noexcept:
+    pt(pt_), eta(eta_), phi(phi_), m(m_)
+{}
+
+
+template<typename T>
+template<typename U>
+inline BasicFourVector<T>::BasicFourVector(BasicFourVector<U> const &src) noexcept:
+    pt(src.Pt()), eta(src.Eta()), phi(src.Phi()), m(src.M())
+{}
+
+
+template<typename T>
+inline BasicFourVector<T>::BasicFourVector(TLorentzVector const &p4) noexcept
+{
+    *this = FromCartesian(p4.Px(), p4.Py(), p4.Pz(), p4.E());
+}
+
+
+template<typename T>
+inline BasicFourVector<T> BasicFourVector<T>::FromCartesian(T px, T py, T pz, T e) noexcept
+{
+    T const pt = std::sqrt(px * px + py * py);
+    
+    
+    // Pseudorapidity is not defined for vectors along the beam axis. Follow TLorentzVector and
+    //return a large value in this case
+    T eta;
+    
+    if (pt > 0)
+        eta = std::asinh(pz / pt);
+    else if (pz == 0)
+        eta = 0;
+    else
+        eta = (pz > 0) ? T(10e10) : T(-10e10);
+    
+    
+    T const m2 = e * e - px * px - py * py - pz * pz;
+    T const m = (m2 >= 0) ? std::sqrt(m2) : -std::sqrt(-m2);
+    
+    return BasicFourVector(pt, eta, std::atan2(py, px), m);
+}
+
+
+template<typename T>
+inline T BasicFourVector<T>::Pt() const noexcept
+{
+    return pt;
+}
+
+
+template<typename T>
+inline T BasicFourVector<T>::Eta() const noexcept
+{
+    return eta;
+}
+
+
+template<typename T>
+inline T BasicFourVector<T>::Phi() const noexcept
+{
+    return phi;
+}
+
+
+template<typename T>
+inline T BasicFourVector<T>::M() const noexcept
+{
+    return m;
+}
+
+
+template<typename T>
+inline T BasicFourVector<T>::Px() const noexcept
+{
+    return pt * std::cos(phi);
+}
+
+
+template<typename T>
+inline T BasicFourVector<T>::Py() const noexcept
+{
+    return pt * std::sin(phi);
+}
+
+
+template<typename T>
+inline T BasicFourVector<T>::Pz() const noexcept
+{
+    return pt * std::sinh(eta);
+}
+
+
+template<typename T>
+inline T BasicFourVector<T>::E() const noexcept
+{
+    T const p = pt * std::cosh(eta);
+    return std::sqrt(p * p + m * m);
+}
+
+
+template<typename T>
+inline T BasicFourVector<T>::DeltaR(BasicFourVector const &rhs) const noexcept
+{
+    return ::DeltaR(eta, phi, rhs.eta, rhs.phi);
+}
+
+
+template<typename T>
+inline BasicFourVector<T> &BasicFourVector<T>::operator+=(BasicFourVector const &rhs) noexcept
+{
+    *this = FromCartesian(Px() + rhs.Px(), Py() + rhs.Py(), Pz() + rhs.Pz(), E() + rhs.E());
+    return *this;
+}
+
+
+template<typename T>
+inline BasicFourVector<T>::operator TLorentzVector() const noexcept
+{
+    return ToTLorentzVector();
+}
+
+
+template<typename T>
+inline TLorentzVector BasicFourVector<T>::ToTLorentzVector() const noexcept
+{
+    TLorentzVector p4;
+    p4.SetPtEtaPhiM(pt, eta, phi, m);
+    return p4;
+}
+
+
+template<typename T>
+inline BasicFourVector<T> operator+(BasicFourVector<T> lhs, BasicFourVector<T> const &rhs) noexcept
+{
+    lhs += rhs;
+    return lhs;
+}
+
+
+template<typename T>
+inline T InvariantMass(BasicFourVector<T> const &lhs, BasicFourVector<T> const &rhs) noexcept
+{
+    // Energies and longitudinal momenta. The transverse part of the scalar product of the momenta
+    //is expressed through the difference in azimuthal angle
+    T const pz1 = lhs.Pz(), pz2 = rhs.Pz();
+    T const e1 = std::sqrt(lhs.Pt() * lhs.Pt() + pz1 * pz1 + lhs.M() * lhs.M());
+    T const e2 = std::sqrt(rhs.Pt() * rhs.Pt() + pz2 * pz2 + rhs.M() * rhs.M());
+    T const pDot = lhs.Pt() * rhs.Pt() * std::cos(lhs.Phi() - rhs.Phi()) + pz1 * pz2;
+    
+    T const m2 = lhs.M() * lhs.M() + rhs.M() * rhs.M() + 2 * (e1 * e2 - pDot);
+    return (m2 >= 0) ? std::sqrt(m2) : -std::sqrt(-m2);
+}
+
+
+template<typename T>
+inline T DeltaR(T eta1, T phi1, T eta2, T phi2) noexcept
+{
+    T const pi = TMath::Pi();
+    T dPhi = phi1 - phi2;
+    
+    while (dPhi > pi)
+        dPhi -= 2 * pi;
+    
+    while (dPhi < -pi)
+        dPhi += 2 * pi;
+    
+    T const dEta = eta1 - eta2;
+    
+    return std::sqrt(dEta * dEta + dPhi * dPhi);
+}
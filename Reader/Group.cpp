@@ -0,0 +1,10 @@
+#include <Group.hpp>
+
+
+using namespace std;
+
+
+Group::Group(string const &name_, initializer_list<string> const &treeNames_,
+ bool isMC_ /*= true*/):
+    name(name_), treeNames(treeNames_), isMC(isMC_)
+{}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <initializer_list>
+
+
+/**
+ * \struct Group
+ * \brief An auxiliary structure to group several trees together
+ * 
+ * Each tree in the source file corresponds to a different physics process. It is useful to consider
+ * several processes together. This structure defines what trees should be considered with a group,
+ * and gives the group a name.
+ */
+struct Group
+{
+    /// Constructor without paramters
+    Group() = default;
+    
+    /// Constructor with explicit initialisation
+    Group(std::string const &name, std::initializer_list<std::string> const &treeNames,
+     bool isMC = true);
+    
+    /// Copy constructor
+    Group(Group const &) = default;
+    
+    /// Move constructor
+    Group(Group &&) = default;
+    
+    /// A name to refer to the group
+    std::string name;
+    
+    /// Names of trees that contribute to this group
+    std::list<std::string> treeNames;
+    
+    /// Flag to indicate MC simulation as opposed to data
+    bool isMC;
+};
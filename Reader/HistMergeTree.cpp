@@ -0,0 +1,284 @@
+#include <HistMergeTree.hpp>
+
+#include <TParameter.h>
+#include <TCollection.h>
+#include <TKey.h>
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <string>
+#include <exception>
+#include <stdexcept>
+#include <sstream>
+#include <cstdio>
+
+
+using namespace std;
+
+
+HistMergeTree::HistMergeTree(unsigned long nLeaves_ /*= 0*/)
+{
+    SetNumLeaves(nLeaves_);
+}
+
+
+void HistMergeTree::Add(unsigned level, unsigned long index, HistSet &&hists)
+{
+    Insert(level, index, move(hists));
+    
+    
+    // Merge the node with its siblings while they are available
+    for (; level < rootLevel; ++level, index /= 2)
+    {
+        auto const left = nodes.find({level, index & ~1ul});
+        
+        if (left == nodes.end())
+            break;
+        
+        if (Exists(level, (index & ~1ul) + 1))
+        {
+            auto const right = nodes.find({level, (index & ~1ul) + 1});
+            
+            if (right == nodes.end())
+                break;
+            
+            AddSets(left->second, right->second);
+            nodes.erase(right);
+        }
+        
+        HistSet merged(move(left->second));
+        nodes.erase(left);
+        nodes[{level + 1, index / 2}] = move(merged);
+    }
+}
+
+
+void HistMergeTree::Reduce(unsigned nThreads /*= 1*/)
+{
+    for (unsigned level = 0; level < rootLevel; ++level)
+    {
+        // Find the pairs of nodes to be added in this level. A left node without the right sibling
+        //is passed to the next level as it is
+        vector<pair<HistSet *, HistSet const *>> pairs;
+        
+        for (auto it = nodes.lower_bound({level, 0});
+         it != nodes.end() and it->first.first == level; ++it)
+        {
+            unsigned long const index = it->first.second;
+            unsigned long const leftIndex = index & ~1ul;
+            
+            if (not Exists(level, leftIndex + 1))
+                continue;
+            
+            auto const left = nodes.find({level, leftIndex});
+            auto const right = nodes.find({level, leftIndex + 1});
+            
+            if (left == nodes.end() or right == nodes.end())
+            {
+                ostringstream ost;
+                ost << "HistMergeTree::Reduce: Node " << (left == nodes.end() ? leftIndex :
+                 leftIndex + 1) << " at level " << level << " is missing.";
+                throw runtime_error(ost.str());
+            }
+            
+            if (index == leftIndex)
+                pairs.emplace_back(&left->second, &right->second);
+        }
+        
+        
+        // Add the pairs concurrently. Exceptions are passed to the current thread
+        atomic<size_t> nextPair(0);
+        exception_ptr workerException;
+        mutex exceptionMutex;
+        
+        auto addPairs = [&]()
+        {
+            try
+            {
+                for (size_t i = nextPair++; i < pairs.size(); i = nextPair++)
+                    AddSets(*pairs[i].first, *pairs[i].second);
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lock(exceptionMutex);
+                workerException = current_exception();
+            }
+        };
+        
+        vector<thread> workers;
+        
+        for (unsigned i = 1; i < min<size_t>(nThreads, pairs.size()); ++i)
+            workers.emplace_back(addPairs);
+        
+        addPairs();
+        
+        for (auto &w: workers)
+            w.join();
+        
+        if (workerException)
+            rethrow_exception(workerException);
+        
+        
+        // Move the results to the next level
+        while (true)
+        {
+            auto const it = nodes.lower_bound({level, 0});
+            
+            if (it == nodes.end() or it->first.first != level)
+                break;
+            
+            unsigned long const index = it->first.second;
+            
+            if (index % 2 == 0)
+            {
+                HistSet merged(move(it->second));
+                nodes.erase(it);
+                nodes[{level + 1, index / 2}] = move(merged);
+            }
+            else
+                nodes.erase(it);
+        }
+    }
+    
+    if (not IsComplete())
+        throw runtime_error("HistMergeTree::Reduce: Some nodes are missing.");
+}
+
+
+bool HistMergeTree::Covers(unsigned long leaf) const
+{
+    for (unsigned level = 0; level <= rootLevel; ++level)
+        if (nodes.count({level, leaf >> level}) > 0)
+            return true;
+    
+    return false;
+}
+
+
+bool HistMergeTree::IsComplete() const
+{
+    return (nLeaves > 0 and nodes.size() == 1 and nodes.count({rootLevel, 0}) == 1);
+}
+
+
+HistMergeTree::HistSet HistMergeTree::TakeResult()
+{
+    if (not IsComplete())
+        throw logic_error("HistMergeTree::TakeResult: The root has not been computed.");
+    
+    HistSet result(move(nodes.begin()->second));
+    nodes.clear();
+    
+    return result;
+}
+
+
+void HistMergeTree::Write(TDirectory &directory) const
+{
+    TParameter<Long64_t> const nLeavesParam("nLeaves", nLeaves);
+    directory.WriteTObject(&nLeavesParam);
+    
+    for (auto const &node: nodes)
+    {
+        ostringstream name;
+        name << "node_" << node.first.first << "_" << node.first.second;
+        TDirectory *nodeDirectory = directory.mkdir(name.str().c_str());
+        
+        for (unsigned i = 0; i < node.second.size(); ++i)
+            nodeDirectory->WriteTObject(node.second[i].get(), ("h" + to_string(i)).c_str());
+    }
+}
+
+
+void HistMergeTree::Read(TDirectory &directory)
+{
+    // Check the number of leaves
+    unique_ptr<TParameter<Long64_t>> nLeavesParam(
+     dynamic_cast<TParameter<Long64_t> *>(directory.Get("nLeaves")));
+    
+    if (not nLeavesParam)
+        throw runtime_error(string("Directory \"") + directory.GetName() +
+         "\" does not contain a HistMergeTree.");
+    
+    if (nLeaves == 0)
+        SetNumLeaves(nLeavesParam->GetVal());
+    else if (static_cast<unsigned long>(nLeavesParam->GetVal()) != nLeaves)
+        throw runtime_error(string("Directory \"") + directory.GetName() +
+         "\" contains a HistMergeTree with a different number of leaves.");
+    
+    
+    // Read the nodes
+    TIter nextKey(directory.GetListOfKeys());
+    
+    while (TKey const *key = dynamic_cast<TKey const *>(nextKey()))
+    {
+        unsigned level;
+        unsigned long index;
+        
+        if (sscanf(key->GetName(), "node_%u_%lu", &level, &index) != 2)
+            continue;
+        
+        TDirectory *nodeDirectory = directory.GetDirectory(key->GetName());
+        HistSet hists;
+        
+        for (unsigned i = 0; ; ++i)
+        {
+            TH1 *hist = dynamic_cast<TH1 *>(nodeDirectory->Get(("h" + to_string(i)).c_str()));
+            
+            if (not hist)
+                break;
+            
+            hist->SetDirectory(nullptr);
+            hists.emplace_back(hist);
+        }
+        
+        Insert(level, index, move(hists));
+    }
+}
+
+
+void HistMergeTree::SetNumLeaves(unsigned long nLeaves_)
+{
+    nLeaves = nLeaves_;
+    rootLevel = 0;
+    
+    while ((1ul << rootLevel) < nLeaves)
+        ++rootLevel;
+}
+
+
+bool HistMergeTree::Exists(unsigned level, unsigned long index) const noexcept
+{
+    return ((index << level) < nLeaves);
+}
+
+
+void HistMergeTree::Insert(unsigned level, unsigned long index, HistSet &&hists)
+{
+    if (level > rootLevel or not Exists(level, index))
+    {
+        ostringstream ost;
+        ost << "HistMergeTree: Node " << index << " at level " << level << " does not belong to " <<
+         "a tree with " << nLeaves << " leaves.";
+        throw logic_error(ost.str());
+    }
+    
+    if (not nodes.emplace(NodeID(level, index), move(hists)).second)
+    {
+        ostringstream ost;
+        ost << "HistMergeTree: Node " << index << " at level " << level << " is added twice.";
+        throw runtime_error(ost.str());
+    }
+}
+
+
+void HistMergeTree::AddSets(HistSet &left, HistSet const &right)
+{
+    if (left.size() != right.size())
+        throw runtime_error("HistMergeTree: Sets of histograms have different sizes.");
+    
+    for (unsigned i = 0; i < left.size(); ++i)
+        left[i]->Add(right[i].get());
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <TH1.h>
+#include <TDirectory.h>
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <utility>
+
+
+/**
+ * \class HistMergeTree
+ * \brief Adds sets of histograms together following a fixed binary tree
+ * 
+ * The sets to be added are the leaves of the tree, numbered from 0 to nLeaves - 1. A node at level
+ * k with index j covers leaves [j * 2^k, (j + 1) * 2^k). It is obtained by adding its right child
+ * to its left child or, if the right child covers no leaves, it is the left child itself. The root
+ * is the node at the lowest level that covers all leaves.
+ * 
+ * Since floating-point addition is not associative, the sum depends on the order of additions.
+ * Following the fixed tree makes the result independent of the order in which the leaves become
+ * available and of how they are distributed among threads or jobs. Partially merged trees can be
+ * written into a ROOT directory and merged later with the nodes computed elsewhere.
+ */
+class HistMergeTree
+{
+public:
+    /// A set of histograms. Sets in all nodes must contain compatible histograms in the same order
+    typedef std::vector<std::unique_ptr<TH1>> HistSet;
+    
+public:
+    /// Constructor from the number of leaves
+    HistMergeTree(unsigned long nLeaves = 0);
+    
+public:
+    /**
+     * \brief Adds a node and merges it with the available siblings
+     * 
+     * The merging proceeds up the tree for as long as the siblings are present. An exception is
+     * thrown if the node already exists or does not belong to the tree.
+     */
+    void Add(unsigned level, unsigned long index, HistSet &&hists);
+    
+    /**
+     * \brief Merges all nodes up to the root
+     * 
+     * The tree is processed level by level, and independent pairs of nodes in a level are merged
+     * concurrently by the given number of threads. An exception is thrown if some nodes needed to
+     * reach the root are missing.
+     */
+    void Reduce(unsigned nThreads = 1);
+    
+    /// Checks if the given leaf has been added, possibly merged into a node at a higher level
+    bool Covers(unsigned long leaf) const;
+    
+    /// Checks if the root has been computed
+    bool IsComplete() const;
+    
+    /**
+     * \brief Takes the histograms of the root
+     * 
+     * An exception is thrown if the root has not been computed. The tree is left empty.
+     */
+    HistSet TakeResult();
+    
+    /**
+     * \brief Writes the number of leaves and all nodes into the given directory
+     * 
+     * Each node is stored in a subdirectory named after its level and index.
+     */
+    void Write(TDirectory &directory) const;
+    
+    /**
+     * \brief Reads nodes written with the method Write and adds them to the tree without merging
+     * 
+     * If the tree has no leaves, it takes the number of leaves from the directory. Otherwise the
+     * numbers must agree, or an exception is thrown.
+     */
+    void Read(TDirectory &directory);
+    
+private:
+    /// Level and index of a node
+    typedef std::pair<unsigned, unsigned long> NodeID;
+    
+private:
+    /// Sets the number of leaves and the level of the root
+    void SetNumLeaves(unsigned long nLeaves);
+    
+    /// Checks if the node covers any leaves
+    bool Exists(unsigned level, unsigned long index) const noexcept;
+    
+    /// Stores a node without merging
+    void Insert(unsigned level, unsigned long index, HistSet &&hists);
+    
+    /// Adds histograms of the right node to the histograms of the left one
+    static void AddSets(HistSet &left, HistSet const &right);
+    
+private:
+    /// Number of leaves
+    unsigned long nLeaves;
+    
+    /// Level of the root
+    unsigned rootLevel;
+    
+    /// Nodes that have not been merged into their parents yet
+    std::map<NodeID, HistSet> nodes;
+};
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <type_traits>
+#include <stdexcept>
+#include <new>
+#include <utility>
+
+
+/**
+ * \class InlineVector
+ * \brief A vector with a fixed capacity whose elements are stored within the object
+ * 
+ * The class provides the part of the interface of std::vector that is used for collections of
+ * objects in the event loop. Since the storage is a member of the object, no memory is allocated
+ * on the heap, and a local InlineVector costs nothing to create and destroy in each event. The
+ * capacity is normally Reader::maxSize, which bounds the number of objects of any type in an
+ * event. An attempt to add an element beyond the capacity throws an exception.
+ */
+template<typename T, unsigned capacity>
+class InlineVector
+{
+public:
+    typedef T value_type;
+    typedef T *iterator;
+    typedef T const *const_iterator;
+    
+public:
+    /// Constructor without parameters. Creates an empty vector
+    InlineVector() noexcept;
+    
+    /// Copy constructor
+    InlineVector(InlineVector const &src);
+    
+    /// Assignment operator
+    InlineVector &operator=(InlineVector const &src);
+    
+    /// Destructor
+    ~InlineVector() noexcept;
+    
+public:
+    /// Adds a copy of the given element at the end
+    void push_back(T const &value);
+    
+    /// Constructs an element at the end from the given arguments
+    template<typename... Args>
+    void emplace_back(Args &&...args);
+    
+    /// Removes the last element
+    void pop_back() noexcept;
+    
+    /// Removes all elements
+    void clear() noexcept;
+    
+    /// Returns the number of elements
+    unsigned size() const noexcept;
+    
+    /// Checks if there are no elements
+    bool empty() const noexcept;
+    
+    /// Returns the maximal number of elements
+    static constexpr unsigned max_size() noexcept
+    {
+        return capacity;
+    }
+    
+    /// Accesses the element with the given index without a range check
+    T &operator[](unsigned index) noexcept;
+    T const &operator[](unsigned index) const noexcept;
+    
+    /// Accesses the element with the given index. Throws an exception if it does not exist
+    T &at(unsigned index);
+    T const &at(unsigned index) const;
+    
+    /// Accesses the first and the last element
+    T &front() noexcept;
+    T const &front() const noexcept;
+    T &back() noexcept;
+    T const &back() const noexcept;
+    
+    /// Returns a pointer to the first element
+    T *data() noexcept;
+    T const *data() const noexcept;
+    
+    /// Iterators
+    iterator begin() noexcept;
+    const_iterator begin() const noexcept;
+    iterator end() noexcept;
+    const_iterator end() const noexcept;
+    
+private:
+    /// Throws an exception if there is no space for another element
+    void CheckSpace() const;
+    
+private:
+    /// Raw storage for the elements
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage[capacity];
+    
+    /// Number of elements
+    unsigned nElements;
+};
+
+
+template<typename T, unsigned capacity>
+InlineVector<T, capacity>::InlineVector() noexcept:
+    nElements(0)
+{}
+
+
+template<typename T, unsigned capacity>
+InlineVector<T, capacity>::InlineVector(InlineVector const &src):
+    nElements(0)
+{
+    for (auto const &value: src)
+        push_back(value);
+}
+
+
+template<typename T, unsigned capacity>
+InlineVector<T, capacity> &InlineVector<T, capacity>::operator=(InlineVector const &src)
+{
+    if (&src != this)
+    {
+        clear();
+        
+        for (auto const &value: src)
+            push_back(value);
+    }
+    
+    return *this;
+}
+
+
+template<typename T, unsigned capacity>
+InlineVector<T, capacity>::~InlineVector() noexcept
+{
+    clear();
+}
+
+
+template<typename T, unsigned capacity>
+void InlineVector<T, capacity>::push_back(T const &value)
+{
+    CheckSpace();
+    new(&storage[nElements]) T(value);
+    ++nElements;
+}
+
+
+template<typename T, unsigned capacity>
+template<typename... Args>
+void InlineVector<T, capacity>::emplace_back(Args &&...args)
+{
+    CheckSpace();
+    new(&storage[nElements]) T(std::forward<Args>(args)...);
+    ++nElements;
+}
+
+
+template<typename T, unsigned capacity>
+void InlineVector<T, capacity>::pop_back() noexcept
+{
+    --nElements;
+    data()[nElements].~T();
+}
+
+
+template<typename T, unsigned capacity>
+void InlineVector<T, capacity>::clear() noexcept
+{
+    while (nElements > 0)
+        pop_back();
+}
+
+
+template<typename T, unsigned capacity>
+unsigned InlineVector<T, capacity>::size() const noexcept
+{
+    return nElements;
+}
+
+
+template<typename T, unsigned capacity>
+bool InlineVector<T, capacity>::empty() const noexcept
+{
+    return (nElements == 0);
+}
+
+
+template<typename T, unsigned capacity>
+T &InlineVector<T, capacity>::operator[](unsigned index) noexcept
+{
+    return data()[index];
+}
+
+
+template<typename T, unsigned capacity>
+T const &InlineVector<T, capacity>::operator[](unsigned index) const noexcept
+{
+    return data()[index];
+}
+
+
+template<typename T, unsigned capacity>
+T &InlineVector<T, capacity>::at(unsigned index)
+{
+    if (index >= nElements)
+        throw std::out_of_range("InlineVector::at: Index is out of range.");
+    
+    return data()[index];
+}
+
+
+template<typename T, unsigned capacity>
+T const &InlineVector<T, capacity>::at(unsigned index) const
+{
+    if (index >= nElements)
+        throw std::out_of_range("InlineVector::at: Index is out of range.");
+    
+    return data()[index];
+}
+
+
+template<typename T, unsigned capacity>
+T &InlineVector<T, capacity>::front() noexcept
+{
+    return data()[0];
+}
+
+
+template<typename T, unsigned capacity>
+T const &InlineVector<T, capacity>::front() const noexcept
+{
+    return data()[0];
+}
+
+
+template<typename T, unsigned capacity>
+T &InlineVector<T, capacity>::back() noexcept
+{
+    return data()[nElements - 1];
+}
+
+
+template<typename T, unsigned capacity>
+T const &InlineVector<T, capacity>::back() const noexcept
+{
+    return data()[nElements - 1];
+}
+
+
+template<typename T, unsigned capacity>
+T *InlineVector<T, capacity>::data() noexcept
+{
+    return reinterpret_cast<T *>(storage);
+}
+
+
+template<typename T, unsigned capacity>
+T const *InlineVector<T, capacity>::data() const noexcept
+{
+    return reinterpret_cast<T const *>(storage);
+}
+
+
+template<typename T, unsigned capacity>
+typename InlineVector<T, capacity>::iterator InlineVector<T, capacity>::begin() noexcept
+{
+    return data();
+}
+
+
+template<typename T, unsigned capacity>
+typename InlineVector<T, capacity>::const_iterator InlineVector<T, capacity>::begin() const
+ noexcept
+{
+    return data();
+}
+
+
+template<typename T, unsigned capacity>
+typename InlineVector<T, capacity>::iterator InlineVector<T, capacity>::end() noexcept
+{
+    return data() + nElements;
+}
+
+
+template<typename T, unsigned capacity>
+typename InlineVector<T, capacity>::const_iterator InlineVector<T, capacity>::end() const
+ noexcept
+{
+    return data() + nElements;
+}
+
+
+template<typename T, unsigned capacity>
+void InlineVector<T, capacity>::CheckSpace() const
+{
+    if (nElements == capacity)
+        throw std::length_error("InlineVector: Capacity is exceeded.");
+}
@@ -0,0 +1,328 @@
+#include <MassKernels.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <immintrin.h>
+#define MASS_KERNELS_X86
+#endif
+
+
+using namespace std;
+
+
+void JetKinematics::Clear() noexcept
+{
+    px.clear();
+    py.clear();
+    pz.clear();
+    e.clear();
+}
+
+
+unsigned JetKinematics::Size() const noexcept
+{
+    return px.size();
+}
+
+
+
+/// Four-momentum in cartesian components, added to each object by the kernels
+struct BaseMomentum
+{
+    float px, py, pz, e;
+};
+
+
+/// Pointers to the columns of a JetKinematics object
+struct Columns
+{
+    /// Constructor from the collection
+    Columns(JetKinematics const &src) noexcept:
+        px(src.px.data()), py(src.py.data()), pz(src.pz.data()), e(src.e.data())
+    {}
+    
+    /// Returns columns starting from the given object
+    Columns Shift(unsigned offset) const noexcept
+    {
+        Columns shifted(*this);
+        shifted.px += offset;
+        shifted.py += offset;
+        shifted.pz += offset;
+        shifted.e += offset;
+        return shifted;
+    }
+    
+    float const *px, *py, *pz, *e;
+};
+
+
+/**
+ * \brief Signature of a kernel
+ * 
+ * Computes invariant masses of the base four-momentum summed with each of the first n objects in
+ * the given columns and writes them to out.
+ */
+typedef void (*Kernel)(BaseMomentum const &, Columns const &, unsigned, float *);
+
+
+/// Returns the base four-momentum for the given object
+static BaseMomentum GetBase(JetKinematics const &src, unsigned index) noexcept
+{
+    return {src.px[index], src.py[index], src.pz[index], src.e[index]};
+}
+
+
+static void MassesScalar(BaseMomentum const &base, Columns const &src, unsigned n, float *out)
+{
+    for (unsigned k = 0; k < n; ++k)
+    {
+        float const px = base.px + src.px[k];
+        float const py = base.py + src.py[k];
+        float const pz = base.pz + src.pz[k];
+        float const e = base.e + src.e[k];
+        
+        float const m2 = e * e - px * px - py * py - pz * pz;
+        out[k] = (m2 >= 0.f) ? sqrt(m2) : -sqrt(-m2);
+    }
+}
+
+
+#ifdef MASS_KERNELS_X86
+
+__attribute__((target("avx2")))
+static void MassesAVX2(BaseMomentum const &base, Columns const &src, unsigned n, float *out)
+{
+    __m256 const basePx = _mm256_set1_ps(base.px), basePy = _mm256_set1_ps(base.py),
+     basePz = _mm256_set1_ps(base.pz), baseE = _mm256_set1_ps(base.e);
+    __m256 const signMask = _mm256_set1_ps(-0.f);
+    unsigned k = 0;
+    
+    for (; k + 8 <= n; k += 8)
+    {
+        __m256 const px = _mm256_add_ps(basePx, _mm256_loadu_ps(src.px + k));
+        __m256 const py = _mm256_add_ps(basePy, _mm256_loadu_ps(src.py + k));
+        __m256 const pz = _mm256_add_ps(basePz, _mm256_loadu_ps(src.pz + k));
+        __m256 const e = _mm256_add_ps(baseE, _mm256_loadu_ps(src.e + k));
+        
+        __m256 m2 = _mm256_mul_ps(e, e);
+        m2 = _mm256_sub_ps(m2, _mm256_mul_ps(px, px));
+        m2 = _mm256_sub_ps(m2, _mm256_mul_ps(py, py));
+        m2 = _mm256_sub_ps(m2, _mm256_mul_ps(pz, pz));
+        
+        
+        // Take the square root of the absolute value and restore the sign
+        __m256 const sign = _mm256_and_ps(m2, signMask);
+        __m256 const m = _mm256_sqrt_ps(_mm256_andnot_ps(signMask, m2));
+        _mm256_storeu_ps(out + k, _mm256_or_ps(m, sign));
+    }
+    
+    MassesScalar(base, src.Shift(k), n - k, out + k);
+}
+
+
+// The AVX-512 intrinsics in GCC initialise unused operands with themselves, which triggers false
+//warnings about uninitialised variables
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f")))
+static void MassesAVX512(BaseMomentum const &base, Columns const &src, unsigned n, float *out)
+{
+    __m512 const basePx = _mm512_set1_ps(base.px), basePy = _mm512_set1_ps(base.py),
+     basePz = _mm512_set1_ps(base.pz), baseE = _mm512_set1_ps(base.e);
+    __m512i const signMask = _mm512_set1_epi32(0x80000000);
+    unsigned k = 0;
+    
+    for (; k + 16 <= n; k += 16)
+    {
+        __m512 const px = _mm512_add_ps(basePx, _mm512_loadu_ps(src.px + k));
+        __m512 const py = _mm512_add_ps(basePy, _mm512_loadu_ps(src.py + k));
+        __m512 const pz = _mm512_add_ps(basePz, _mm512_loadu_ps(src.pz + k));
+        __m512 const e = _mm512_add_ps(baseE, _mm512_loadu_ps(src.e + k));
+        
+        __m512 m2 = _mm512_mul_ps(e, e);
+        m2 = _mm512_sub_ps(m2, _mm512_mul_ps(px, px));
+        m2 = _mm512_sub_ps(m2, _mm512_mul_ps(py, py));
+        m2 = _mm512_sub_ps(m2, _mm512_mul_ps(pz, pz));
+        
+        
+        // Take the square root of the absolute value and restore the sign. Bitwise operations on
+        //floating-point vectors require AVX-512DQ, so they are done on integer vectors
+        __m512i const bits = _mm512_castps_si512(m2);
+        __m512i const sign = _mm512_and_si512(bits, signMask);
+        __m512 const absM2 = _mm512_castsi512_ps(_mm512_andnot_si512(signMask, bits));
+        __m512i const m = _mm512_castps_si512(_mm512_sqrt_ps(absM2));
+        _mm512_storeu_ps(out + k, _mm512_castsi512_ps(_mm512_or_si512(m, sign)));
+    }
+    
+    MassesScalar(base, src.Shift(k), n - k, out + k);
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+
+/// Returns the kernel for the given implementation
+static Kernel GetKernel(MassKernels::Isa isa) noexcept
+{
+    switch (isa)
+    {
+    #ifdef MASS_KERNELS_X86
+        case MassKernels::Isa::AVX512:
+            return MassesAVX512;
+        
+        case MassKernels::Isa::AVX2:
+            return MassesAVX2;
+    #endif
+        
+        default:
+            return MassesScalar;
+    }
+}
+
+
+/// Returns the best implementation supported by the CPU
+static MassKernels::Isa SelectIsa() noexcept
+{
+    if (MassKernels::IsSupported(MassKernels::Isa::AVX512))
+        return MassKernels::Isa::AVX512;
+    else if (MassKernels::IsSupported(MassKernels::Isa::AVX2))
+        return MassKernels::Isa::AVX2;
+    else
+        return MassKernels::Isa::Scalar;
+}
+
+
+/**
+ * \brief Returns a reference to the implementation in use
+ * 
+ * It is selected on the first call.
+ */
+static MassKernels::Isa &CurrentIsa() noexcept
+{
+    static MassKernels::Isa isa = SelectIsa();
+    return isa;
+}
+
+
+/// Returns a reference to the kernel in use
+static Kernel &CurrentKernel() noexcept
+{
+    static Kernel kernel = GetKernel(CurrentIsa());
+    return kernel;
+}
+
+
+
+MassKernels::Isa MassKernels::GetIsa() noexcept
+{
+    return CurrentIsa();
+}
+
+
+bool MassKernels::IsSupported(Isa isa) noexcept
+{
+#ifdef MASS_KERNELS_X86
+    __builtin_cpu_init();
+#endif
+    
+    switch (isa)
+    {
+        case Isa::Scalar:
+            return true;
+    
+    #ifdef MASS_KERNELS_X86
+        case Isa::AVX2:
+            return __builtin_cpu_supports("avx2");
+        
+        case Isa::AVX512:
+        #if defined(__clang__) or __GNUC__ >= 5
+            return __builtin_cpu_supports("avx512f");
+        #else
+            // Older versions of GCC cannot detect AVX-512 at run time
+            return false;
+        #endif
+    #endif
+        
+        default:
+            return false;
+    }
+}
+
+
+void MassKernels::SetIsa(Isa isa)
+{
+    if (not IsSupported(isa))
+    {
+        ostringstream message;
+        message << "MassKernels::SetIsa: Implementation \"" << GetName(isa) <<
+         "\" is not supported by the CPU.";
+        throw runtime_error(message.str());
+    }
+    
+    CurrentIsa() = isa;
+    CurrentKernel() = GetKernel(isa);
+}
+
+
+char const *MassKernels::GetName(Isa isa) noexcept
+{
+    switch (isa)
+    {
+        case Isa::AVX2:
+            return "AVX2";
+        
+        case Isa::AVX512:
+            return "AVX-512";
+        
+        default:
+            return "scalar";
+    }
+}
+
+
+MassKernels::PairMatch MassKernels::FindBestPair(JetKinematics const &objects, float targetMass,
+ float maxDistance /*= 1000.f*/)
+{
+    PairMatch match{0, 0, 0.f, false};
+    float bestDistance = maxDistance;
+    
+    unsigned const n = objects.Size();
+    Kernel const kernel = CurrentKernel();
+    Columns const columns(objects);
+    
+    
+    // Masses are computed in chunks of a fixed size, which avoids allocating memory
+    unsigned const chunkSize = 64;
+    float buffer[chunkSize];
+    
+    for (unsigned i = 0; i < n; ++i)
+    {
+        BaseMomentum const base = GetBase(objects, i);
+        
+        for (unsigned start = i + 1; start < n; start += chunkSize)
+        {
+            unsigned const length = min(chunkSize, n - start);
+            kernel(base, columns.Shift(start), length, buffer);
+            
+            for (unsigned k = 0; k < length; ++k)
+            {
+                float const distance = fabs(buffer[k] - targetMass);
+                
+                if (distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    match = {i, start + k, buffer[k], true};
+                }
+            }
+        }
+    }
+    
+    return match;
+}
+
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <FourVector.hpp>
+#include <InlineVector.hpp>
+
+
+/**
+ * \struct JetKinematics
+ * \brief Cartesian components of momenta of a small collection of objects, stored column-wise
+ * 
+ * This is the input of the kernels in class MassKernels. Components are stored in single precision
+ * so that eight objects fit in a 256-bit register. The columns are stored within the object, so
+ * a local JetKinematics can be created in each event without allocating memory. The capacity
+ * equals Reader::maxSize.
+ */
+struct JetKinematics
+{
+    /// Maximal number of objects
+    static unsigned const maxSize = 64;
+    
+    /// Removes all objects
+    void Clear() noexcept;
+    
+    /// Adds an object with the given four-momentum
+    template<typename T>
+    void Add(BasicFourVector<T> const &p4);
+    
+    /// Number of objects
+    unsigned Size() const noexcept;
+    
+    /// Cartesian components of the momenta and energies
+    InlineVector<float, maxSize> px, py, pz, e;
+};
+
+
+/**
+ * \class MassKernels
+ * \brief Vectorised search for the pair of objects with the invariant mass closest to a target
+ * 
+ * The kernels compute the invariant mass of a fixed four-momentum summed with each object of a
+ * collection in turn, and the search is built on them. The implementation is chosen at run
+ * time according to the instruction sets supported by the CPU: AVX-512, AVX2, or a scalar
+ * fallback, which is also used on architectures other than x86. All implementations perform the
+ * same operations in the same order and give identical results. As with TLorentzVector, the mass
+ * is negative if its square is negative due to rounding.
+ */
+class MassKernels
+{
+public:
+    /// Supported implementations
+    enum class Isa
+    {
+        Scalar,
+        AVX2,
+        AVX512
+    };
+    
+    /// Result of the search for the pair with the mass closest to a target value
+    struct PairMatch
+    {
+        /// Indices of the objects in the pair, i < j. Meaningful only if found is true
+        unsigned i, j;
+        
+        /// Invariant mass of the pair
+        float mass;
+        
+        /// Indicates whether a pair has been found
+        bool found;
+    };
+    
+public:
+    /// Returns the implementation currently in use
+    static Isa GetIsa() noexcept;
+    
+    /// Checks if the given implementation is supported by the CPU
+    static bool IsSupported(Isa isa) noexcept;
+    
+    /**
+     * \brief Forces the given implementation
+     * 
+     * Meant for benchmarks and validation. Throws an exception if the implementation is not
+     * supported. Must not be called while other threads use the kernels.
+     */
+    static void SetIsa(Isa isa);
+    
+    /// Returns the name of the given implementation
+    static char const *GetName(Isa isa) noexcept;
+    
+    /**
+     * \brief Finds the pair of objects whose invariant mass is the closest to the target value
+     * 
+     * Pairs are considered in the order (0, 1), (0, 2), ..., (1, 2), ..., and in case of equal
+     * distances the first one is chosen. A pair is only accepted if the distance is smaller than
+     * maxDistance.
+     */
+    static PairMatch FindBestPair(JetKinematics const &objects, float targetMass,
+     float maxDistance = 1000.f);
+};
+
+
+
+template<typename T>
+inline void JetKinematics::Add(BasicFourVector<T> const &p4)
+{
+    px.push_back(p4.Px());
+    py.push_back(p4.Py());
+    pz.push_back(p4.Pz());
+    e.push_back(p4.E());
+}
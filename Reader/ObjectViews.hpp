@@ -0,0 +1,583 @@
+#pragma once
+
+#include <PhysicsObjects.hpp>
+#include <BranchSchema.hpp>
+
+#include <TLorentzVector.h>
+#include <Rtypes.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+
+
+/**
+ * \struct LeptonSource
+ * \brief Describes where properties of leptons in the current event are stored
+ * 
+ * The pointers refer to read buffers, which are updated for each event. Array order contains
+ * indices of the leptons such that their pt decreases.
+ */
+struct LeptonSource: public LeptonFields<PointerStorage>
+{
+    /// Number of leptons
+    Int_t const *size;
+    
+    /// Indices of leptons ordered in pt
+    unsigned char const *order;
+    
+    /**
+     * \brief Groups of branches used through the views, a combination of BranchGroup flags
+     * 
+     * Updated by the getters that read fields with their own group, for the learning mode of the
+     * Reader. Null if the usage is not tracked.
+     */
+    unsigned *usedGroups;
+};
+
+
+/**
+ * \struct JetSource
+ * \brief Describes where properties of jets in the current event are stored
+ * 
+ * The pointers refer to read buffers, which are updated for each event. Array order contains
+ * indices of the jets such that their pt decreases.
+ */
+struct JetSource: public JetFields<PointerStorage>
+{
+    /// Number of jets
+    Int_t const *size;
+    
+    /// Indices of jets ordered in pt
+    unsigned char const *order;
+};
+
+
+/**
+ * \class LeptonView
+ * \brief A lightweight handle to a lepton stored in read buffers of the Reader
+ * 
+ * Provides the same getters as the class Lepton, but reads the properties directly from the
+ * buffers. Cartesian components of the momentum are computed only when requested. A view is
+ * valid until the next event is read.
+ */
+class LeptonView
+{
+public:
+    /// Constructor from the source and index of the lepton in the read buffers
+    LeptonView(LeptonSource const *src, unsigned index) noexcept;
+    
+public:
+    /// Transverse momentum
+    double Pt() const noexcept;
+    
+    /// Pseudorapidity
+    double Eta() const noexcept;
+    
+    /// Azimuthal angle
+    double Phi() const noexcept;
+    
+    /// Mass, deduced from the flavour
+    double M() const noexcept;
+    
+    /// Cartesian components of the momentum and energy
+    double Px() const noexcept;
+    double Py() const noexcept;
+    double Pz() const noexcept;
+    double E() const noexcept;
+    
+    /// Builds the four-momentum
+    FourVector Momentum() const noexcept;
+    
+    /// Builds the four-momentum as a TLorentzVector
+    TLorentzVector P4() const noexcept;
+    
+    /// Calculates dR distance to another object
+    template<typename T>
+    double DeltaR(T const &rhs) const noexcept;
+    
+    /// Returns lepton flavour encoded with PDG ID codes
+    int Flavour() const noexcept;
+    
+    /**
+     * \brief Returns lepton isolation
+     * 
+     * Although the method is constant, it marks the isolation branch as used in the source, so
+     * that the branch is kept by Reader::LearnBranchesToRead.
+     */
+    double Isolation() const noexcept;
+    
+    /**
+     * \brief Creates a standalone copy of the lepton with properties of the given type
+     * 
+     * Marks the isolation as used, as does the method Isolation.
+     */
+    template<typename T = double>
+    BasicLepton<T> ToLepton() const noexcept;
+    
+private:
+    /// Source of the properties
+    LeptonSource const *src;
+    
+    /// Index of the lepton in the read buffers
+    unsigned index;
+};
+
+
+/**
+ * \class JetView
+ * \brief A lightweight handle to a jet stored in read buffers of the Reader
+ * 
+ * Provides the same getters as the class Jet, but reads the properties directly from the buffers.
+ * Cartesian components of the momentum are computed only when requested. A view is valid until
+ * the next event is read.
+ */
+class JetView
+{
+public:
+    /// Constructor from the source and index of the jet in the read buffers
+    JetView(JetSource const *src, unsigned index) noexcept;
+    
+public:
+    /// Transverse momentum
+    double Pt() const noexcept;
+    
+    /// Pseudorapidity
+    double Eta() const noexcept;
+    
+    /// Azimuthal angle
+    double Phi() const noexcept;
+    
+    /// Mass, which is always zero
+    double M() const noexcept;
+    
+    /// Cartesian components of the momentum and energy
+    double Px() const noexcept;
+    double Py() const noexcept;
+    double Pz() const noexcept;
+    double E() const noexcept;
+    
+    /// Builds the four-momentum
+    FourVector Momentum() const noexcept;
+    
+    /// Builds the four-momentum as a TLorentzVector
+    TLorentzVector P4() const noexcept;
+    
+    /// Calculates dR distance to another object
+    template<typename T>
+    double DeltaR(T const &rhs) const noexcept;
+    
+    /// Returns jet flavour encoded with PDG ID codes
+    int Flavour() const noexcept;
+    
+    /// Returns value of the b-tagging discriminator
+    double BTag() const noexcept;
+    
+    /// Creates a standalone copy of the jet with properties of the given type
+    template<typename T = double>
+    BasicJet<T> ToJet() const noexcept;
+    
+private:
+    /// Source of the properties
+    JetSource const *src;
+    
+    /// Index of the jet in the read buffers
+    unsigned index;
+};
+
+
+/**
+ * \class ObjectRange
+ * \brief A range of views to objects of the current event, ordered in pt
+ * 
+ * Supports the subset of the interface of std::vector that is needed to iterate over the objects.
+ * Iterators and accessors return views by value.
+ */
+template<typename View, typename Source>
+class ObjectRange
+{
+public:
+    /**
+     * \brief Iterator over the range
+     * 
+     * Dereferencing returns a view by value rather than a reference, and there is no default
+     * constructor. Hence the iterator only meets the requirements of an input iterator, although
+     * the range can be traversed any number of times.
+     */
+    class Iterator: public std::iterator<std::input_iterator_tag, View, int, void, View>
+    {
+    public:
+        /// Constructor from the source and position in the ordered range
+        Iterator(Source const *src, unsigned pos) noexcept;
+        
+    public:
+        View operator*() const noexcept;
+        Iterator &operator++() noexcept;
+        Iterator operator++(int) noexcept;
+        int operator-(Iterator const &rhs) const noexcept;
+        bool operator==(Iterator const &rhs) const noexcept;
+        bool operator!=(Iterator const &rhs) const noexcept;
+        
+    private:
+        Source const *src;
+        unsigned pos;
+    };
+    
+public:
+    /// Constructor from the source of objects
+    ObjectRange(Source const *src) noexcept;
+    
+public:
+    /// Number of objects
+    unsigned size() const noexcept;
+    
+    /// Checks if there are no objects
+    bool empty() const noexcept;
+    
+    /// Returns the object with the given position in the pt-ordered range
+    View operator[](unsigned pos) const noexcept;
+    
+    /// Same as operator[] but throws an exception if the position is out of range
+    View at(unsigned pos) const;
+    
+    /// Returns the object with the highest pt
+    View front() const noexcept;
+    
+    /// Iterators to the beginning and the end of the range
+    Iterator begin() const noexcept;
+    Iterator end() const noexcept;
+    
+private:
+    /// Source of the objects
+    Source const *src;
+};
+
+
+/// Range of leptons in the current event
+typedef ObjectRange<LeptonView, LeptonSource> LeptonRange;
+
+/// Range of jets in the current event
+typedef ObjectRange<JetView, JetSource> JetRange;
+
+
+
+// Implementation of the methods is given here so that they can be inlined in the event loop
+
+inline LeptonView::LeptonView(LeptonSource const *src_, unsigned index_) noexcept:
+    src(src_), index(index_)
+{}
+
+
+inline double LeptonView::Pt() const noexcept
+{
+    return src->pt[index];
+}
+
+
+inline double LeptonView::Eta() const noexcept
+{
+    return src->eta[index];
+}
+
+
+inline double LeptonView::Phi() const noexcept
+{
+    return src->phi[index];
+}
+
+
+inline double LeptonView::M() const noexcept
+{
+    switch (std::abs(src->flavour[index]))
+    {
+        case 11:  // electron
+            return 0.511e-3;
+        
+        case 13:  // muon
+            return 105.7e-3;
+        
+        case 15:  // tau-lepton
+            return 1776.8e-3;
+        
+        default:
+            return 0.;
+    }
+}
+
+
+inline double LeptonView::Px() const noexcept
+{
+    return Pt() * std::cos(Phi());
+}
+
+
+inline double LeptonView::Py() const noexcept
+{
+    return Pt() * std::sin(Phi());
+}
+
+
+inline double LeptonView::Pz() const noexcept
+{
+    return Pt() * std::sinh(Eta());
+}
+
+
+inline double LeptonView::E() const noexcept
+{
+    double const p = Pt() * std::cosh(Eta());
+    double const m = M();
+    return std::sqrt(p * p + m * m);
+}
+
+
+inline FourVector LeptonView::Momentum() const noexcept
+{
+    return FourVector(Pt(), Eta(), Phi(), M());
+}
+
+
+inline TLorentzVector LeptonView::P4() const noexcept
+{
+    TLorentzVector p4;
+    p4.SetPtEtaPhiM(Pt(), Eta(), Phi(), M());
+    return p4;
+}
+
+
+template<typename T>
+inline double LeptonView::DeltaR(T const &rhs) const noexcept
+{
+    return ::DeltaR<double>(Eta(), Phi(), rhs.Eta(), rhs.Phi());
+}
+
+
+inline int LeptonView::Flavour() const noexcept
+{
+    return src->flavour[index];
+}
+
+
+inline double LeptonView::Isolation() const noexcept
+{
+    if (src->usedGroups)
+        *src->usedGroups |= bgLeptonIsolation;
+    
+    return src->isolation[index];
+}
+
+
+template<typename T>
+inline BasicLepton<T> LeptonView::ToLepton() const noexcept
+{
+    return BasicLepton<T>(Flavour(), src->pt[index], src->eta[index], src->phi[index],
+     Isolation());
+}
+
+
+inline JetView::JetView(JetSource const *src_, unsigned index_) noexcept:
+    src(src_), index(index_)
+{}
+
+
+inline double JetView::Pt() const noexcept
+{
+    return src->pt[index];
+}
+
+
+inline double JetView::Eta() const noexcept
+{
+    return src->eta[index];
+}
+
+
+inline double JetView::Phi() const noexcept
+{
+    return src->phi[index];
+}
+
+
+inline double JetView::M() const noexcept
+{
+    return 0.;
+}
+
+
+inline double JetView::Px() const noexcept
+{
+    return Pt() * std::cos(Phi());
+}
+
+
+inline double JetView::Py() const noexcept
+{
+    return Pt() * std::sin(Phi());
+}
+
+
+inline double JetView::Pz() const noexcept
+{
+    return Pt() * std::sinh(Eta());
+}
+
+
+inline double JetView::E() const noexcept
+{
+    return Pt() * std::cosh(Eta());
+}
+
+
+inline FourVector JetView::Momentum() const noexcept
+{
+    return FourVector(Pt(), Eta(), Phi(), 0.);
+}
+
+
+inline TLorentzVector JetView::P4() const noexcept
+{
+    TLorentzVector p4;
+    p4.SetPtEtaPhiM(Pt(), Eta(), Phi(), 0.);
+    return p4;
+}
+
+
+template<typename T>
+inline double JetView::DeltaR(T const &rhs) const noexcept
+{
+    return ::DeltaR<double>(Eta(), Phi(), rhs.Eta(), rhs.Phi());
+}
+
+
+inline int JetView::Flavour() const noexcept
+{
+    return src->flavour[index];
+}
+
+
+inline double JetView::BTag() const noexcept
+{
+    return src->bTag[index];
+}
+
+
+template<typename T>
+inline BasicJet<T> JetView::ToJet() const noexcept
+{
+    return BasicJet<T>(src->pt[index], src->eta[index], src->phi[index], src->bTag[index],
+     Flavour());
+}
+
+
+template<typename View, typename Source>
+inline ObjectRange<View, Source>::Iterator::Iterator(Source const *src_, unsigned pos_) noexcept:
+    src(src_), pos(pos_)
+{}
+
+
+template<typename View, typename Source>
+inline View ObjectRange<View, Source>::Iterator::operator*() const noexcept
+{
+    return View(src, src->order[pos]);
+}
+
+
+template<typename View, typename Source>
+inline typename ObjectRange<View, Source>::Iterator &
+ ObjectRange<View, Source>::Iterator::operator++() noexcept
+{
+    ++pos;
+    return *this;
+}
+
+
+template<typename View, typename Source>
+inline typename ObjectRange<View, Source>::Iterator
+ ObjectRange<View, Source>::Iterator::operator++(int) noexcept
+{
+    Iterator const old(*this);
+    ++pos;
+    return old;
+}
+
+
+template<typename View, typename Source>
+inline int ObjectRange<View, Source>::Iterator::operator-(Iterator const &rhs) const noexcept
+{
+    return int(pos) - int(rhs.pos);
+}
+
+
+template<typename View, typename Source>
+inline bool ObjectRange<View, Source>::Iterator::operator==(Iterator const &rhs) const noexcept
+{
+    return (pos == rhs.pos);
+}
+
+
+template<typename View, typename Source>
+inline bool ObjectRange<View, Source>::Iterator::operator!=(Iterator const &rhs) const noexcept
+{
+    return (pos != rhs.pos);
+}
+
+
+template<typename View, typename Source>
+inline ObjectRange<View, Source>::ObjectRange(Source const *src_) noexcept:
+    src(src_)
+{}
+
+
+template<typename View, typename Source>
+inline unsigned ObjectRange<View, Source>::size() const noexcept
+{
+    return *src->size;
+}
+
+
+template<typename View, typename Source>
+inline bool ObjectRange<View, Source>::empty() const noexcept
+{
+    return (*src->size == 0);
+}
+
+
+template<typename View, typename Source>
+inline View ObjectRange<View, Source>::operator[](unsigned pos) const noexcept
+{
+    return View(src, src->order[pos]);
+}
+
+
+template<typename View, typename Source>
+inline View ObjectRange<View, Source>::at(unsigned pos) const
+{
+    if (pos >= size())
+        throw std::out_of_range("ObjectRange::at: index is out of range.");
+    
+    return (*this)[pos];
+}
+
+
+template<typename View, typename Source>
+inline View ObjectRange<View, Source>::front() const noexcept
+{
+    return (*this)[0];
+}
+
+
+template<typename View, typename Source>
+inline typename ObjectRange<View, Source>::Iterator ObjectRange<View, Source>::begin() const
+ noexcept
+{
+    return Iterator(src, 0);
+}
+
+
+template<typename View, typename Source>
+inline typename ObjectRange<View, Source>::Iterator ObjectRange<View, Source>::end() const
+ noexcept
+{
+    return Iterator(src, *src->size);
+}
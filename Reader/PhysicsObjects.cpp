@@ -1,76 +1,100 @@
 #include <PhysicsObjects.hpp>
 
 
-Candidate::Candidate() noexcept:
+template<typename T>
+BasicCandidate<T>::BasicCandidate() noexcept:
     p4()
 {}
 
 
-Candidate::Candidate(TLorentzVector const &p4_) noexcept:
+template<typename T>
+BasicCandidate<T>::BasicCandidate(TLorentzVector const &p4_) noexcept:
     p4(p4_)
 {}
 
 
-Candidate::Candidate(double pt, double eta, double phi, double mass /*= 0.*/) noexcept
+template<typename T>
+BasicCandidate<T>::BasicCandidate(BasicFourVector<T> const &p4_) noexcept:
+    p4(p4_)
+{}
+
+
+template<typename T>
+BasicCandidate<T>::BasicCandidate(T pt, T eta, T phi, T mass /*= 0*/) noexcept:
+    p4(pt, eta, phi, mass)
+{}
+
+
+template<typename T>
+BasicFourVector<T> const &BasicCandidate<T>::Momentum() const noexcept
 {
-    p4.SetPtEtaPhiM(pt, eta, phi, mass);
+    return p4;
 }
 
 
-TLorentzVector const &Candidate::P4() const noexcept
+template<typename T>
+TLorentzVector BasicCandidate<T>::P4() const noexcept
 {
-    return p4;
+    return p4.ToTLorentzVector();
 }
 
 
-double Candidate::Pt() const noexcept
+template<typename T>
+T BasicCandidate<T>::Pt() const noexcept
 {
     return p4.Pt();
 }
 
 
-double Candidate::Eta() const noexcept
+template<typename T>
+T BasicCandidate<T>::Eta() const noexcept
 {
     return p4.Eta();
 }
 
 
-double Candidate::Phi() const noexcept
+template<typename T>
+T BasicCandidate<T>::Phi() const noexcept
 {
     return p4.Phi();
 }
 
 
-double Candidate::M() const noexcept
+template<typename T>
+T BasicCandidate<T>::M() const noexcept
 {
     return p4.M();
 }
 
 
-double Candidate::DeltaR(Candidate const &rhs) const noexcept
+template<typename T>
+T BasicCandidate<T>::DeltaR(BasicCandidate const &rhs) const noexcept
 {
     return p4.DeltaR(rhs.p4);
 }
 
 
-bool Candidate::operator<(Candidate const &rhs) const noexcept
+template<typename T>
+bool BasicCandidate<T>::operator<(BasicCandidate const &rhs) const noexcept
 {
     return (p4.Pt() < rhs.p4.Pt());
 }
 
 
 
-Lepton::Lepton() noexcept:
-    Candidate(),
-    flavour(0), isolation(0.)
+template<typename T>
+BasicLepton<T>::BasicLepton() noexcept:
+    BasicCandidate<T>(),
+    flavour(0), isolation(0)
 {}
 
 
-Lepton::Lepton(int flavour_, double pt, double eta, double phi, double isolation_) noexcept:
+template<typename T>
+BasicLepton<T>::BasicLepton(int flavour_, T pt, T eta, T phi, T isolation_) noexcept:
     flavour(flavour_), isolation(isolation_)
 {
     // Deduce the mass
-    double mass = 0.;
+    T mass = 0;
     
     switch (abs(flavour))
     {
@@ -89,59 +113,83 @@ Lepton::Lepton(int flavour_, double pt, double eta, double phi, double isolation
     
     
     // Set the four-momentum
-    Candidate::p4.SetPtEtaPhiM(pt, eta, phi, mass);
+    BasicCandidate<T>::p4 = BasicFourVector<T>(pt, eta, phi, mass);
 }
 
 
-int Lepton::Flavour() const noexcept
+template<typename T>
+int BasicLepton<T>::Flavour() const noexcept
 {
     return flavour;
 }
 
 
-double Lepton::Isolation() const noexcept
+template<typename T>
+T BasicLepton<T>::Isolation() const noexcept
 {
     return isolation;
 }
 
 
 
-Jet::Jet() noexcept:
-    Candidate(),
-    flavour(0), bTag(0.)
+template<typename T>
+BasicJet<T>::BasicJet() noexcept:
+    BasicCandidate<T>(),
+    flavour(0), bTag(0)
 {}
 
 
-Jet::Jet(double pt, double eta, double phi, double bTag_, int flavour_ /* = 0*/) noexcept:
-    Candidate(pt, eta, phi, 0.),
+template<typename T>
+BasicJet<T>::BasicJet(T pt, T eta, T phi, T bTag_, int flavour_ /* = 0*/) noexcept:
+    BasicCandidate<T>(pt, eta, phi, 0),
     flavour(flavour_), bTag(bTag_)
 {}
 
 
-int Jet::Flavour() const noexcept
+template<typename T>
+int BasicJet<T>::Flavour() const noexcept
 {
     return flavour;
 }
 
 
-double Jet::BTag() const noexcept
+template<typename T>
+T BasicJet<T>::BTag() const noexcept
 {
     return bTag;
 }
 
 
 
-MET::MET() noexcept:
-    Candidate()
+template<typename T>
+BasicMET<T>::BasicMET() noexcept:
+    BasicCandidate<T>()
 {}
 
 
-MET::MET(double pt, double phi) noexcept:
-    Candidate(pt, 0., phi, 0.)
+template<typename T>
+BasicMET<T>::BasicMET(T pt, T phi) noexcept:
+    BasicCandidate<T>(pt, 0, phi, 0)
 {}
 
 
-void MET::Set(double pt, double phi) noexcept
+template<typename T>
+void BasicMET<T>::Set(T pt, T phi) noexcept
 {
-    Candidate::p4.SetPtEtaPhiM(pt, 0., phi, 0.);
+    BasicCandidate<T>::p4 = BasicFourVector<T>(pt, 0, phi, 0);
 }
+
+
+
+// Explicit instantiations for the two supported precisions
+template class BasicCandidate<double>;
+template class BasicCandidate<float>;
+
+template class BasicLepton<double>;
+template class BasicLepton<float>;
+
+template class BasicJet<double>;
+template class BasicJet<float>;
+
+template class BasicMET<double>;
+template class BasicMET<float>;
@@ -1,70 +1,92 @@
 #pragma once
 
+#include <FourVector.hpp>
+
 #include <TLorentzVector.h>
 
 
 /**
- * \class Candidate
- * \brief A wrapper around a Lorentz vector
+ * \class BasicCandidate
+ * \brief A wrapper around a four-momentum
  * 
- * The class is used as a base class for leptons and jets
+ * The class is used as a base class for leptons and jets. The four-momentum is stored as a
+ * BasicFourVector, so that the short-cuts below do not recompute anything. The template parameter
+ * is the type of stored properties. The classes are instantiated for double (Candidate, Lepton,
+ * Jet, MET) and float (CandidateF, LeptonF, JetF, METF) only. Single precision matches the source
+ * trees and halves the size of collections of objects; double precision is the default.
  */
-class Candidate
+template<typename T>
+class BasicCandidate
 {
+public:
+    /// Type of the properties
+    typedef T Scalar;
+    
 public:
     /// Constructor with no parameters
-    Candidate() noexcept;
+    BasicCandidate() noexcept;
     
     /// Constructor from a Lorentz vector
-    Candidate(TLorentzVector const &p4) noexcept;
+    BasicCandidate(TLorentzVector const &p4) noexcept;
+    
+    /// Constructor from a four-vector
+    BasicCandidate(BasicFourVector<T> const &p4) noexcept;
     
     /// Constructor with explicit initialisation
-    Candidate(double pt, double eta, double phi, double mass = 0.) noexcept;
+    BasicCandidate(T pt, T eta, T phi, T mass = 0) noexcept;
     
 public:
     /// Accessor to the four-momentum
-    TLorentzVector const &P4() const noexcept;
+    BasicFourVector<T> const &Momentum() const noexcept;
+    
+    /// Builds the four-momentum as a TLorentzVector
+    TLorentzVector P4() const noexcept;
     
     /// A short-cut for transverse momentum
-    double Pt() const noexcept;
+    T Pt() const noexcept;
     
     /// A short-cut for pseudorapidity
-    double Eta() const noexcept;
+    T Eta() const noexcept;
     
     /// A short-cut for azimuthal angle
-    double Phi() const noexcept;
+    T Phi() const noexcept;
     
     /// A short-cut for mass
-    double M() const noexcept;
+    T M() const noexcept;
     
     /// A short-cut to calculate dR distance
-    double DeltaR(Candidate const &rhs) const noexcept;
+    T DeltaR(BasicCandidate const &rhs) const noexcept;
     
     /// Comparison operator for pt ordering
-    bool operator<(Candidate const &rhs) const noexcept;
+    bool operator<(BasicCandidate const &rhs) const noexcept;
     
 protected:
     /// Four-momentum
-    TLorentzVector p4;
+    BasicFourVector<T> p4;
 };
 
 
 /**
- * \class Lepton
+ * \class BasicLepton
  * \brief Describes a reconstructed lepton
  */
-class Lepton: public Candidate
+template<typename T>
+class BasicLepton: public BasicCandidate<T>
 {
 public:
     /// Constructor without parameters
-    Lepton() noexcept;
+    BasicLepton() noexcept;
     
     /**
      * \brief Constructor explicit initialisation
      * 
      * The mass is set according to the given flavour.
      */
-    Lepton(int flavour, double pt, double eta, double phi, double isolation) noexcept;
+    BasicLepton(int flavour, T pt, T eta, T phi, T isolation) noexcept;
+    
+    /// Conversion from the other precision
+    template<typename U>
+    explicit BasicLepton(BasicLepton<U> const &src) noexcept;
     
 public:
     /**
@@ -80,7 +102,7 @@ public:
      * 
      * The smaller the value, the smaller are energy depositions around the lepton.
      */
-    double Isolation() const noexcept;
+    T Isolation() const noexcept;
     
 private:
     /**
@@ -91,26 +113,31 @@ private:
     int flavour;
     
     /// Isolation
-    double isolation;
+    T isolation;
 };
 
 
 /**
- * \class Jet
+ * \class BasicJet
  * \brief Describes a reconstructed jet
  */
-class Jet: public Candidate
+template<typename T>
+class BasicJet: public BasicCandidate<T>
 {
 public:
     /// Constructor without parameters
-    Jet() noexcept;
+    BasicJet() noexcept;
     
     /**
      * \brief Constructor explicit initialisation
      * 
      * The mass is set to zero.
      */
-    Jet(double pt, double eta, double phi, double bTag, int flavour = 0) noexcept;
+    BasicJet(T pt, T eta, T phi, T bTag, int flavour = 0) noexcept;
+    
+    /// Conversion from the other precision
+    template<typename U>
+    explicit BasicJet(BasicJet<U> const &src) noexcept;
     
 public:
     /**
@@ -128,7 +155,7 @@ public:
      * The larger the value, the more likely it is that the jet stems from fragmentation of a
      * B hadron.
      */
-    double BTag() const noexcept;
+    T BTag() const noexcept;
     
 private:
     /**
@@ -143,28 +170,60 @@ private:
      * 
      * See documentation for the method 'BTag'.
      */
-    double bTag;
+    T bTag;
 };
 
 
 /**
- * \class MET
+ * \class BasicMET
  * \brief Represents reconstructed missing transverse energy
  */
-class MET: public Candidate
+template<typename T>
+class BasicMET: public BasicCandidate<T>
 {
 public:
     /// Constructor without parameters
-    MET() noexcept;
+    BasicMET() noexcept;
     
     /**
      * \brief Constructor with complete initialisation
      * 
      * Pseudorapidity and mass are always set to zero.
      */
-    MET(double pt, double phi) noexcept;
+    BasicMET(T pt, T phi) noexcept;
     
 public:
     /// Updates the object
-    void Set(double pt, double phi) noexcept;
+    void Set(T pt, T phi) noexcept;
 };
+
+
+/// Physics objects in double precision
+typedef BasicCandidate<double> Candidate;
+typedef BasicLepton<double> Lepton;
+typedef BasicJet<double> Jet;
+typedef BasicMET<double> MET;
+
+/// Physics objects in single precision
+typedef BasicCandidate<float> CandidateF;
+typedef BasicLepton<float> LeptonF;
+typedef BasicJet<float> JetF;
+typedef BasicMET<float> METF;
+
+
+// The converting constructors are templates in two parameters and are defined here
+
+template<typename T>
+template<typename U>
+BasicLepton<T>::BasicLepton(BasicLepton<U> const &src) noexcept:
+    BasicCandidate<T>(BasicFourVector<T>(src.Momentum())),
+    flavour(src.Flavour()), isolation(src.Isolation())
+{}
+
+
+template<typename T>
+template<typename U>
+BasicJet<T>::BasicJet(BasicJet<U> const &src) noexcept:
+    BasicCandidate<T>(BasicFourVector<T>(src.Momentum())),
+    flavour(src.Flavour()), bTag(src.BTag())
+{}
@@ -1,110 +1,343 @@
 #include <Reader.hpp>
+#include <DeltaRKernels.hpp>
+
+#include <TTreeCache.h>
+#include <TList.h>
+#include <TThread.h>
 
 #include <stdexcept>
 #include <sstream>
+#include <iomanip>
 #include <algorithm>
+#include <cstring>
+#include <limits>
+#include <iterator>
+#include <chrono>
+#include <cstdint>
 
 
 using namespace std;
 
 
-// A static data member
+/// Waits before the next attempt to access a queue. Yields at first and then sleeps
+static void Backoff(unsigned &nAttempts)
+{
+    if (++nAttempts < 64)
+        this_thread::yield();
+    else
+        this_thread::sleep_for(chrono::microseconds(50));
+}
+
+
+/**
+ * \brief Skips zones that are marked as not to be read
+ * 
+ * The zones are given by the indices of the entries following their last entries and flags that
+ * show if they are read. They are sorted and cover the tree without gaps. The index of the zone
+ * that contains the current entry is updated, and the entry is moved to the end of the zone if the
+ * latter is not read.
+ */
+static void SkipZones(vector<pair<Long64_t, bool>> const &zones, size_t &zoneIndex,
+ unsigned long &entry, unsigned long endEntry) noexcept
+{
+    while (zoneIndex < zones.size() and zones[zoneIndex].first <= Long64_t(entry))
+        ++zoneIndex;
+    
+    if (zoneIndex < zones.size() and not zones[zoneIndex].second)
+        entry = min<unsigned long>(zones[zoneIndex].first, endEntry);
+}
+
+
+/// Decides if the cluster with the given index is read in the preview mode
+static bool IsPreviewCluster(unsigned stride, unsigned long seed, uint64_t treeHash,
+ unsigned long index) noexcept
+{
+    if (seed == 0)
+        return (index % stride == 0);
+    
+    
+    // Mix the arguments with the finaliser of SplitMix64, which gives well distributed values even
+    //for consecutive indices
+    uint64_t x = seed ^ treeHash ^ (index * 0x9e3779b97f4a7c15ull);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    
+    return (x % stride == 0);
+}
+
+
+/// Returns indices 0, 1, 2, etc., which describe the order of objects already ordered in pt
+static unsigned char const *GetIdentityOrder() noexcept
+{
+    struct IdentityOrder
+    {
+        IdentityOrder()
+        {
+            for (unsigned i = 0; i < Reader::maxSize; ++i)
+                order[i] = i;
+        }
+        
+        unsigned char order[Reader::maxSize];
+    };
+    
+    static IdentityOrder const identity;
+    return identity.order;
+}
+
+
+/**
+ * \brief Visitor that points fields of a description of objects to the given arrays
+ * 
+ * The arrays can be read buffers, columns of a block, or columns of a batch. The given offset is
+ * added to them.
+ */
+struct FieldPointerSetter
+{
+    /// Offset of the first object
+    unsigned offset;
+    
+    template<typename Field, typename T, typename Array>
+    void operator()(Field const &, T const *&field, Array const &array) const
+    {
+        field = array + offset;
+    }
+    
+    template<typename Field, typename T>
+    void operator()(Field const &, T const *&field, vector<T> const &column) const
+    {
+        field = column.data() + offset;
+    }
+};
+
+
+/// Visitor that copies the element with the given index from columns into read buffers
+struct ElementCopier
+{
+    /// Index of the element
+    unsigned long index;
+    
+    template<typename Field, typename T>
+    void operator()(Field const &, T &buffer, T const *column) const
+    {
+        buffer = column[index];
+    }
+};
+
+
+/// Visitor that appends properties of objects to columns in the given order
+struct OrderedAppender
+{
+    /// Indices of the objects in the order in which they are appended
+    unsigned char const *order;
+    
+    /// Number of objects
+    int size;
+    
+    template<typename Field, typename T>
+    void operator()(Field const &, vector<T> &column, T const *values) const
+    {
+        for (int i = 0; i < size; ++i)
+            column.push_back(values[order[i]]);
+    }
+};
+
+
+/// Visitor that copies an object from the given position in a collection to read buffers
+struct ElementMover
+{
+    /// Positions of the object in the source collection and in the buffers
+    unsigned from, to;
+    
+    template<typename Field, typename T>
+    void operator()(Field const &, T *buffer, T const *values) const
+    {
+        buffer[to] = values[from];
+    }
+};
+
+
+/// Visitor that appends per-event values to columns
+struct ValueAppender
+{
+    template<typename Field, typename T>
+    void operator()(Field const &, vector<T> &column, T const &value) const
+    {
+        column.push_back(value);
+    }
+};
+
+
+// Static data members
 unsigned const Reader::maxSize;
+Long64_t const Reader::minCacheSize;
+char const *const Reader::ptOrderedMarker = "ObjectsOrderedInPt";
 
 
 Reader::Reader(shared_ptr<TFile> &srcFile_, list<string> const &treeNames_, bool isMC_ /*= true*/):
-    srcFile(srcFile_), treeNames(treeNames_), curTreeNameIt(treeNames.begin()), isMC(isMC_),
+    Reader(srcFile_, nullptr, treeNames_, isMC_)
+{}
+
+
+Reader::Reader(shared_ptr<TFile> &srcFile_, string const &treeName, bool isMC_ /*= true*/):
+    Reader(srcFile_, list<string>{treeName}, isMC_)
+{}
+
+
+Reader::Reader(shared_ptr<FlatEventFile> const &flatFile_, list<string> const &treeNames_,
+ bool isMC_ /*= true*/):
+    Reader(nullptr, flatFile_, treeNames_, isMC_)
+{}
+
+
+Reader::Reader(shared_ptr<FlatEventFile> const &flatFile_, string const &treeName,
+ bool isMC_ /*= true*/):
+    Reader(flatFile_, list<string>{treeName}, isMC_)
+{}
+
+
+Reader::Reader(shared_ptr<TFile> const &srcFile_, shared_ptr<FlatEventFile> const &flatFile_,
+ list<string> const &treeNames_, bool isMC_):
+    srcFile(srcFile_), flatFile(flatFile_), treeNames(treeNames_),
+    csvReweighter(isMC_ ? CSVReweighter::GetInstance() : nullptr),
+    curTreeNameIt(treeNames.begin()), curFlatTree(nullptr), curFlatBlock(0),
+    rangeBegin(0), rangeEnd(numeric_limits<unsigned long>::max()), isMC(isMC_),
     curSystType(SystType::Nominal), curSystDirection(SystDirection::Up),
-    applyBTagReweighting(true)
+    readJECVariations(false), objectsOrdered(false), loadedEntry(-1), builtJECGroups(0),
+    allWeightsCached(false), applyBTagReweighting(true), jetCleaningDR(0.),
+    jetCleaningMinLeptonPt(0.),
+    nLearningEventsLeft(0), usedBranchGroups(0), sourcesRedirected(false),
+    readAheadDepth(0), readAheadBatchSize(0), stopPrefetch(false),
+    curBatch(nullptr), curBatchPos(0), curBatchRetired(false), resumeTree(0), resumeEntry(0),
+    readAheadStats{0, 0, 0.}, curEntryListPos(0), curZoneIndex(0),
+    previewStride(1), previewSeed(0), curPreviewClusterIndex(0), previewScale(1.),
+    curTreeStats(nullptr), nReadCalls(0), curEventSampled(false), fileBytesMark(0)
 {
     // Make sure the source file is a valid one
-    if (not srcFile or srcFile->IsZombie())
+    if (not flatFile and (not srcFile or srcFile->IsZombie()))
         throw runtime_error("The source file does not exist or is corrupted.");
     
     
+    // Describe the branches that will be read
+    RegisterBranches();
+    
+    
+    // Describe the read buffers for the views of objects
+    ResetSources();
+    
+    
+    // Create counters for all trees
+    for (auto const &name: treeNames)
+        treeStats.push_back(&stats.GetTree(name));
+    
+    
     // Get the first tree
     GetTree(*curTreeNameIt);
 }
 
 
-Reader::Reader(shared_ptr<TFile> &srcFile_, string const &treeName, bool isMC_ /*= true*/):
-    Reader(srcFile_, list<string>{treeName}, isMC_)
-{}
+Reader::~Reader()
+{
+    StopReadAhead();
+}
 
 
 bool Reader::ReadNextEvent()
 {
-    // Check if there are events left in the current source tree
-    if (curEntry == nEntries)  // no more events in the current tree
+    // Measure the time spent in the user code on the previous event and in reading the next one,
+    //but only for sampled events. Otherwise the cost is a single comparison
+    chrono::steady_clock::time_point start;
+    bool const sampled = ((++nReadCalls & (ReaderStats::samplingPeriod - 1)) == 0);
+    
+    if (curEventSampled or sampled)
     {
-        ++curTreeNameIt;
-        
-        if (curTreeNameIt == treeNames.end())  // no more source trees
-            return false;
+        start = chrono::steady_clock::now();
         
-        GetTree(*curTreeNameIt);
+        if (curEventSampled)
+            curTreeStats->userTime += ReaderStats::samplingPeriod *
+             chrono::duration<double>(start - curEventTime).count();
     }
     
-    
-    // Either there were events in the current source file or a new file has been opened
-    curTree->GetEntry(curEntry);
-    ++curEntry;
+    curEventSampled = false;
     
     
-    // Copy properies of objects in the event from read buffers
-    leptons.clear();
+    // Temporaries of the user code from the previous event are no longer needed
+    arena.Reset();
     
-    for (int i = 0; i < lepSize; ++i)
-        leptons.emplace_back(lepFlavour[i], lepPt[i], lepEta[i], lepPhi[i], lepIso[i]);
     
-    jets.clear();
+    // Read the buffers
+    if (not ReadNextEntry())
+        return false;
     
-    for (int i = 0; i < jetSize; ++i)
-        jets.emplace_back(jetPt[i], jetEta[i], jetPhi[i], jetBTag[i], jetFlavour[i]);
     
-    met.Set(metPt, metPhi);
-    
-    if (isMC)
+    // Order objects in pt. The objects themselves are not copied: views to them are created on
+    //demand by the getters
+    if (not objectsOrdered)
     {
-        jetsJECUp.clear();
-        jetsJECDown.clear();
+        OrderInPt(lepBuffers.pt, lepSize, lepOrder);
         
-        for (int i = 0; i < jetJECUpSize; ++i)
-            jetsJECUp.emplace_back(jetJECUpPt[i], jetJECUpEta[i], jetJECUpPhi[i],
-             jetJECUpBTag[i], jetJECUpFlavour[i]);
-        
-        for (int i = 0; i < jetJECDownSize; ++i)
-            jetsJECDown.emplace_back(jetJECDownPt[i], jetJECDownEta[i], jetJECDownPhi[i],
-             jetJECDownBTag[i], jetJECDownFlavour[i]);
-        
-        metJECUp.Set(metJECUpPt, metJECUpPhi);
-        metJECDown.Set(metJECDownPt, metJECDownPhi);
+        if (jetCleaningDR <= 0.)
+            OrderInPt(jetBuffers.pt, jetSize, jetOrder);
     }
     
+    met.Set(eventBuffers.metPt, eventBuffers.metPhi);
     
-    // Make sure vector of leptons and jets are ordered in pt
-    sort(leptons.rbegin(), leptons.rend());
-    sort(jets.rbegin(), jets.rend());
     
-    if (isMC)
-    {
-        sort(jetsJECUp.rbegin(), jetsJECUp.rend());
-        sort(jetsJECDown.rbegin(), jetsJECDown.rend());
-    }
+    // JEC-varied collections will be set up when requested, unless they are cleaned now
+    builtJECGroups = 0;
+    CleanAllJets();
     
     
-    // Indicate that the stored event weight is no longer up-to-date
+    // Indicate that the stored event weights are no longer up-to-date
     weightCached = false;
-        
+    allWeightsCached = false;
+    
+    
+    ++curTreeStats->nEvents;
+    
+    if (sampled)
+    {
+        curEventTime = chrono::steady_clock::now();
+        curTreeStats->readTime += ReaderStats::samplingPeriod *
+         chrono::duration<double>(curEventTime - start).count();
+        curEventSampled = true;
+    }
+    
     
     return true;
 }
 
 
-void Reader::Rewind() noexcept
+unsigned Reader::ReadBatch(EventBatch &batch, unsigned maxEvents)
 {
+    batch.Clear();
+    
+    while (batch.nEvents < maxEvents and ReadNextEntry())
+        AppendCurrentEvent(batch);
+    
+    return batch.nEvents;
+}
+
+
+void Reader::Rewind()
+{
+    // The background thread reads the trees and must not run while they are switched
+    StopReadAhead();
+    
     curTreeNameIt = treeNames.begin();
     GetTree(*curTreeNameIt);
+    
+    if (readAheadDepth > 0)
+        StartReadAhead(0, curEntry);
+}
+
+
+void Reader::SetEntryRange(unsigned long firstEntry, unsigned long lastEntry)
+{
+    rangeBegin = firstEntry;
+    rangeEnd = lastEntry;
+    
+    Rewind();
 }
 
 
@@ -120,78 +353,203 @@ void Reader::SetSystematics(SystType systType, SystDirection systDirection)
         curSystDirection = SystDirection::Up;
     
     
+    // Make sure JEC-varied branches are read if needed
+    if (curSystType == SystType::JEC)
+        EnableJECVariations();
+    
+    
     // The stored weight might not be up-to-date anymore since it might be affected by the
     //systematics
     weightCached = false;
 }
 
 
-vector<Lepton> const &Reader::GetLeptons() const noexcept
+void Reader::EnableJECVariations()
+{
+    if (not isMC or readJECVariations)
+        return;
+    
+    readJECVariations = true;
+    ApplyBranchSelection();
+    
+    
+    // When reading in the background, restart it to read the variations, including the current
+    //event
+    if (readAheadDepth > 0)
+    {
+        RestartReadAhead(true);
+        builtJECGroups = 0;
+        CleanAllJets();
+        return;
+    }
+    
+    
+    // If an event has been read already, read the JEC-varied branches for it. Flat event files
+    //always provide the variations
+    if (curTree and loadedEntry >= 0)
+    {
+        unsigned const jecGroups = bgJetsJECUp | bgJetsJECDown | bgMETJECUp | bgMETJECDown;
+        
+        // Branches are read individually. Set the current entry of the tree first, so that the
+        //reads are served by the TTreeCache
+        curTree->LoadTree(loadedEntry);
+        
+        for (auto const &b: branchBindings)
+            if ((b.group & jecGroups) and IsBranchRead(b))
+            {
+                TBranch *branch = curTree->GetBranch(b.name.c_str());
+                
+                if (branch)
+                    branch->GetEntry(loadedEntry);
+            }
+        
+        builtJECGroups = 0;
+        CleanAllJets();
+    }
+}
+
+
+LeptonRange Reader::GetLeptons() const noexcept
+{
+    usedBranchGroups |= bgLeptons;
+    return LeptonRange(&leptonSource);
+}
+
+
+JetRange Reader::GetJets() const noexcept
 {
-    return leptons;
+    return GetJets(curSystType, curSystDirection);
 }
 
 
-vector<Jet> const &Reader::GetJets() const noexcept
+JetRange Reader::GetJets(SystType systType, SystDirection systDirection) const noexcept
 {
-    if (isMC and curSystType == SystType::JEC)
+    if (isMC and systType == SystType::JEC)
     {
-        if (curSystDirection == SystDirection::Up)
-            return jetsJECUp;
+        if (systDirection == SystDirection::Up)
+        {
+            usedBranchGroups |= bgJetsJECUp;
+            
+            if (not (builtJECGroups & bgJetsJECUp) and not objectsOrdered)
+            {
+                OrderInPt(jetJECUpBuffers.pt, jetJECUpSize, jetJECUpOrder);
+                builtJECGroups |= bgJetsJECUp;
+            }
+            
+            return JetRange(&jetJECUpSource);
+        }
         else
-            return jetsJECDown;
+        {
+            usedBranchGroups |= bgJetsJECDown;
+            
+            if (not (builtJECGroups & bgJetsJECDown) and not objectsOrdered)
+            {
+                OrderInPt(jetJECDownBuffers.pt, jetJECDownSize, jetJECDownOrder);
+                builtJECGroups |= bgJetsJECDown;
+            }
+            
+            return JetRange(&jetJECDownSource);
+        }
     }
     else
-        return jets;
+    {
+        usedBranchGroups |= bgJets;
+        return JetRange(&jetSource);
+    }
 }
 
 
 MET const &Reader::GetMET() const noexcept
 {
-    if (isMC and curSystType == SystType::JEC)
+    return GetMET(curSystType, curSystDirection);
+}
+
+
+MET const &Reader::GetMET(SystType systType, SystDirection systDirection) const noexcept
+{
+    if (isMC and systType == SystType::JEC)
     {
-        if (curSystDirection == SystDirection::Up)
+        if (systDirection == SystDirection::Up)
+        {
+            usedBranchGroups |= bgMETJECUp;
+            
+            if (not (builtJECGroups & bgMETJECUp))
+            {
+                metJECUp.Set(eventBuffers.metJECUpPt, eventBuffers.metJECUpPhi);
+                builtJECGroups |= bgMETJECUp;
+            }
+            
             return metJECUp;
+        }
         else
+        {
+            usedBranchGroups |= bgMETJECDown;
+            
+            if (not (builtJECGroups & bgMETJECDown))
+            {
+                metJECDown.Set(eventBuffers.metJECDownPt, eventBuffers.metJECDownPhi);
+                builtJECGroups |= bgMETJECDown;
+            }
+            
             return metJECDown;
+        }
     }
     else
+    {
+        usedBranchGroups |= bgMET;
         return met;
+    }
 }
 
 
 double Reader::GetWeight() noexcept
 {
+    // The weight is calculated from the raw weight and the nominal jets
+    usedBranchGroups |= bgWeight | bgJets;
+    
+    
     // If the current sample is data, the answer is trivial
     if (not isMC)
-        return 1.;
+        return previewScale;
     
     
-    // Check if the weight is up-to-date
+    // Check if the weight is up-to-date. Weights for all variations can be used as well if they
+    //have been computed
     if (weightCached)
         return weight;
     
+    if (allWeightsCached)
+    {
+        weight = allWeights(curSystType, curSystDirection);
+        weightCached = true;
+        return weight;
+    }
+    
     
     // Recalculate the weight. Note that if the workflow reaches this point, the current sample is
     //simulation
     
     // Raw weights stored in the trees inlcude effects of pile-up, lepton scale factors, and
     //normalisation for the cross section and integrated luminosity
-    weight = rawWeight;
+    weight = eventBuffers.rawWeight;
     
     
     // Reweighting for the b-tagging scale factors
     if (applyBTagReweighting)
-        for (auto const &j: jets)
+        for (auto const &j: JetRange(&jetSource))
         {
-            double const perJetBTagWeight =
-             csvReweighter.CalculateJetWeight(j, curSystType, curSystDirection);
+            double const perJetBTagWeight = csvReweighter->CalculateJetWeight(j.Pt(), j.Eta(),
+             j.BTag(), j.Flavour(), curSystType, curSystDirection);
             
             if (perJetBTagWeight != 0.)
                 weight *= perJetBTagWeight;
         }
     
     
+    // In the preview mode, compensate for the clusters that are not read
+    weight *= previewScale;
+    
+    
     // The weight is now cached
     weightCached = true;
     
@@ -201,85 +559,1235 @@ double Reader::GetWeight() noexcept
 }
 
 
+double Reader::GetRawWeight() const noexcept
+{
+    usedBranchGroups |= bgWeight;
+    return (isMC) ? eventBuffers.rawWeight : 1.;
+}
+
+
 unsigned Reader::GetNumPV() const noexcept
 {
-    return nPV;
+    usedBranchGroups |= bgNumPV;
+    return eventBuffers.nPV;
+}
+
+
+SystWeights const &Reader::GetAllWeights() noexcept
+{
+    // The weights are calculated from the raw weight and the nominal jets
+    usedBranchGroups |= bgWeight | bgJets;
+    
+    if (allWeightsCached)
+        return allWeights;
+    
+    
+    // Follow the same steps as in GetWeight, so that the results are identical
+    if (not isMC)
+        allWeights.Fill(1.);
+    else
+    {
+        allWeights.Fill(eventBuffers.rawWeight);
+        
+        if (applyBTagReweighting)
+        {
+            SystWeights jetWeights;
+            
+            for (auto const &j: JetRange(&jetSource))
+            {
+                csvReweighter->CalculateJetWeights(j.Pt(), j.Eta(), j.BTag(), j.Flavour(),
+                 jetWeights);
+                
+                for (unsigned i = 0; i < SystWeights::size; ++i)
+                    if (jetWeights[i] != 0.)
+                        allWeights[i] *= jetWeights[i];
+            }
+        }
+    }
+    
+    for (unsigned i = 0; i < SystWeights::size; ++i)
+        allWeights[i] *= previewScale;
+    
+    
+    allWeightsCached = true;
+    return allWeights;
 }
 
 
 void Reader::SwitchBTagReweighting(bool on /*= true*/)
 {
     applyBTagReweighting = on;
+    
+    // Cached weights might have been computed with the other setting
+    weightCached = false;
+    allWeightsCached = false;
 }
 
 
-void Reader::GetTree(string const &name)
+void Reader::SetBranchesToRead(set<string> const &branchNames)
 {
-    // Get the tree from the source file
-    //curTree.reset(dynamic_cast<TTree *>(srcFile->Get(name.c_str())));
-    curTree.reset(dynamic_cast<TTree *>(srcFile->Get(name.c_str())));
+    branchesToRead = branchNames;
+    nLearningEventsLeft = 0;
     
+    ApplyBranchSelection();
     
-    // Make sure the tree exists
-    if (not curTree)
-    {
-        ostringstream ost;
-        ost << "Cannot find tree \"" << name << "\" in file \"" << srcFile->GetTitle() << "\".";
-        throw runtime_error(ost.str());
-    }
+    if (readAheadDepth > 0)
+        RestartReadAhead(false);
+}
+
+
+void Reader::SetLeptonPreselection(LeptonPreselection const &preselection)
+{
+    leptonPreselection = preselection;
+    
+    if (readAheadDepth > 0)
+        RestartReadAhead(false);
+}
+
+
+void Reader::SetJetLeptonCleaning(double maxDR, double minLeptonPt /*= 0.*/)
+{
+    jetCleaningDR = maxDR;
+    jetCleaningMinLeptonPt = minLeptonPt;
+}
+
+
+void Reader::LearnBranchesToRead(unsigned long nEvents)
+{
+    // Read all branches during the learning phase
+    branchesToRead.clear();
+    ApplyBranchSelection();
     
     
-    // Set event counters
-    nEntries = curTree->GetEntries();
-    curEntry = 0;
+    // Start recording the usage of getters. One is added to the number of events because the
+    //counter is decremented at the beginning of ReadNextEvent
+    usedBranchGroups = 0;
+    nLearningEventsLeft = nEvents + 1;
     
+    if (readAheadDepth > 0)
+        RestartReadAhead(false);
+}
+
+
+void Reader::EnableReadAhead(unsigned queueDepth, unsigned batchSize /*= 1024*/)
+{
+    if (queueDepth == 0 and readAheadDepth == 0)
+        return;
     
-    // Set buffers to read the tree
-    curTree->SetBranchAddress("nlepton", &lepSize);
-    curTree->SetBranchAddress("lept_pt", lepPt);
-    curTree->SetBranchAddress("lept_eta", lepEta);
-    curTree->SetBranchAddress("lept_phi", lepPhi);
-    curTree->SetBranchAddress("lept_iso", lepIso);
-    curTree->SetBranchAddress("lept_flav", lepFlavour);
     
-    curTree->SetBranchAddress("njets", &jetSize);
-    curTree->SetBranchAddress("jet_pt", jetPt);
-    curTree->SetBranchAddress("jet_eta", jetEta);
-    curTree->SetBranchAddress("jet_phi", jetPhi);
-    curTree->SetBranchAddress("jet_btagdiscri", jetBTag);
-    curTree->SetBranchAddress("jet_flav", jetFlavour);
+    // Find where reading should continue before the mode is changed
+    unsigned treeIndex;
+    unsigned long entry;
+    GetReadPosition(false, treeIndex, entry);
     
-    curTree->SetBranchAddress("met_pt", &metPt);
-    curTree->SetBranchAddress("met_phi", &metPhi);
+    StopReadAhead();
+    readAheadDepth = queueDepth;
+    readAheadBatchSize = max(batchSize, 1u);
     
-    curTree->SetBranchAddress("nvertex", &nPV);
     
-    if (isMC)
+    // If reading in the background is disabled, continue in the current thread. The current
+    //event stays valid since its batch is not destroyed
+    if (readAheadDepth == 0)
     {
-        curTree->SetBranchAddress("jesup_njets", &jetJECUpSize);
-        curTree->SetBranchAddress("jet_jesup_pt", jetJECUpPt);
-        curTree->SetBranchAddress("jet_jesup_eta", jetJECUpEta);
-        curTree->SetBranchAddress("jet_jesup_phi", jetJECUpPhi);
-        curTree->SetBranchAddress("jet_jesup_btagdiscri", jetJECUpBTag);
-        curTree->SetBranchAddress("jet_jesup_flav", jetJECUpFlavour);
-        
-        curTree->SetBranchAddress("jesdown_njets", &jetJECDownSize);
-        curTree->SetBranchAddress("jet_jesdown_pt", jetJECDownPt);
-        curTree->SetBranchAddress("jet_jesdown_eta", jetJECDownEta);
-        curTree->SetBranchAddress("jet_jesdown_phi", jetJECDownPhi);
-        curTree->SetBranchAddress("jet_jesdown_btagdiscri", jetJECDownBTag);
-        curTree->SetBranchAddress("jet_jesdown_flav", jetJECDownFlavour);
-        
-        curTree->SetBranchAddress("met_jesup_pt", &metJECUpPt);
-        curTree->SetBranchAddress("met_jesup_phi", &metJECUpPhi);
-        
-        curTree->SetBranchAddress("met_jesdown_pt", &metJECDownPt);
-        curTree->SetBranchAddress("met_jesdown_phi", &metJECDownPhi);
-        
-        curTree->SetBranchAddress("evtweight", &rawWeight);
+        SeekTo(treeIndex, entry);
+        return;
     }
     
     
-    // Set the event weight for data (it will not be modified)
-    weight = 1.;
+    // Make ROOT aware that it is used from several threads and start the background reading
+    TThread::Initialize();
+    StartReadAhead(treeIndex, entry);
+}
+
+
+Reader::ReadAheadStats const &Reader::GetReadAheadStats() const noexcept
+{
+    return readAheadStats;
+}
+
+
+ReaderStats const &Reader::GetStats()
+{
+    // Counters of the background reader can only be accessed when its thread is stopped. If it
+    //has delivered all events, it is not restarted
+    if (prefetchThread.joinable())
+    {
+        if (curBatch and not curBatchRetired and curBatch->last and
+         curBatchPos == curBatch->events.nEvents and not curBatch->exception)
+            StopReadAhead();
+        else
+            RestartReadAhead(false);
+    }
+    
+    UpdateIOStats();
+    return stats;
+}
+
+
+ReaderStats::ScopedTimer Reader::Time(char const *name)
+{
+    return ReaderStats::ScopedTimer(curEventSampled ? &stats.GetTimer(name) : nullptr);
+}
+
+
+EventArena &Reader::GetArena() noexcept
+{
+    return arena;
+}
+
+
+void Reader::SetEntryList(shared_ptr<EntryListFile const> const &entryLists, string const &key)
+{
+    entryListSource = entryLists;
+    entryListKey = key;
+    
+    Rewind();
+}
+
+
+void Reader::SetZoneMap(shared_ptr<ZoneMap const> const &zoneMap_,
+ vector<ZoneMap::Cut> const &cuts)
+{
+    zoneMap = zoneMap_;
+    zoneCuts = cuts;
+    
+    Rewind();
+}
+
+
+void Reader::SetPreview(unsigned stride, unsigned long seed /*= 0*/)
+{
+    previewStride = max(stride, 1u);
+    previewSeed = seed;
+    
+    Rewind();
+}
+
+
+string Reader::DescribeSelection() const
+{
+    ostringstream description;
+    description << setprecision(numeric_limits<double>::max_digits10);
+    
+    description << "preview: " << previewStride << ' ' << previewSeed << '\n';
+    description << "entry list: " << (entryListSource ? entryListKey : "none") << '\n';
+    description << "zone cuts:";
+    
+    if (zoneMap)
+        for (auto const &cut: zoneCuts)
+            description << ' ' << int(cut.variable) << '/' << cut.count << '/' << cut.threshold;
+    else
+        description << " none";
+    
+    description << "\njet-lepton cleaning: ";
+    
+    if (jetCleaningDR > 0.)
+        description << jetCleaningDR << ' ' << jetCleaningMinLeptonPt << '\n';
+    else
+        description << "none\n";
+    
+    return description.str();
+}
+
+
+void Reader::RecordEntryList(shared_ptr<EntryListFile> const &entryLists, string const &key)
+{
+    entryListRecorder = entryLists;
+    recordKey = key;
+}
+
+
+void Reader::MarkSelected()
+{
+    if (not entryListRecorder or loadedEntry < 0)
+        return;
+    
+    
+    // When reading in the background, the current event is described by the current batch
+    if (readAheadDepth > 0)
+    {
+        unsigned const treeIndex = curBatch->trees[curBatchPos - 1];
+        auto treeNameIt = treeNames.cbegin();
+        advance(treeNameIt, treeIndex);
+        
+        entryListRecorder->AddEntry(recordKey, *treeNameIt, curBatch->treeSizes[treeIndex],
+         loadedEntry);
+    }
+    else
+        entryListRecorder->AddEntry(recordKey, *curTreeNameIt, nEntries, loadedEntry);
+}
+
+
+void Reader::GetTree(string const &name)
+{
+    // Finalise the counters of the previous tree
+    UpdateIOStats();
+    curTreeStats = treeStats[GetTreeIndex()];
+    
+    
+    // In case of a flat event file, only set the counters. Objects in such files are always ordered
+    //in pt
+    if (flatFile)
+    {
+        curFlatTree = &flatFile->GetTree(name);
+        
+        nEntries = curFlatTree->nEntries;
+        curEntry = min(rangeBegin, nEntries);
+        endEntry = max(curEntry, min(rangeEnd, nEntries));
+        loadedEntry = -1;
+        curFlatBlock = 0;
+        SetUpSkipping(name);
+        
+        objectsOrdered = true;
+        
+        for (unsigned i = 0; i < maxSize; ++i)
+            lepOrder[i] = jetOrder[i] = jetJECUpOrder[i] = jetJECDownOrder[i] = i;
+        
+        weight = 1.;
+        return;
+    }
+    
+    
+    // Get the tree from the source file
+    //curTree.reset(dynamic_cast<TTree *>(srcFile->Get(name.c_str())));
+    curTree.reset(dynamic_cast<TTree *>(srcFile->Get(name.c_str())));
+    
+    
+    // Make sure the tree exists
+    if (not curTree)
+    {
+        ostringstream ost;
+        ost << "Cannot find tree \"" << name << "\" in file \"" << srcFile->GetTitle() << "\".";
+        throw runtime_error(ost.str());
+    }
+    
+    
+    // Set event counters
+    fileBytesMark = srcFile->GetBytesRead();
+    nEntries = curTree->GetEntries();
+    curEntry = min(rangeBegin, nEntries);
+    endEntry = max(curEntry, min(rangeEnd, nEntries));
+    loadedEntry = -1;
+    SetUpSkipping(name);
+    
+    
+    // Check if objects in the tree are already ordered in pt, as is the case for skimmed trees. If
+    //so, use the trivial order
+    TList const *userInfo = curTree->GetUserInfo();
+    objectsOrdered = (userInfo and userInfo->FindObject(ptOrderedMarker));
+    
+    if (objectsOrdered)
+        for (unsigned i = 0; i < maxSize; ++i)
+            lepOrder[i] = jetOrder[i] = jetJECUpOrder[i] = jetJECDownOrder[i] = i;
+    
+    
+    // Set buffers to read the tree and deactivate all other branches
+    ApplyBranchSelection();
+    
+    
+    // Set the event weight for data (it will not be modified)
+    weight = 1.;
+}
+
+
+bool Reader::ReadNextEntry()
+{
+    // If the learning phase has just been completed, deactivate the branches that have not been
+    //used in it
+    if (nLearningEventsLeft > 0)
+    {
+        --nLearningEventsLeft;
+        
+        if (nLearningEventsLeft == 0)
+            FinishLearning();
+    }
+    
+    
+    // If events are read in the background thread, take the next one from it
+    if (readAheadDepth > 0)
+        return ReadPrefetchedEntry();
+    
+    
+    // Loop until an event that passes the preselection is found
+    while (true)
+    {
+        // Check if there are events left in the current source tree. Trees with no entries in the
+        //requested range are skipped
+        while (curEntry == endEntry)  // no more events in the current tree
+        {
+            ++curTreeNameIt;
+            
+            if (curTreeNameIt == treeNames.end())  // no more source trees
+                return false;
+            
+            GetTree(*curTreeNameIt);
+        }
+        
+        
+        // Entries of flat event files are accessed in place, so there is no need to read them in
+        //two stages
+        if (curFlatTree)
+        {
+            Long64_t const entry = curEntry;
+            AdvanceEntry();
+            LoadFlatEntry(entry);
+            ++curTreeStats->nEntries;
+            
+            if (leptonPreselection and not leptonPreselection(LeptonRange(&leptonSource)))
+                continue;
+            
+            loadedEntry = entry;
+            return true;
+        }
+        
+        
+        // Either there were events in the current source file or a new file has been opened. The
+        //views must refer to the own buffers, which might have been changed by the read-ahead
+        if (sourcesRedirected)
+            ResetSources();
+        
+        
+        // If there is no preselection, read all branches at once
+        if (not leptonPreselection)
+        {
+            curTreeStats->totBytes += curTree->GetEntry(curEntry);
+            ++curTreeStats->nEntries;
+            loadedEntry = curEntry;
+            AdvanceEntry();
+            
+            return true;
+        }
+        
+        
+        // Otherwise read the leptons first and evaluate the preselection. Branches are read
+        //individually, so the current entry of the tree is set explicitly. This drives the
+        //TTreeCache, which would otherwise be bypassed
+        Long64_t const entry = curEntry;
+        AdvanceEntry();
+        curTree->LoadTree(entry);
+        
+        for (TBranch *branch: firstStageBranches)
+            curTreeStats->totBytes += branch->GetEntry(entry);
+        
+        ++curTreeStats->nEntries;
+        
+        if (not objectsOrdered)
+            OrderInPt(lepBuffers.pt, lepSize, lepOrder);
+        
+        if (not leptonPreselection(LeptonRange(&leptonSource)))
+            continue;
+        
+        for (TBranch *branch: secondStageBranches)
+            curTreeStats->totBytes += branch->GetEntry(entry);
+        
+        loadedEntry = entry;
+        
+        return true;
+    }
+}
+
+
+void Reader::OrderInPt(Float_t const *pt, int size, unsigned char *order)
+{
+    // Insertion sort is used since the number of objects is small and they are often ordered
+    //already in the source tree
+    for (int i = 0; i < size; ++i)
+    {
+        int j = i;
+        
+        for (; j > 0 and pt[order[j - 1]] < pt[i]; --j)
+            order[j] = order[j - 1];
+        
+        order[j] = i;
+    }
+}
+
+
+void Reader::AppendCurrentEvent(EventBatch &batch) const
+{
+    unsigned char order[maxSize];
+    
+    // Copy leptons, ordered in pt
+    LeptonColumns &l = batch.leptons;
+    OrderInPt(leptonSource.pt, lepSize, order);
+    BranchSchema::ForEachLeptonField(OrderedAppender{order, lepSize}, l, leptonSource);
+    l.offsets.push_back(l.pt.size());
+    
+    
+    // Copy jets, ordered in pt. A lambda is used since there are three jet collections
+    auto copyJets = [&order](JetColumns &j, JetSource const &src)
+    {
+        int const size = *src.size;
+        OrderInPt(src.pt, size, order);
+        BranchSchema::ForEachJetField(OrderedAppender{order, size}, j, src);
+        j.offsets.push_back(j.pt.size());
+    };
+    
+    copyJets(batch.jets, jetSource);
+    BranchSchema::ForEachEventField(ValueAppender(), batch, eventBuffers);
+    
+    if (isMC)
+    {
+        copyJets(batch.jetsJECUp, jetJECUpSource);
+        copyJets(batch.jetsJECDown, jetJECDownSource);
+    }
+    else
+    {
+        // Branches that exist in simulation only are not read for data. Fill their columns with
+        //the values that the getters return in this case
+        batch.jetsJECUp.offsets.push_back(0);
+        batch.jetsJECDown.offsets.push_back(0);
+        
+        batch.metJECUpPt.back() = eventBuffers.metPt;
+        batch.metJECUpPhi.back() = eventBuffers.metPhi;
+        batch.metJECDownPt.back() = eventBuffers.metPt;
+        batch.metJECDownPhi.back() = eventBuffers.metPhi;
+        batch.rawWeight.back() = 1.f;
+    }
+    
+    ++batch.nEvents;
+}
+
+
+void Reader::LoadFlatEntry(unsigned long entry) noexcept
+{
+    // Find the block that contains the entry. Entries are usually read sequentially, so the search
+    //starts from the current block
+    auto const &blocks = curFlatTree->blocks;
+    
+    if (curFlatBlock >= blocks.size() or blocks[curFlatBlock].firstEntry > entry)
+        curFlatBlock = 0;
+    
+    while (blocks[curFlatBlock].firstEntry + blocks[curFlatBlock].nEvents <= entry)
+        ++curFlatBlock;
+    
+    FlatEventFile::Block const &block = blocks[curFlatBlock];
+    LoadBlockEntry(block, entry - block.firstEntry);
+}
+
+
+void Reader::LoadBlockEntry(FlatEventFile::Block const &block, unsigned long i) noexcept
+{
+    // Point the descriptions of collections to the columns of the block. Objects in blocks are
+    //ordered in pt
+    FlatEventFile::LeptonBlock const &l = block.leptons;
+    unsigned const lepOffset = l.offsets[i];
+    lepSize = l.offsets[i + 1] - lepOffset;
+    BranchSchema::ForEachLeptonField(FieldPointerSetter{lepOffset}, leptonSource, l);
+    leptonSource.order = GetIdentityOrder();
+    
+    auto setJets = [i](JetSource &src, Int_t &size, FlatEventFile::JetBlock const &j)
+    {
+        unsigned const offset = j.offsets[i];
+        size = j.offsets[i + 1] - offset;
+        BranchSchema::ForEachJetField(FieldPointerSetter{offset}, src, j);
+        src.order = GetIdentityOrder();
+    };
+    
+    setJets(jetSource, jetSize, block.jets);
+    setJets(jetJECUpSource, jetJECUpSize, block.jetsJECUp);
+    setJets(jetJECDownSource, jetJECDownSize, block.jetsJECDown);
+    
+    
+    // Copy per-event quantities
+    BranchSchema::ForEachEventField(ElementCopier{i}, eventBuffers, block);
+    
+    sourcesRedirected = true;
+}
+
+
+void Reader::ResetSources() noexcept
+{
+    auto setJets = [](JetSource &src, Int_t const &size, JetBuffers const &buffers,
+     unsigned char const *order)
+    {
+        src.size = &size;
+        BranchSchema::ForEachJetField(FieldPointerSetter{0}, src, buffers);
+        src.order = order;
+    };
+    
+    leptonSource.size = &lepSize;
+    BranchSchema::ForEachLeptonField(FieldPointerSetter{0}, leptonSource, lepBuffers);
+    leptonSource.order = lepOrder;
+    leptonSource.usedGroups = &usedBranchGroups;
+    
+    setJets(jetSource, jetSize, jetBuffers, jetOrder);
+    setJets(jetJECUpSource, jetJECUpSize, jetJECUpBuffers, jetJECUpOrder);
+    setJets(jetJECDownSource, jetJECDownSize, jetJECDownBuffers, jetJECDownOrder);
+    
+    sourcesRedirected = false;
+}
+
+
+void Reader::CleanJets(JetSource &src, Int_t &size, JetBuffers &buffers, unsigned char *order,
+ BranchGroup group)
+{
+    usedBranchGroups |= bgLeptons | group;
+    
+    
+    // Collect directions of the leptons used in the cleaning
+    float lepEta[maxSize], lepPhi[maxSize];
+    unsigned nLeptons = 0;
+    
+    for (int i = 0; i < *leptonSource.size; ++i)
+        if (leptonSource.pt[i] > jetCleaningMinLeptonPt)
+        {
+            lepEta[nLeptons] = leptonSource.eta[i];
+            lepPhi[nLeptons] = leptonSource.phi[i];
+            ++nLeptons;
+        }
+    
+    
+    // Find jets that overlap with the leptons and copy the others to the front of the buffers.
+    //Since the jets are only moved towards the front, this works in place
+    unsigned char overlaps[maxSize];
+    DeltaRKernels::MarkOverlaps(lepEta, lepPhi, nLeptons, src.eta, src.phi, size, jetCleaningDR,
+     overlaps);
+    
+    unsigned nKept = 0;
+    
+    for (int i = 0; i < size; ++i)
+        if (not overlaps[i])
+        {
+            BranchSchema::ForEachJetField(ElementMover{unsigned(i), nKept}, buffers, src);
+            ++nKept;
+        }
+    
+    size = nKept;
+    BranchSchema::ForEachJetField(FieldPointerSetter{0}, src, buffers);
+    src.order = order;
+    
+    
+    // Order the remaining jets in pt. Their relative order is preserved by the copying, so
+    //collections that are ordered already stay so
+    if (objectsOrdered)
+        for (unsigned i = 0; i < nKept; ++i)
+            order[i] = i;
+    else
+        OrderInPt(buffers.pt, nKept, order);
+    
+    if (group != bgJets)
+        builtJECGroups |= group;
+}
+
+
+void Reader::CleanAllJets()
+{
+    if (jetCleaningDR <= 0.)
+        return;
+    
+    CleanJets(jetSource, jetSize, jetBuffers, jetOrder, bgJets);
+    
+    
+    // JEC-varied collections are cleaned if they are read. Flat event files and batches read in
+    //the background always provide them
+    if (isMC and (readJECVariations or sourcesRedirected))
+    {
+        CleanJets(jetJECUpSource, jetJECUpSize, jetJECUpBuffers, jetJECUpOrder, bgJetsJECUp);
+        CleanJets(jetJECDownSource, jetJECDownSize, jetJECDownBuffers, jetJECDownOrder,
+         bgJetsJECDown);
+    }
+}
+
+
+FlatEventFile::Block Reader::MakeBlock(EventBatch const &batch) noexcept
+{
+    FlatEventFile::Block block;
+    block.firstEntry = 0;
+    block.nEvents = batch.nEvents;
+    
+    block.leptons.offsets = batch.leptons.offsets.data();
+    BranchSchema::ForEachLeptonField(FieldPointerSetter{0}, block.leptons, batch.leptons);
+    
+    auto setJets = [](FlatEventFile::JetBlock &dst, JetColumns const &j)
+    {
+        dst.offsets = j.offsets.data();
+        BranchSchema::ForEachJetField(FieldPointerSetter{0}, dst, j);
+    };
+    
+    setJets(block.jets, batch.jets);
+    setJets(block.jetsJECUp, batch.jetsJECUp);
+    setJets(block.jetsJECDown, batch.jetsJECDown);
+    
+    BranchSchema::ForEachEventField(FieldPointerSetter{0}, block, batch);
+    
+    return block;
+}
+
+
+unsigned Reader::GetTreeIndex() const noexcept
+{
+    return distance(treeNames.begin(), decltype(treeNames)::const_iterator(curTreeNameIt));
+}
+
+
+void Reader::SeekTo(unsigned treeIndex, unsigned long entry)
+{
+    curTreeNameIt = treeNames.begin();
+    advance(curTreeNameIt, treeIndex);
+    GetTree(*curTreeNameIt);
+    
+    curEntry = max(curEntry, min(entry, endEntry));
+    SkipEntries();
+    
+    if (curTree)
+        curTree->SetCacheEntryRange(curEntry, endEntry);
+}
+
+
+bool Reader::GetReadPosition(bool includeCurrent, unsigned &treeIndex, unsigned long &entry) const
+{
+    // When reading in the current thread, the reader itself knows the next entry
+    if (readAheadDepth == 0)
+    {
+        treeIndex = GetTreeIndex();
+        entry = curEntry;
+        return false;
+    }
+    
+    
+    // If no event has been taken from the running background reading, it would start anew
+    if (not curBatch or curBatchRetired or curBatchPos == 0)
+    {
+        treeIndex = resumeTree;
+        entry = resumeEntry;
+        return false;
+    }
+    
+    
+    // Otherwise continue after the current event or from it
+    treeIndex = curBatch->trees[curBatchPos - 1];
+    entry = curBatch->entries[curBatchPos - 1];
+    
+    if (includeCurrent)
+        return true;
+    
+    ++entry;
+    return false;
+}
+
+
+void Reader::StartReadAhead(unsigned treeIndex, unsigned long entry)
+{
+    StopReadAhead();
+    
+    
+    // Set up the reader for the background thread with the same settings as this one. A ROOT
+    //file returns the same TTree object to all readers that request it, so the background reader
+    //opens the file anew and gets its own trees and caches. The flat file is read-only and shared
+    if (not prefetcher)
+    {
+        shared_ptr<TFile> prefetchFile;
+        
+        if (srcFile)
+        {
+            prefetchFile.reset(TFile::Open(srcFile->GetName()));
+            
+            if (not prefetchFile or prefetchFile->IsZombie())
+                throw runtime_error(string("Cannot reopen file \"") + srcFile->GetName() +
+                 "\" for reading in the background.");
+        }
+        
+        prefetcher.reset(new Reader(prefetchFile, flatFile, treeNames, isMC));
+    }
+    
+    prefetcher->rangeBegin = rangeBegin;
+    prefetcher->rangeEnd = rangeEnd;
+    prefetcher->branchesToRead = branchesToRead;
+    prefetcher->readJECVariations = readJECVariations;
+    prefetcher->leptonPreselection = leptonPreselection;
+    prefetcher->entryListSource = entryListSource;
+    prefetcher->entryListKey = entryListKey;
+    prefetcher->zoneMap = zoneMap;
+    prefetcher->zoneCuts = zoneCuts;
+    prefetcher->previewStride = previewStride;
+    prefetcher->previewSeed = previewSeed;
+    prefetcher->SeekTo(treeIndex, entry);
+    
+    resumeTree = treeIndex;
+    resumeEntry = entry;
+    
+    
+    // Allocate the batches. The one holding the current event is kept until the next event is
+    //read, and the others are given to the background thread
+    vector<unique_ptr<PrefetchedBatch>> batches;
+    
+    for (auto &b: prefetchedBatches)
+        if (b.get() == curBatch)
+            batches.emplace_back(move(b));
+    
+    while (batches.size() < readAheadDepth + (curBatch ? 1 : 0))
+        batches.emplace_back(new PrefetchedBatch);
+    
+    prefetchedBatches = move(batches);
+    filledBatches.Reset(prefetchedBatches.size());
+    freeBatches.Reset(prefetchedBatches.size());
+    
+    for (auto const &b: prefetchedBatches)
+        if (b.get() != curBatch)
+            freeBatches.Push(b.get());
+    
+    curBatchRetired = true;
+    
+    
+    // Events in the batches are ordered in pt, so there is no need to order them again
+    objectsOrdered = true;
+    
+    
+    // Start the thread
+    stopPrefetch = false;
+    prefetchThread = thread(&Reader::Prefetch, this);
+}
+
+
+void Reader::RestartReadAhead(bool includeCurrent)
+{
+    unsigned treeIndex;
+    unsigned long entry;
+    bool const rereadCurrent = GetReadPosition(includeCurrent, treeIndex, entry);
+    
+    StartReadAhead(treeIndex, entry);
+    
+    if (rereadCurrent)
+        ReadPrefetchedEntry();
+}
+
+
+void Reader::StopReadAhead() noexcept
+{
+    if (prefetchThread.joinable())
+    {
+        stopPrefetch = true;
+        prefetchThread.join();
+        
+        
+        // Collect the counters of the background reader. It reads its own copy of the file, so
+        //the bytes read by it are not included in the counter of this reader's file
+        prefetcher->UpdateIOStats();
+        stats.Merge(prefetcher->stats);
+        prefetcher->stats.Reset();
+        
+        if (srcFile)
+            fileBytesMark = srcFile->GetBytesRead();
+    }
+}
+
+
+void Reader::Prefetch()
+{
+    while (true)
+    {
+        // Get an empty batch. It can only be unavailable if the consumer has not yet returned it
+        PrefetchedBatch *batch;
+        unsigned nAttempts = 0;
+        
+        while (not freeBatches.Pop(batch))
+        {
+            if (stopPrefetch)
+                return;
+            
+            Backoff(nAttempts);
+        }
+        
+        
+        // Fill the batch. Exceptions are passed to the consumer
+        batch->events.Clear();
+        batch->trees.clear();
+        batch->entries.clear();
+        batch->treeSizes.assign(treeNames.size(), 0);
+        batch->previewScales.assign(treeNames.size(), 1.);
+        batch->last = false;
+        batch->exception = nullptr;
+        
+        try
+        {
+            while (batch->events.nEvents < readAheadBatchSize)
+            {
+                if (not prefetcher->ReadNextEntry())
+                {
+                    batch->last = true;
+                    break;
+                }
+                
+                prefetcher->AppendCurrentEvent(batch->events);
+                
+                unsigned const treeIndex = prefetcher->GetTreeIndex();
+                batch->trees.push_back(treeIndex);
+                batch->entries.push_back(prefetcher->loadedEntry);
+                batch->treeSizes[treeIndex] = prefetcher->nEntries;
+                batch->previewScales[treeIndex] = prefetcher->previewScale;
+            }
+        }
+        catch (...)
+        {
+            batch->exception = current_exception();
+            batch->last = true;
+        }
+        
+        
+        // There is always room in the queue since it can hold all batches
+        filledBatches.Push(batch);
+        
+        if (batch->last or stopPrefetch)
+            return;
+    }
+}
+
+
+bool Reader::ReadPrefetchedEntry()
+{
+    // Take the next batch if the current one has been exhausted
+    while (not curBatch or curBatchRetired or curBatchPos == curBatch->events.nEvents)
+    {
+        if (curBatch and not curBatchRetired and curBatch->last)
+        {
+            // No more events. Report an error from the background thread only once
+            if (curBatch->exception)
+            {
+                exception_ptr const e = curBatch->exception;
+                curBatch->exception = nullptr;
+                rethrow_exception(e);
+            }
+            
+            return false;
+        }
+        
+        if (curBatch)
+            freeBatches.Push(curBatch);
+        
+        PrefetchedBatch *batch;
+        
+        if (not filledBatches.Pop(batch))
+        {
+            // The background thread has not caught up. Wait for it and record the stall
+            auto const start = chrono::steady_clock::now();
+            unsigned nAttempts = 0;
+            
+            while (not filledBatches.Pop(batch))
+                Backoff(nAttempts);
+            
+            ++readAheadStats.nStalls;
+            readAheadStats.stallTime +=
+             chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        
+        ++readAheadStats.nBatches;
+        curBatch = batch;
+        curBatchPos = 0;
+        curBatchRetired = false;
+        curBatchBlock = MakeBlock(curBatch->events);
+    }
+    
+    
+    // Serve the event directly from the batch
+    curTreeStats = treeStats[curBatch->trees[curBatchPos]];
+    previewScale = curBatch->previewScales[curBatch->trees[curBatchPos]];
+    LoadBlockEntry(curBatchBlock, curBatchPos);
+    loadedEntry = curBatch->entries[curBatchPos];
+    ++curBatchPos;
+    
+    return true;
+}
+
+
+void Reader::UpdateIOStats() noexcept
+{
+    if (not curTree)
+        return;
+    
+    Long64_t const bytesRead = srcFile->GetBytesRead();
+    
+    if (readAheadDepth == 0)
+    {
+        Long64_t const zipBytes = bytesRead - fileBytesMark;
+        curTreeStats->zipBytes += zipBytes;
+        
+        TTreeCache const *cache =
+         dynamic_cast<TTreeCache const *>(srcFile->GetCacheRead(curTree.get()));
+        
+        if (cache)
+            curTreeStats->cacheHitBytes += cache->GetEfficiencyRel() * zipBytes;
+    }
+    
+    fileBytesMark = bytesRead;
+}
+
+
+void Reader::SetUpSkipping(string const &treeName)
+{
+    // Find the list of entries
+    if (entryListSource)
+        curEntryList = entryListSource->Find(entryListKey, treeName, nEntries);
+    else
+        curEntryList.reset();
+    
+    curEntryListPos = 0;
+    
+    
+    // Evaluate the cuts for all zones of the tree. Zone maps describe ROOT files only
+    curZones.clear();
+    curZoneIndex = 0;
+    auto const *zones = (zoneMap and curTree) ? zoneMap->Find(treeName, nEntries) : nullptr;
+    
+    if (zones)
+        for (auto const &zone: *zones)
+            curZones.emplace_back(zone.endEntry, ZoneMap::MayPass(zone, zoneCuts));
+    
+    
+    // Choose the clusters to read in the preview mode and find the fraction of entries in them
+    curPreviewClusters.clear();
+    curPreviewClusterIndex = 0;
+    previewScale = 1.;
+    
+    if (previewStride > 1)
+    {
+        vector<Long64_t> clusterEnds;
+        
+        if (curFlatTree)
+            for (auto const &block: curFlatTree->blocks)
+                clusterEnds.push_back(block.firstEntry + block.nEvents);
+        else
+        {
+            TTree::TClusterIterator clusterIt = curTree->GetClusterIterator(0);
+            
+            while (clusterIt() < Long64_t(nEntries))
+                clusterEnds.push_back(min<Long64_t>(clusterIt.GetNextEntry(), nEntries));
+        }
+        
+        // Unlike std::hash, FNV-1a gives the same choice with any standard library
+        uint64_t treeHash = 14695981039346656037ull;
+        
+        for (char const c: treeName)
+            treeHash = (treeHash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        
+        Long64_t clusterStart = 0, nChosenEntries = 0;
+        
+        for (unsigned long i = 0; i < clusterEnds.size(); ++i)
+        {
+            bool const chosen = IsPreviewCluster(previewStride, previewSeed, treeHash, i);
+            curPreviewClusters.emplace_back(clusterEnds[i], chosen);
+            
+            if (chosen)
+                nChosenEntries += clusterEnds[i] - clusterStart;
+            
+            clusterStart = clusterEnds[i];
+        }
+        
+        if (nChosenEntries == 0 and not curPreviewClusters.empty())
+        {
+            curPreviewClusters.front().second = true;
+            nChosenEntries = curPreviewClusters.front().first;
+        }
+        
+        if (nChosenEntries > 0)
+            previewScale = double(nEntries) / nChosenEntries;
+    }
+    
+    
+    SkipEntries();
+}
+
+
+void Reader::SkipEntries() noexcept
+{
+    // Each skipping criterion can move the current entry forward, so they are applied repeatedly
+    //until the entry is accepted by all of them
+    while (curEntry < endEntry)
+    {
+        unsigned long const startEntry = curEntry;
+        
+        
+        // Skip zones in which no event can pass the cuts and, in the preview mode, clusters that
+        //are not chosen
+        SkipZones(curZones, curZoneIndex, curEntry, endEntry);
+        SkipZones(curPreviewClusters, curPreviewClusterIndex, curEntry, endEntry);
+        
+        
+        // Skip entries not in the list. Entries in the list are sorted, and the reader only moves
+        //forward. Thus the search starts from the last listed entry
+        if (curEntryList)
+        {
+            auto const &entries = *curEntryList;
+            curEntryListPos = lower_bound(entries.begin() + curEntryListPos, entries.end(),
+             Long64_t(curEntry)) - entries.begin();
+            
+            if (curEntryListPos < entries.size())
+                curEntry = min<unsigned long>(entries[curEntryListPos], endEntry);
+            else
+                curEntry = endEntry;
+        }
+        
+        
+        if (curEntry == startEntry)
+            break;
+    }
+}
+
+
+void Reader::AdvanceEntry() noexcept
+{
+    ++curEntry;
+    SkipEntries();
+}
+
+
+void Reader::RegisterBranches()
+{
+    // A short-cut to describe a branch
+    auto add = [this](string const &name, void *address, unsigned size, BranchGroup group,
+     bool mcOnly)
+    {
+        branchBindings.push_back({name, address, size, group, mcOnly});
+    };
+    
+    
+    // Branches of collections of objects are generated from the schema, except for the size
+    //branches, which are added explicitly
+    auto fieldAdder = [&add](BranchSchema::Collection const &c)
+    {
+        return BranchSchema::VisitBuffers(
+         [&add, c](char const *suffix, void *address, unsigned size, char)
+         {
+             add(string(c.prefix) + suffix, address, size, BranchSchema::FieldGroup(c, suffix),
+              c.mcOnly);
+         });
+    };
+    
+    BranchSchema::Collection const leptons = BranchSchema::Leptons();
+    add(leptons.sizeName, &lepSize, sizeof(lepSize), leptons.group, leptons.mcOnly);
+    BranchSchema::ForEachLeptonField(fieldAdder(leptons), lepBuffers);
+    
+    auto addJets = [&](BranchSchema::Collection const &c, Int_t &size, JetBuffers &buffers)
+    {
+        add(c.sizeName, &size, sizeof(size), c.group, c.mcOnly);
+        BranchSchema::ForEachJetField(fieldAdder(c), buffers);
+    };
+    
+    addJets(BranchSchema::Jets(), jetSize, jetBuffers);
+    addJets(BranchSchema::JetsJECUp(), jetJECUpSize, jetJECUpBuffers);
+    addJets(BranchSchema::JetsJECDown(), jetJECDownSize, jetJECDownBuffers);
+    
+    
+    // Per-event quantities
+    BranchSchema::ForEachEventField(BranchSchema::VisitBuffers(
+     [&add](BranchSchema::EventField const &f, void *address, unsigned size, char)
+     {
+         add(f.name, address, size, f.group, f.mcOnly);
+     }), eventBuffers);
+}
+
+
+void Reader::ApplyBranchSelection()
+{
+    // Columns of flat event files are accessed in place and do not need to be selected
+    if (not curTree)
+        return;
+    
+    
+    // Deactivate all branches. Those that are needed will be reactivated below
+    curTree->SetBranchStatus("*", 0);
+    
+    
+    // Activate requested branches and set buffers to read them. Buffers of branches that will not
+    //be read are zeroed. Count the compressed size of the branches to be read and sort them into
+    //the two stages of reading
+    Long64_t zipBytes = 0;
+    firstStageBranches.clear();
+    secondStageBranches.clear();
+    
+    for (auto const &b: branchBindings)
+    {
+        // Branches missing in the tree, e.g. in a skimmed one, are treated as not read
+        TBranch *branch = curTree->GetBranch(b.name.c_str());
+        
+        if (branch and IsBranchRead(b))
+        {
+            curTree->SetBranchStatus(b.name.c_str(), 1);
+            curTree->SetBranchAddress(b.name.c_str(), b.address);
+            zipBytes += branch->GetZipBytes();
+            
+            if (b.group & (bgLeptons | bgLeptonIsolation))
+                firstStageBranches.push_back(branch);
+            else
+                secondStageBranches.push_back(branch);
+        }
+        else
+            memset(b.address, 0, b.size);
+    }
+    
+    
+    // Estimate the number of entries in a cluster. If the auto-flush setting is negative, it
+    //gives the compressed size of a cluster of all branches in bytes
+    Long64_t entriesPerCluster = nEntries;
+    Long64_t const autoFlush = curTree->GetAutoFlush();
+    
+    if (autoFlush > 0)
+        entriesPerCluster = autoFlush;
+    else if (autoFlush < 0 and curTree->GetZipBytes() > 0)
+        entriesPerCluster = -autoFlush * Long64_t(nEntries) / curTree->GetZipBytes() + 1;
+    
+    
+    // Size the cache to hold a single cluster of the branches to be read, with a 10% margin, and
+    //fill the cache with these branches only
+    Long64_t cacheSize = minCacheSize;
+    
+    if (nEntries > 0)
+        cacheSize = max(cacheSize,
+         Long64_t(1.1 * zipBytes * min<Long64_t>(entriesPerCluster, nEntries) / nEntries));
+    
+    curTree->SetCacheSize(cacheSize);
+    
+    for (auto const &b: branchBindings)
+        if (IsBranchRead(b) and curTree->GetBranch(b.name.c_str()))
+            curTree->AddBranchToCache(b.name.c_str(), true);
+    
+    curTree->StopCacheLearningPhase();
+    curTree->SetCacheEntryRange(curEntry, endEntry);
+}
+
+
+bool Reader::IsBranchRead(BranchBinding const &binding) const
+{
+    if (binding.mcOnly and not isMC)
+        return false;
+    
+    if (not readJECVariations and
+     (binding.group & (bgJetsJECUp | bgJetsJECDown | bgMETJECUp | bgMETJECDown)))
+        return false;
+    
+    return (branchesToRead.empty() or branchesToRead.count(binding.name) > 0);
+}
+
+
+void Reader::FinishLearning()
+{
+    // Collect names of the branches from the groups that have been used. The lepton preselection
+    //accesses the leptons directly rather than through the getters, so the lepton branches are
+    //always kept when it is set. Otherwise the preselection would reject all following events if
+    //the user code did not call GetLeptons during the learning phase. The isolation is kept as
+    //well since the preselection might be evaluated in the background thread, whose usage of
+    //the isolation is not seen here
+    unsigned usedGroups = usedBranchGroups;
+    
+    if (leptonPreselection)
+        usedGroups |= bgLeptons | bgLeptonIsolation;
+    
+    set<string> usedBranches;
+    
+    for (auto const &b: branchBindings)
+        if (usedGroups & b.group)
+            usedBranches.insert(b.name);
+    
+    
+    // If no getter has been called at all, there is nothing to restrict
+    if (usedBranches.empty())
+        return;
+    
+    
+    // Update the selection of branches for the current tree and the following ones
+    branchesToRead = usedBranches;
+    ApplyBranchSelection();
+    
+    if (readAheadDepth > 0)
+        RestartReadAhead(false);
 }
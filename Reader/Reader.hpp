@@ -1,8 +1,16 @@
 #pragma once
 
 #include <PhysicsObjects.hpp>
+#include <ObjectViews.hpp>
 #include <Systematics.hpp>
 #include <CSVReweighter.hpp>
+#include <EventBatch.hpp>
+#include <FlatEventFile.hpp>
+#include <EntryListFile.hpp>
+#include <ZoneMap.hpp>
+#include <ReaderStats.hpp>
+#include <EventArena.hpp>
+#include <SPSCQueue.hpp>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -10,7 +18,13 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <set>
 #include <memory>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <chrono>
 
 
 /**
@@ -21,9 +35,41 @@
  * help of dedicated getters. Allows to perform systematical variations, which can be requested via
  * the SetSystematics method. When the requested systematical variation is changed, it affects
  * results of all relevant getters.
+ * 
+ * The source can be either a ROOT file or a memory-mapped FlatEventFile. In the latter case
+ * properties of objects are accessed directly in the mapped file, and the methods that control
+ * reading of branches have no effect.
  */
 class Reader
 {
+public:
+    /// Maximal number of objects of each type in an event
+    static unsigned const maxSize = 64;
+    
+    /**
+     * \brief Name of an object in the user info of a tree that marks pt-ordered objects
+     * 
+     * If a tree carries an object with this name in its user info, leptons and jets in each entry
+     * are already ordered in pt, and the reader does not reorder them.
+     */
+    static char const *const ptOrderedMarker;
+    
+    /// A function to decide whether an event should be read in full, given its leptons
+    typedef std::function<bool(LeptonRange const &leptons)> LeptonPreselection;
+    
+    /// Statistics of reading events in a background thread
+    struct ReadAheadStats
+    {
+        /// Number of batches of events received from the background thread
+        unsigned long nBatches;
+        
+        /// Number of times the consumer had to wait for the next batch
+        unsigned long nStalls;
+        
+        /// Total time spent waiting, in seconds
+        double stallTime;
+    };
+    
 public:
     /**
      * \brief Constructor from a source file and names of trees to be read from it
@@ -42,6 +88,18 @@ public:
      */
     Reader(std::shared_ptr<TFile> &srcFile, std::string const &treeName, bool isMC = true);
     
+    /**
+     * \brief Constructor from a flat event file and names of trees to be read from it
+     * 
+     * An exception is thrown if the file is not valid.
+     */
+    Reader(std::shared_ptr<FlatEventFile> const &flatFile, std::list<std::string> const &treeNames,
+     bool isMC = true);
+    
+    /// Constructor from a flat event file and name of a single tree
+    Reader(std::shared_ptr<FlatEventFile> const &flatFile, std::string const &treeName,
+     bool isMC = true);
+    
     /// There is no construction without parameters
     Reader() = delete;
     
@@ -51,6 +109,9 @@ public:
     /// Assignment operator is disabled
     Reader &operator=(Reader const &) = delete;
     
+    /// Destructor. Stops the background thread if it is running
+    ~Reader();
+    
 public:
     /**
      * \brief Reads next event from the source trees
@@ -60,8 +121,28 @@ public:
      */
     bool ReadNextEvent();
     
+    /**
+     * \brief Reads a block of events in the columnar layout
+     * 
+     * Reads up to maxEvents events, starting from the current position, and stores them in the
+     * given batch, whose previous content is discarded. No Lepton or Jet objects are constructed,
+     * and results of the getters are not updated. The JEC-varied collections are filled only if
+     * EnableJECVariations has been called. The jet-lepton cleaning is not applied. Returns the
+     * number of events read, which is zero if there are no more events.
+     */
+    unsigned ReadBatch(EventBatch &batch, unsigned maxEvents);
+    
     /// Rewinds the reader to the first event in the first tree
-    void Rewind() noexcept;
+    void Rewind();
+    
+    /**
+     * \brief Restricts reading of each tree to the given range of entries
+     * 
+     * Only entries with indices in the range [firstEntry, lastEntry) are read. The range is clipped
+     * to the size of each tree. The reader is rewound to the first tree. The method is mostly
+     * useful when reading a single tree in parts.
+     */
+    void SetEntryRange(unsigned long firstEntry, unsigned long lastEntry);
     
     /**
      * \brief Sets desired systematical variation
@@ -72,28 +153,58 @@ public:
      */
     void SetSystematics(SystType systType, SystDirection systDirection);
     
+    /**
+     * \brief Requests reading of the JEC-varied jets and MET
+     * 
+     * Branches with JEC variations are not read until this method is called, which saves time in
+     * the common case when only nominal jets are used. The method is called automatically by
+     * SetSystematics when a JEC variation is requested. If an event has been read already, the
+     * JEC branches are read for it immediately. Has no effect for data.
+     */
+    void EnableJECVariations();
+    
     /**
      * \brief Returns the collection of leptons in the current event
      * 
-     * The collection is ordered in pt, in the decreasing order.
+     * The collection is ordered in pt, in the decreasing order. It consists of lightweight views
+     * that read properties of leptons directly from the buffers of the reader. The views are valid
+     * until the next event is read. Although the method is constant, it records the use of the
+     * lepton branches for the learning mode (see LearnBranchesToRead), and so does the method
+     * Isolation of the views for the isolation branch.
      */
-    std::vector<Lepton> const &GetLeptons() const noexcept;
+    LeptonRange GetLeptons() const noexcept;
     
     /**
      * \brief Returns the collection of jets in the current event
      * 
      * The collection is ordered in pt, in the decreasing order. If the JEC systematical variations
      * have been requested, the appropriate jet collection is returned insted of the nominal one.
+     * It consists of lightweight views that read properties of jets directly from the buffers of
+     * the reader. The views are valid until the next event is read. The use of the jet branches is
+     * recorded for the learning mode, which is the only state the method modifies.
+     */
+    JetRange GetJets() const noexcept;
+    
+    /**
+     * \brief Returns the collection of jets for the given systematical variation
+     * 
+     * Only the JEC variations alter the collection. The current systematics of the reader is not
+     * changed. In order to access a JEC variation, it must be read, see EnableJECVariations. As
+     * with GetJets, the use of the branches is recorded for the learning mode.
      */
-    std::vector<Jet> const &GetJets() const noexcept;
+    JetRange GetJets(SystType systType, SystDirection systDirection) const noexcept;
     
     /**
      * \brief Returns MET of the current event
      * 
      * If the JEC systematical variations have been requested, the MET is altered accordingly.
+     * The use of the MET branches is recorded for the learning mode.
      */
     MET const &GetMET() const noexcept;
     
+    /// Returns MET for the given systematical variation. See the documentation for GetJets
+    MET const &GetMET(SystType systType, SystDirection systDirection) const noexcept;
+    
     /**
      * \brief Returns weight of the current event
      * 
@@ -107,7 +218,31 @@ public:
      */
     double GetWeight() noexcept;
     
-    /// Returns the number of reconstructed primary vertices in the current event
+    /**
+     * \brief Returns weights of the current event for all systematical variations
+     * 
+     * Each weight equals the one returned by GetWeight when the corresponding variation is set,
+     * but all of them are computed in a single loop over jets and cached for the event. The
+     * current systematics of the reader is not changed. Useful to evaluate envelopes of b-tagging
+     * uncertainties, e.g.
+     *   SystWeights const &weights = reader.GetAllWeights();
+     *   double const weightUp = weights(SystType::BTagStatHF1, SystDirection::Up);
+     */
+    SystWeights const &GetAllWeights() noexcept;
+    
+    /**
+     * \brief Returns the weight of the current event as stored in the source tree
+     * 
+     * It includes the reweighting for cross section and target integrated luminosity only. Always
+     * equals 1. in case of data. The use of the weight branch is recorded for the learning mode.
+     */
+    double GetRawWeight() const noexcept;
+    
+    /**
+     * \brief Returns the number of reconstructed primary vertices in the current event
+     * 
+     * The use of the branch is recorded for the learning mode.
+     */
     unsigned GetNumPV() const noexcept;
     
     /**
@@ -119,7 +254,346 @@ public:
      */
     void SwitchBTagReweighting(bool on = true);
     
+    /**
+     * \brief Restricts reading to the given branches
+     * 
+     * Branches of the source trees that are not listed are deactivated, and the TTreeCache is
+     * sized to hold one cluster of the listed branches only. Buffers of deactivated branches are
+     * filled with zeros; e.g. if "lept_iso" is not listed, the isolation of all leptons is zero.
+     * The selection affects the current tree and all following ones. Names of branches that are
+     * not read by the class are ignored. An empty set restores reading of all branches. The method
+     * has no effect when reading a flat event file.
+     */
+    void SetBranchesToRead(std::set<std::string> const &branchNames);
+    
+    /**
+     * \brief Sets a preselection that is evaluated before the bulk of an event is read
+     * 
+     * When a preselection is set, events are read in two stages. First only the lepton branches
+     * are read, and the preselection is evaluated for the leptons. Jet, MET, and all other branches
+     * are read only if the preselection is passed; otherwise the event is skipped silently. This
+     * saves decompression of the jet branches in samples with a low selection efficiency. An empty
+     * function disables the preselection.
+     */
+    void SetLeptonPreselection(LeptonPreselection const &preselection);
+    
+    /**
+     * \brief Removes jets that overlap with leptons
+     * 
+     * Jets closer than maxDR to any lepton with pt above minLeptonPt are removed from all jet
+     * collections returned by GetJets and are not considered in the b-tagging reweighting. The
+     * cleaning is done before the jets are ordered in pt, and the same leptons are used for the
+     * nominal and JEC-varied collections. A non-positive maxDR disables the cleaning, which is the
+     * default.
+     */
+    void SetJetLeptonCleaning(double maxDR, double minLeptonPt = 0.);
+    
+    /**
+     * \brief Deduces the branches to be read from the usage of getters in the first events
+     * 
+     * During the next nEvents events the class reads all branches and records which getters are
+     * called. After that the branches that are not needed by these getters are deactivated as with
+     * the method SetBranchesToRead. The number of events must be large enough for all code paths
+     * of the user's selection to be exercised: a collection whose getter is called for the first
+     * time after the learning phase is left empty. The isolation of leptons is recorded
+     * separately and is only kept if LeptonView::Isolation or LeptonView::ToLepton has been
+     * called. The lepton branches, including the isolation, are kept if a lepton preselection is
+     * set when the learning phase ends.
+     */
+    void LearnBranchesToRead(unsigned long nEvents);
+    
+    /**
+     * \brief Reads and decompresses events in a background thread
+     * 
+     * The background thread reads events ahead of the consumer and hands them over in batches of
+     * batchSize events through a lock-free queue that holds up to queueDepth batches. In this way
+     * reading overlaps with the processing of events. Changes to the selection of branches or to
+     * the preselection, as well as requests of JEC variations, restart the background reading
+     * from the current event. The background thread reads a separate instance of the ROOT file,
+     * which is opened anew by its path. The lepton preselection is then evaluated in the
+     * background thread and must not modify any shared state. A queue depth of zero stops the
+     * background thread, and the reading continues in the current thread from the next event.
+     */
+    void EnableReadAhead(unsigned queueDepth, unsigned batchSize = 1024);
+    
+    /// Returns statistics of reading in the background thread, accumulated since its first start
+    ReadAheadStats const &GetReadAheadStats() const noexcept;
+    
+    /**
+     * \brief Returns counters of reading and processing, accumulated since the construction
+     * 
+     * If events are read in the background thread, it is stopped to collect its counters and, if
+     * there are events left, restarted from the next event.
+     */
+    ReaderStats const &GetStats();
+    
+    /**
+     * \brief Starts a named timer that measures the time spent until the end of the scope
+     * 
+     * Intended to profile parts of the user code, e.g.
+     *   auto const timer = reader.Time("jet selection");
+     * The timer only runs for the events sampled for time measurements, so it is cheap to keep in
+     * production code. Its results are included in the counters returned by GetStats.
+     */
+    ReaderStats::ScopedTimer Time(char const *name);
+    
+    /**
+     * \brief Returns the arena for temporaries of the user code that live for one event
+     * 
+     * The arena is reset at the start of each call to ReadNextEvent, e.g.
+     *   ArenaVector<double> weights(reader.GetArena());
+     * declared in the event loop does not allocate memory on the heap once the arena has grown to
+     * the size needed by the busiest event.
+     */
+    EventArena &GetArena() noexcept;
+    
+    /**
+     * \brief Restricts reading to the entries stored in the given file under the given key
+     * 
+     * For each tree that has a valid list in the file, only the listed entries are read, and the
+     * rest of the tree is skipped; trees without a list are read in full. The list must have been
+     * recorded with the same or a looser selection than the one applied by the user, otherwise
+     * events are lost. The entry range set with SetEntryRange is respected. The reader is rewound
+     * to the first tree. A null pointer restores reading of all entries.
+     */
+    void SetEntryList(std::shared_ptr<EntryListFile const> const &entryLists,
+     std::string const &key);
+    
+    /**
+     * \brief Requests recording of the entries that pass the selection
+     * 
+     * The entries for which MarkSelected is called are added to the given file under the given
+     * key. The lists are complete only if all entries of the trees are processed, possibly by
+     * several readers. A null pointer stops the recording.
+     */
+    void RecordEntryList(std::shared_ptr<EntryListFile> const &entryLists, std::string const &key);
+    
+    /**
+     * \brief Skips zones of entries in which no event can pass the given cuts
+     * 
+     * Zones of each tree are taken from the given map; trees not described by the map are read in
+     * full. The cuts must be the same as or looser than the selection applied by the user. They
+     * are checked against the nominal jets, so the thresholds must allow for the JEC variations
+     * if the latter are used. The reader is rewound to the first tree. A null pointer restores
+     * reading of all zones. The method has no effect when reading a flat event file.
+     */
+    void SetZoneMap(std::shared_ptr<ZoneMap const> const &zoneMap,
+     std::vector<ZoneMap::Cut> const &cuts);
+    
+    /**
+     * \brief Reads only a fraction of clusters of each tree for a fast preview
+     * 
+     * With a zero seed, every stride-th cluster of each tree is read, starting from the first one.
+     * Otherwise each cluster is chosen with probability 1 / stride, using a pseudorandom sequence
+     * determined by the seed, the name of the tree, and the index of the cluster. In both cases
+     * the choice does not depend on the entry range, so that readers processing different ranges
+     * of the same tree agree on it. At least one cluster of each tree is read. The weights returned
+     * by GetWeight, including those of data, are multiplied by the ratio between the numbers of
+     * entries in the tree and in the chosen clusters, which preserves the normalisation. For flat
+     * event files, blocks play the role of clusters.
+     * 
+     * A stride of 0 or 1 restores reading of all clusters. The reader is rewound to the first
+     * tree. Lists of entries recorded in the preview mode are incomplete and must not be used for
+     * full runs.
+     */
+    void SetPreview(unsigned stride, unsigned long seed = 0);
+    
+    /**
+     * \brief Marks the current event as passing the selection
+     * 
+     * Has no effect unless the recording has been requested with RecordEntryList.
+     */
+    void MarkSelected();
+    
+    /**
+     * \brief Describes the settings that change which events and jets are delivered to the user
+     * 
+     * Includes the preview mode, the key of the list of entries, the cuts used to skip zones, and
+     * the jet-lepton cleaning. The lepton preselection cannot be inspected and is not included.
+     */
+    std::string DescribeSelection() const;
+    
+private:
+    /// Describes a branch read by the class and the buffer it is read into
+    struct BranchBinding
+    {
+        /// Name of the branch
+        std::string name;
+        
+        /// Address of the buffer
+        void *address;
+        
+        /// Size of the buffer, in bytes
+        unsigned size;
+        
+        /// Group to which the branch belongs
+        BranchGroup group;
+        
+        /// Indicates that the branch exists in simulation only
+        bool mcOnly;
+    };
+    
+    /// Read buffers for properties of objects and per-event quantities
+    typedef LeptonFields<ArrayStorage<maxSize>> LeptonBuffers;
+    typedef JetFields<ArrayStorage<maxSize>> JetBuffers;
+    typedef EventFields<ValueStorage> EventBuffers;
+    
 private:
+    /// A batch of events read by the background thread
+    struct PrefetchedBatch
+    {
+        /// Properties of the events, ordered in pt
+        EventBatch events;
+        
+        /// Indices of the trees and entries in them for each event
+        std::vector<unsigned> trees;
+        std::vector<Long64_t> entries;
+        
+        /// Numbers of entries in the trees, indexed in the same way as the list of trees
+        std::vector<unsigned long> treeSizes;
+        
+        /// Scale factors for weights in the preview mode, indexed in the same way as treeSizes
+        std::vector<double> previewScales;
+        
+        /// Indicates that there are no more events after this batch
+        bool last;
+        
+        /// Exception thrown in the background thread, if any
+        std::exception_ptr exception;
+    };
+    
+private:
+    /// Constructor that does the actual work for the public ones. Exactly one source must be given
+    Reader(std::shared_ptr<TFile> const &srcFile, std::shared_ptr<FlatEventFile> const &flatFile,
+     std::list<std::string> const &treeNames, bool isMC);
+    
+    /**
+     * \brief Reads the next entry into the buffers
+     * 
+     * Switches to the next tree when needed. Returns false if there are no more entries.
+     */
+    bool ReadNextEntry();
+    
+    /**
+     * \brief Finds the order of objects in pt
+     * 
+     * Fills the array order with indices of the given objects such that their pt decreases.
+     */
+    static void OrderInPt(Float_t const *pt, int size, unsigned char *order);
+    
+    /**
+     * \brief Loads the given entry of the current tree of the flat event file
+     * 
+     * Per-event quantities are copied into the buffers, while the descriptions of collections of
+     * objects are pointed to the mapped columns.
+     */
+    void LoadFlatEntry(unsigned long entry) noexcept;
+    
+    /// Points the descriptions of collections to the given event of a block and copies the rest
+    void LoadBlockEntry(FlatEventFile::Block const &block, unsigned long i) noexcept;
+    
+    /// Points the descriptions of collections to the own read buffers
+    void ResetSources() noexcept;
+    
+    /**
+     * \brief Removes jets close to leptons from the given collection and orders the rest in pt
+     * 
+     * The remaining jets are copied to the front of the given read buffers, and the description
+     * of the collection is pointed to them. The copy is done in place if the collection is read
+     * into these buffers. The JEC-varied collections are marked as built.
+     */
+    void CleanJets(JetSource &src, Int_t &size, JetBuffers &buffers, unsigned char *order,
+     BranchGroup group);
+    
+    /// Applies the jet-lepton cleaning to all jet collections available in the current event
+    void CleanAllJets();
+    
+    /// Appends the current event to the batch, with objects ordered in pt
+    void AppendCurrentEvent(EventBatch &batch) const;
+    
+    /// Describes columns of a batch in the same way as a block of a flat event file
+    static FlatEventFile::Block MakeBlock(EventBatch const &batch) noexcept;
+    
+    /// Returns the index of the current tree in the list of trees
+    unsigned GetTreeIndex() const noexcept;
+    
+    /// Positions the reader so that the next entry read is the given one (or the first one after)
+    void SeekTo(unsigned treeIndex, unsigned long entry);
+    
+    /**
+     * \brief Finds where the background reading should start to continue the current sequence
+     * 
+     * If includeCurrent is true and there is a current event, the position refers to it rather
+     * than to the next one. Returns true if the position refers to the current event.
+     */
+    bool GetReadPosition(bool includeCurrent, unsigned &treeIndex, unsigned long &entry) const;
+    
+    /// Starts the background thread at the given position, stopping it first if needed
+    void StartReadAhead(unsigned treeIndex, unsigned long entry);
+    
+    /**
+     * \brief Restarts the background thread from the current position with the current settings
+     * 
+     * If includeCurrent is true, the current event is read again.
+     */
+    void RestartReadAhead(bool includeCurrent);
+    
+    /// Stops the background thread
+    void StopReadAhead() noexcept;
+    
+    /// Body of the background thread. Fills batches until stopped or there are no more events
+    void Prefetch();
+    
+    /// Takes the next event prepared by the background thread. Returns false if there are none
+    bool ReadPrefetchedEntry();
+    
+    /**
+     * \brief Adds the bytes read from the source file since the last call to counters of the tree
+     * 
+     * Bytes are not counted in the read-ahead mode since the file is read by the background
+     * reader then.
+     */
+    void UpdateIOStats() noexcept;
+    
+    /**
+     * \brief Finds the list of entries and the zones that tell which entries of the tree with the
+     * given name can be skipped
+     * 
+     * Called when a new tree is opened. Positions the reader at the first entry not skipped.
+     */
+    void SetUpSkipping(std::string const &treeName);
+    
+    /**
+     * \brief Moves the current entry forward to the closest one that should be read
+     * 
+     * Skips entries that are not in the list of entries and zones that fail the cuts.
+     */
+    void SkipEntries() noexcept;
+    
+    /// Moves to the next entry to be read in the current tree
+    void AdvanceEntry() noexcept;
+    
+    /// Fills the list of branches that are read by the class
+    void RegisterBranches();
+    
+    /**
+     * \brief Activates requested branches in the current tree and sets up the TTreeCache
+     * 
+     * All branches that will not be read are deactivated, and their buffers are zeroed.
+     */
+    void ApplyBranchSelection();
+    
+    /**
+     * \brief Decides if the given branch should be read
+     * 
+     * Takes into account the type of the sample and the selection of branches.
+     */
+    bool IsBranchRead(BranchBinding const &binding) const;
+    
+    /// Replaces the branch selection with the groups of branches used during the learning phase
+    void FinishLearning();
+    
+
     /**
      * \brief Gets a new tree from the source file and sets up buffers to read it
      * 
@@ -129,14 +603,25 @@ private:
     void GetTree(std::string const &name);
     
 private:
-    /// Pointer to the source file
+    /// Minimal size of the TTreeCache, in bytes
+    static Long64_t const minCacheSize = 256 * 1024;
+    
+
+    /// Pointer to the source file. It is null if a flat event file is read
     std::shared_ptr<TFile> srcFile;
     
+    /// Pointer to the flat event file. It is null if a ROOT file is read
+    std::shared_ptr<FlatEventFile> flatFile;
+    
     /// Names of trees to be read from the source file
     std::list<std::string> treeNames;
     
-    /// An object to perform CSV reweighting
-    CSVReweighter csvReweighter;
+    /**
+     * \brief An object to perform CSV reweighting
+     * 
+     * The instance is shared by all readers in the process. It is null for data.
+     */
+    std::shared_ptr<CSVReweighter const> csvReweighter;
     
     /// Iterator that points to the name of the current tree
     decltype(treeNames)::iterator curTreeNameIt;
@@ -144,12 +629,24 @@ private:
     /// Pointer to the current tree
     std::unique_ptr<TTree> curTree;
     
+    /// Current tree of the flat event file
+    FlatEventFile::Tree const *curFlatTree;
+    
+    /// Index of the block of the current flat tree that contains the current entry
+    unsigned curFlatBlock;
+    
     /// Number of events in the current tree
     unsigned long nEntries;
     
     /// Index of the current event in the current tree
     unsigned long curEntry;
     
+    /// Index of the entry following the last one to be read from the current tree
+    unsigned long endEntry;
+    
+    /// Range of entries to be read from each tree, as set by SetEntryRange
+    unsigned long rangeBegin, rangeEnd;
+    
     /// Flag that indicates if the current sample is simulation
     bool isMC;
     
@@ -167,25 +664,42 @@ private:
      */
     SystDirection curSystDirection;
     
-    /// Size of buffers to read the source tree
-    static unsigned const maxSize = 64;
-    
-    /// Leptons in the current events
-    std::vector<Lepton> leptons;
+    /// Description of the read buffers for leptons
+    LeptonSource leptonSource;
     
     /**
-     * \brief Jets in the current event
+     * \brief Description of the read buffers for jets
      * 
      * Nominal collection and variations due to JEC uncertainty.
      */
-    std::vector<Jet> jets, jetsJECUp, jetsJECDown;
+    JetSource jetSource, jetJECUpSource, jetJECDownSource;
+    
+    /// Nominal MET in the current event
+    MET met;
     
     /**
-     * \brief METs in the current event
+     * \brief Systematical variations of MET due to JEC uncertainty
      * 
-     * Nominal value and systematical variations due to JEC uncertainty.
+     * They are set only when requested by the user.
      */
-    MET met, metJECUp, metJECDown;
+    mutable MET metJECUp, metJECDown;
+    
+    /// Indicates if JEC-varied branches are read
+    bool readJECVariations;
+    
+    /// Indicates if objects in the current tree are already ordered in pt
+    bool objectsOrdered;
+    
+    /// Index of the entry of the current tree whose content is in the buffers, or -1 if none
+    Long64_t loadedEntry;
+    
+    /**
+     * \brief JEC-varied collections that have been set up in the current event
+     * 
+     * A combination of BranchGroup flags. Jets are ordered in pt and MET is constructed only when
+     * requested by the user.
+     */
+    mutable unsigned builtJECGroups;
     
     /// Total weight of the event
     double weight;
@@ -193,6 +707,12 @@ private:
     /// Indicates if the weight is up-to-date and should not be recalculated
     bool weightCached;
     
+    /// Weights of the event for all systematical variations
+    SystWeights allWeights;
+    
+    /// Indicates if allWeights are up-to-date
+    bool allWeightsCached;
+    
     /**
      * \brief Flag showing if the reweighting for b-tagging should be applied
      * 
@@ -200,29 +720,181 @@ private:
      */
     bool applyBTagReweighting;
     
+    /**
+     * \brief Parameters of the jet-lepton cleaning
+     * 
+     * See documentation for the method SetJetLeptonCleaning. The cleaning is disabled if the
+     * distance is not positive.
+     */
+    double jetCleaningDR, jetCleaningMinLeptonPt;
+    
+    /// All branches that can be read by the class
+    std::vector<BranchBinding> branchBindings;
     
-    // Buffers to read the trees
-    Int_t lepSize;
-    Float_t lepPt[maxSize], lepEta[maxSize], lepPhi[maxSize], lepIso[maxSize];
-    Int_t lepFlavour[maxSize];
+    /**
+     * \brief Names of the branches requested by the user
+     * 
+     * An empty set means that all branches from branchBindings are read.
+     */
+    std::set<std::string> branchesToRead;
+    
+    /// Preselection evaluated on leptons before other branches are read
+    LeptonPreselection leptonPreselection;
+    
+    /**
+     * \brief Branches of the current tree read in the first and the second stage
+     * 
+     * Used only when the lepton preselection is set. The first stage includes lepton branches,
+     * the second one includes all other branches that are read.
+     */
+    std::vector<TBranch *> firstStageBranches, secondStageBranches;
+    
+    /**
+     * \brief Number of events left in the learning phase
+     * 
+     * Zero if there is no learning phase in progress.
+     */
+    unsigned long nLearningEventsLeft;
+    
+    /**
+     * \brief Groups of branches whose getters have been called, a combination of BranchGroup flags
+     * 
+     * Updated by constant getters and by the views of leptons, hence mutable.
+     */
+    mutable unsigned usedBranchGroups;
+    
+    /// Indicates that the descriptions of collections point outside of the own read buffers
+    bool sourcesRedirected;
+    
+    /// Number of batches in the read-ahead queue. Zero if reading in the background is disabled
+    unsigned readAheadDepth;
+    
+    /// Number of events in a batch read in the background
+    unsigned readAheadBatchSize;
+    
+    /// Reader used by the background thread
+    std::unique_ptr<Reader> prefetcher;
+    
+    /// Background thread
+    std::thread prefetchThread;
     
-    Int_t jetSize;
-    Float_t jetPt[maxSize], jetEta[maxSize], jetPhi[maxSize], jetBTag[maxSize];
-    Int_t jetFlavour[maxSize];
+    /// Flag to request the background thread to stop
+    std::atomic<bool> stopPrefetch;
+    
+    /// Storage for batches exchanged with the background thread
+    std::vector<std::unique_ptr<PrefetchedBatch>> prefetchedBatches;
+    
+    /// Batches filled by the background thread and empty batches returned to it
+    SPSCQueue<PrefetchedBatch *> filledBatches, freeBatches;
+    
+    /// Batch that contains the current event, or null
+    PrefetchedBatch *curBatch;
+    
+    /// Index of the next event in the current batch
+    unsigned long curBatchPos;
+    
+    /**
+     * \brief Indicates that the current batch does not belong to the running background reading
+     * 
+     * This is the case after a restart. The batch is kept until the next event is read since it
+     * contains the current event.
+     */
+    bool curBatchRetired;
     
-    Int_t jetJECUpSize;
-    Float_t jetJECUpPt[maxSize], jetJECUpEta[maxSize], jetJECUpPhi[maxSize], jetJECUpBTag[maxSize];
-    Int_t jetJECUpFlavour[maxSize];
+    /// Columns of the current batch
+    FlatEventFile::Block curBatchBlock;
+    
+    /// Position at which the running background reading has started
+    unsigned resumeTree;
+    unsigned long resumeEntry;
+    
+    /// Statistics of the background reading
+    ReadAheadStats readAheadStats;
+    
+    /// File with the lists of entries to be read and the key of the lists
+    std::shared_ptr<EntryListFile const> entryListSource;
+    std::string entryListKey;
+    
+    /// Entries to be read from the current tree. Null if all entries are read
+    std::shared_ptr<EntryListFile::EntryList const> curEntryList;
+    
+    /// Position of the current entry in the list of entries
+    std::size_t curEntryListPos;
+    
+    /// Map of zones of the source trees and the cuts to skip zones
+    std::shared_ptr<ZoneMap const> zoneMap;
+    std::vector<ZoneMap::Cut> zoneCuts;
+    
+    /**
+     * \brief Zones of the current tree
+     * 
+     * For each zone, contains the index of the entry following its last entry and a flag that
+     * shows if an event in the zone can pass the cuts. Empty if zones are not skipped.
+     */
+    std::vector<std::pair<Long64_t, bool>> curZones;
+    
+    /// Index of the zone that contains the current entry
+    std::size_t curZoneIndex;
+    
+    /// Only one out of previewStride clusters is read if it is larger than 1
+    unsigned previewStride;
+    
+    /// Seed to choose the clusters at random. Zero means that every previewStride-th is taken
+    unsigned long previewSeed;
+    
+    /**
+     * \brief Clusters of the current tree in the preview mode
+     * 
+     * For each cluster, contains the index of the entry following its last entry and a flag that
+     * shows if the cluster is read. Empty if the preview mode is disabled.
+     */
+    std::vector<std::pair<Long64_t, bool>> curPreviewClusters;
+    
+    /// Index of the cluster that contains the current entry
+    std::size_t curPreviewClusterIndex;
+    
+    /// Factor to rescale weights of events of the current tree in the preview mode
+    double previewScale;
+    
+    /// File to record the selected entries in and the key for them
+    std::shared_ptr<EntryListFile> entryListRecorder;
+    std::string recordKey;
+    
+    /// Counters of reading and processing
+    ReaderStats stats;
+    
+    /// Memory for temporaries of the user code, reset for each event
+    EventArena arena;
+    
+    /// Counters for the source trees, in the same order as treeNames
+    std::vector<ReaderStats::TreeStats *> treeStats;
+    
+    /// Counters for the tree of the current event
+    ReaderStats::TreeStats *curTreeStats;
+    
+    /// Number of calls to ReadNextEvent, used to choose the events sampled for time measurements
+    unsigned long nReadCalls;
+    
+    /// Indicates if the current event is sampled for time measurements
+    bool curEventSampled;
+    
+    /// Time when the current event has been given to the user, if it is sampled
+    std::chrono::steady_clock::time_point curEventTime;
+    
+    /// Number of bytes read from the source file at the last update of the counters
+    Long64_t fileBytesMark;
+    
+    
+    // Buffers to read the trees. Their layout is defined by BranchSchema
+    Int_t lepSize;
+    LeptonBuffers lepBuffers;
     
-    Int_t jetJECDownSize;
-    Float_t jetJECDownPt[maxSize], jetJECDownEta[maxSize], jetJECDownPhi[maxSize],
-     jetJECDownBTag[maxSize];
-    Int_t jetJECDownFlavour[maxSize];
+    Int_t jetSize, jetJECUpSize, jetJECDownSize;
+    JetBuffers jetBuffers, jetJECUpBuffers, jetJECDownBuffers;
     
-    Float_t metPt, metPhi;
-    Float_t metJECUpPt, metJECUpPhi;
-    Float_t metJECDownPt, metJECDownPhi;
+    EventBuffers eventBuffers;
     
-    Int_t nPV;
-    Float_t rawWeight;
+    // Indices of objects ordered in pt
+    unsigned char lepOrder[maxSize], jetOrder[maxSize];
+    mutable unsigned char jetJECUpOrder[maxSize], jetJECDownOrder[maxSize];
 };
@@ -0,0 +1,177 @@
+#include <ReaderStats.hpp>
+
+#include <iomanip>
+#include <sstream>
+
+
+using namespace std;
+
+
+/// Adds counters of one tree to those of another
+static void AddTreeStats(ReaderStats::TreeStats &dst, ReaderStats::TreeStats const &src) noexcept
+{
+    dst.nEntries += src.nEntries;
+    dst.nEvents += src.nEvents;
+    dst.zipBytes += src.zipBytes;
+    dst.totBytes += src.totBytes;
+    dst.cacheHitBytes += src.cacheHitBytes;
+    dst.readTime += src.readTime;
+    dst.userTime += src.userTime;
+}
+
+
+/// Writes a string as a JSON literal
+static void WriteJSONString(ostream &out, string const &s)
+{
+    out << '"';
+    
+    for (char const c: s)
+    {
+        if (c == '"' or c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            ostringstream code;
+            code << "\\u" << hex << setw(4) << setfill('0') << int(c);
+            out << code.str();
+        }
+        else
+            out << c;
+    }
+    
+    out << '"';
+}
+
+
+/// Writes counters of a tree as a JSON object
+static void WriteJSONTree(ostream &out, ReaderStats::TreeStats const &s, string const &indent)
+{
+    double const busyTime = s.readTime + s.userTime;
+    
+    out << "{\n";
+    out << indent << "  \"entries\": " << s.nEntries << ",\n";
+    out << indent << "  \"events\": " << s.nEvents << ",\n";
+    out << indent << "  \"compressedBytes\": " << s.zipBytes << ",\n";
+    out << indent << "  \"uncompressedBytes\": " << s.totBytes << ",\n";
+    out << indent << "  \"cacheHitRatio\": " <<
+     (s.zipBytes > 0 ? s.cacheHitBytes / s.zipBytes : 0.) << ",\n";
+    out << indent << "  \"readTime\": " << s.readTime << ",\n";
+    out << indent << "  \"userTime\": " << s.userTime << ",\n";
+    out << indent << "  \"eventsPerSecond\": " << (busyTime > 0. ? s.nEvents / busyTime : 0.) <<
+     "\n";
+    out << indent << "}";
+}
+
+
+ReaderStats::ScopedTimer::ScopedTimer(double *target_) noexcept:
+    target(target_)
+{
+    if (target)
+        start = chrono::steady_clock::now();
+}
+
+
+ReaderStats::ScopedTimer::ScopedTimer(ScopedTimer &&src) noexcept:
+    target(src.target), start(src.start)
+{
+    src.target = nullptr;
+}
+
+
+ReaderStats::ScopedTimer::~ScopedTimer() noexcept
+{
+    if (target)
+        *target += samplingPeriod *
+         chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+
+// Static data members
+unsigned const ReaderStats::samplingPeriod;
+
+
+ReaderStats::TreeStats &ReaderStats::GetTree(string const &treeName)
+{
+    auto const res = trees.find(treeName);
+    
+    if (res != trees.end())
+        return res->second;
+    
+    return trees[treeName] = TreeStats{0, 0, 0, 0, 0., 0., 0.};
+}
+
+
+double &ReaderStats::GetTimer(string const &name)
+{
+    return timers[name];
+}
+
+
+void ReaderStats::Merge(ReaderStats const &other)
+{
+    for (auto const &t: other.trees)
+        AddTreeStats(GetTree(t.first), t.second);
+    
+    for (auto const &t: other.timers)
+        timers[t.first] += t.second;
+}
+
+
+void ReaderStats::Reset() noexcept
+{
+    for (auto &t: trees)
+        t.second = TreeStats{0, 0, 0, 0, 0., 0., 0.};
+    
+    for (auto &t: timers)
+        t.second = 0.;
+}
+
+
+ReaderStats::TreeStats ReaderStats::GetTotal() const noexcept
+{
+    TreeStats s{0, 0, 0, 0, 0., 0., 0.};
+    
+    for (auto const &t: trees)
+        AddTreeStats(s, t.second);
+    
+    return s;
+}
+
+
+void ReaderStats::WriteJSON(ostream &out, double wallTime /*= 0.*/) const
+{
+    out << "{\n";
+    out << "  \"wallTime\": " << wallTime << ",\n";
+    out << "  \"samplingPeriod\": " << samplingPeriod << ",\n";
+    out << "  \"total\": ";
+    WriteJSONTree(out, GetTotal(), "  ");
+    out << ",\n";
+    
+    
+    // Counters for individual trees
+    out << "  \"trees\": {";
+    
+    for (auto it = trees.begin(); it != trees.end(); ++it)
+    {
+        out << (it == trees.begin() ? "\n    " : ",\n    ");
+        WriteJSONString(out, it->first);
+        out << ": ";
+        WriteJSONTree(out, it->second, "    ");
+    }
+    
+    out << "\n  },\n";
+    
+    
+    // Named timers
+    out << "  \"timers\": {";
+    
+    for (auto it = timers.begin(); it != timers.end(); ++it)
+    {
+        out << (it == timers.begin() ? "\n    " : ",\n    ");
+        WriteJSONString(out, it->first);
+        out << ": " << it->second;
+    }
+    
+    out << "\n  }\n";
+    out << "}\n";
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <chrono>
+#include <ostream>
+
+
+/**
+ * \class ReaderStats
+ * \brief Counters of reading and processing events, collected separately for each tree
+ * 
+ * An object of this class is owned by each Reader and is only updated from the thread that uses
+ * the reader, so the counters need no synchronisation. Statistics of several readers are combined
+ * with the method Merge.
+ * 
+ * Counting entries and bytes costs a few additions per event. Time is measured only for one event
+ * out of samplingPeriod, and the measured durations are scaled up accordingly. This includes the
+ * named timers defined by the user (see Reader::Time).
+ */
+class ReaderStats
+{
+public:
+    /// Counters for a single tree
+    struct TreeStats
+    {
+        /// Number of entries read from the source, including those rejected by a preselection
+        unsigned long nEntries;
+        
+        /// Number of events given to the user
+        unsigned long nEvents;
+        
+        /// Numbers of compressed bytes read from the file and of uncompressed bytes unpacked
+        unsigned long long zipBytes, totBytes;
+        
+        /**
+         * \brief Compressed bytes read through the tree cache
+         * 
+         * Estimated from the efficiency of the cache. Divide by zipBytes to get the hit ratio.
+         */
+        double cacheHitBytes;
+        
+        /// Estimated time spent in reading events and in the user code between them, in seconds
+        double readTime, userTime;
+    };
+    
+    /**
+     * \class ScopedTimer
+     * \brief Adds the time spent in its scope to a named timer
+     * 
+     * Objects are created with Reader::Time. If the current event is not sampled, the timer does
+     * nothing.
+     */
+    class ScopedTimer
+    {
+    public:
+        /// Constructor from the target counter. A null pointer gives an inactive timer
+        ScopedTimer(double *target) noexcept;
+        
+        /// Move constructor
+        ScopedTimer(ScopedTimer &&src) noexcept;
+        
+        /// Copying is prohibited
+        ScopedTimer(ScopedTimer const &) = delete;
+        
+        /// Adds the elapsed time, scaled with the sampling period, to the target counter
+        ~ScopedTimer() noexcept;
+        
+    private:
+        /// Counter to which the time is added. Null if the timer is inactive
+        double *target;
+        
+        /// Time of creation
+        std::chrono::steady_clock::time_point start;
+    };
+    
+public:
+    /// Time is measured for one event out of this number. Must be a power of two
+    static unsigned const samplingPeriod = 64;
+    
+public:
+    /**
+     * \brief Returns counters for the tree with the given name
+     * 
+     * Counters are created if needed. References stay valid until the object is destroyed.
+     */
+    TreeStats &GetTree(std::string const &treeName);
+    
+    /// Returns the counter of the named timer. It is created if needed
+    double &GetTimer(std::string const &name);
+    
+    /// Adds counters from another object
+    void Merge(ReaderStats const &other);
+    
+    /// Sets all counters to zero. References to them stay valid
+    void Reset() noexcept;
+    
+    /// Returns the sum of counters over all trees
+    TreeStats GetTotal() const noexcept;
+    
+    /**
+     * \brief Writes a report in the JSON format
+     * 
+     * The report contains counters for each tree and their total, derived rates, and the named
+     * timers. The wall time of the job, if given, is included to put the counters in perspective.
+     */
+    void WriteJSON(std::ostream &out, double wallTime = 0.) const;
+    
+private:
+    /// Counters for all trees
+    std::map<std::string, TreeStats> trees;
+    
+    /// Named timers, in seconds
+    std::map<std::string, double> timers;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+
+/**
+ * \class SPSCQueue
+ * \brief A bounded lock-free queue for one producer thread and one consumer thread
+ *
+ * Implemented as a ring buffer with atomic indices of the head and the tail. Push must only be
+ * called from the producer thread and Pop from the consumer thread. Neither method blocks: they
+ * return false if the queue is full or empty respectively.
+ */
+template<typename T>
+class SPSCQueue
+{
+public:
+    /// Constructor with the maximal number of elements in the queue
+    SPSCQueue(std::size_t capacity = 1);
+
+    /// Copy constructor is disabled
+    SPSCQueue(SPSCQueue const &) = delete;
+
+    /// Assignment operator is disabled
+    SPSCQueue &operator=(SPSCQueue const &) = delete;
+
+public:
+    /**
+     * \brief Changes the capacity and removes all elements
+     *
+     * Must not be called while the queue is used by other threads.
+     */
+    void Reset(std::size_t capacity);
+
+    /// Adds an element to the queue. Returns false if the queue is full
+    bool Push(T const &value) noexcept;
+
+    /// Takes an element from the queue. Returns false if the queue is empty
+    bool Pop(T &value) noexcept;
+
+private:
+    /// Storage for the elements. It contains one spare slot to distinguish a full queue
+    std::vector<T> buffer;
+
+    /// Index of the next element to pop, modified by the consumer only
+    std::atomic<std::size_t> head;
+
+    /// Index of the slot for the next element to push, modified by the producer only
+    std::atomic<std::size_t> tail;
+};
+
+
+template<typename T>
+SPSCQueue<T>::SPSCQueue(std::size_t capacity):
+    head(0), tail(0)
+{
+    Reset(capacity);
+}
+
+
+template<typename T>
+void SPSCQueue<T>::Reset(std::size_t capacity)
+{
+    buffer.assign(capacity + 1, T());
+    head.store(0);
+    tail.store(0);
+}
+
+
+template<typename T>
+bool SPSCQueue<T>::Push(T const &value) noexcept
+{
+    std::size_t const curTail = tail.load(std::memory_order_relaxed);
+    std::size_t const nextTail = (curTail + 1) % buffer.size();
+
+    if (nextTail == head.load(std::memory_order_acquire))  // the queue is full
+        return false;
+
+    buffer[curTail] = value;
+    tail.store(nextTail, std::memory_order_release);
+    return true;
+}
+
+
+template<typename T>
+bool SPSCQueue<T>::Pop(T &value) noexcept
+{
+    std::size_t const curHead = head.load(std::memory_order_relaxed);
+
+    if (curHead == tail.load(std::memory_order_acquire))  // the queue is empty
+        return false;
+
+    value = buffer[curHead];
+    head.store((curHead + 1) % buffer.size(), std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,236 @@
+#include <SkimWriter.hpp>
+
+#include <TNamed.h>
+#include <TList.h>
+
+#include <stdexcept>
+
+
+using namespace std;
+
+
+SkimWriter::SkimWriter(string const &outFileName):
+    outFile(new TFile(outFileName.c_str(), "recreate")), curTree(nullptr), isMC(true),
+    writeJECVariations(false)
+{
+    if (outFile->IsZombie())
+        throw runtime_error(string("Cannot create the output file \"") + outFileName + "\".");
+    
+    RegisterBranches();
+}
+
+
+SkimWriter::~SkimWriter()
+{
+    if (curTree)
+        EndTree();
+}
+
+
+void SkimWriter::SetBranchesToWrite(set<string> const &branchNames)
+{
+    branchesToWrite = branchNames;
+}
+
+
+void SkimWriter::EnableJECVariations()
+{
+    writeJECVariations = true;
+}
+
+
+void SkimWriter::BeginTree(string const &name, bool isMC_ /*= true*/)
+{
+    if (curTree)
+        EndTree();
+    
+    isMC = isMC_;
+    
+    
+    // Create the tree in the output file and mark that objects in it are ordered in pt
+    outFile->cd();
+    curTree = new TTree(name.c_str(), name.c_str());
+    curTree->GetUserInfo()->Add(new TNamed(Reader::ptOrderedMarker, ""));
+    
+    
+    // Create the branches. Their types and names coincide with the ones in the source trees
+    bool jecBranchWritten = false;
+    
+    for (auto const &b: branchBindings)
+        if (IsBranchWritten(b))
+        {
+            curTree->Branch(b.name.c_str(), b.address, b.leafList.c_str());
+            jecBranchWritten |= b.jecVariation;
+        }
+    
+    
+    // Requested JEC variations must not be dropped silently by the selection of branches
+    if (isMC and writeJECVariations and not jecBranchWritten)
+        throw logic_error("SkimWriter::BeginTree: JEC variations are requested, but none of their "
+         "branches is selected for writing.");
+}
+
+
+void SkimWriter::Fill(Reader const &reader)
+{
+    if (not curTree)
+        throw logic_error("SkimWriter::Fill: BeginTree has not been called.");
+    
+    
+    // Copy the objects. Getters of the reader return them ordered in pt
+    auto const srcLeptons = reader.GetLeptons();
+    lepSize = srcLeptons.size();
+    
+    for (unsigned i = 0; i < srcLeptons.size(); ++i)
+    {
+        auto const l = srcLeptons[i];
+        leptons.pt[i] = l.Pt();
+        leptons.eta[i] = l.Eta();
+        leptons.phi[i] = l.Phi();
+        leptons.isolation[i] = l.Isolation();
+        leptons.flavour[i] = l.Flavour();
+    }
+    
+    CopyJets(reader.GetJets(SystType::Nominal, SystDirection::Up), jets);
+    
+    MET const &met = reader.GetMET(SystType::Nominal, SystDirection::Up);
+    event.metPt = met.Pt();
+    event.metPhi = met.Phi();
+    
+    event.nPV = reader.GetNumPV();
+    event.rawWeight = reader.GetRawWeight();
+    
+    
+    // JEC variations are only copied when requested since they require additional branches to be
+    //read
+    if (isMC and writeJECVariations)
+    {
+        CopyJets(reader.GetJets(SystType::JEC, SystDirection::Up), jetsJECUp);
+        CopyJets(reader.GetJets(SystType::JEC, SystDirection::Down), jetsJECDown);
+        
+        MET const &metUp = reader.GetMET(SystType::JEC, SystDirection::Up);
+        event.metJECUpPt = metUp.Pt();
+        event.metJECUpPhi = metUp.Phi();
+        
+        MET const &metDown = reader.GetMET(SystType::JEC, SystDirection::Down);
+        event.metJECDownPt = metDown.Pt();
+        event.metJECDownPhi = metDown.Phi();
+    }
+    
+    
+    curTree->Fill();
+}
+
+
+unsigned long SkimWriter::EndTree()
+{
+    if (not curTree)
+        return 0;
+    
+    unsigned long const nEvents = curTree->GetEntries();
+    
+    outFile->cd();
+    curTree->Write();
+    
+    delete curTree;
+    curTree = nullptr;
+    
+    return nEvents;
+}
+
+
+void SkimWriter::RegisterBranches()
+{
+    // A short-cut to describe a branch
+    auto add = [this](string const &name, string const &leafList, void *address, bool mcOnly,
+     bool jecVariation)
+    {
+        branchBindings.push_back({name, leafList, address, mcOnly, jecVariation});
+    };
+    
+    auto isJECVariation = [](BranchGroup group)
+    {
+        return (group & (bgJetsJECUp | bgJetsJECDown | bgMETJECUp | bgMETJECDown)) != 0;
+    };
+    
+    
+    // Branches of collections of objects are generated from the schema, except for the size
+    //branches, which are added explicitly. Arrays are sized by the latter
+    auto fieldAdder = [&](BranchSchema::Collection const &c)
+    {
+        return BranchSchema::VisitBuffers(
+         [&, c](char const *suffix, void *address, unsigned, char leafCode)
+         {
+             string const name(string(c.prefix) + suffix);
+             add(name, name + "[" + c.sizeName + "]/" + leafCode, address, c.mcOnly,
+              isJECVariation(c.group));
+         });
+    };
+    
+    auto addCollection = [&](BranchSchema::Collection const &c, Int_t &size)
+    {
+        add(c.sizeName, string(c.sizeName) + "/I", &size, c.mcOnly, isJECVariation(c.group));
+    };
+    
+    BranchSchema::Collection const lepCollection = BranchSchema::Leptons();
+    addCollection(lepCollection, lepSize);
+    BranchSchema::ForEachLeptonField(fieldAdder(lepCollection), leptons);
+    
+    auto addJets = [&](BranchSchema::Collection const &c, JetBuffers &buffers)
+    {
+        addCollection(c, buffers.size);
+        BranchSchema::ForEachJetField(fieldAdder(c), buffers);
+    };
+    
+    addJets(BranchSchema::Jets(), jets);
+    addJets(BranchSchema::JetsJECUp(), jetsJECUp);
+    addJets(BranchSchema::JetsJECDown(), jetsJECDown);
+    
+    
+    // Per-event quantities
+    BranchSchema::ForEachEventField(BranchSchema::VisitBuffers(
+     [&](BranchSchema::EventField const &f, void *address, unsigned, char leafCode)
+     {
+         add(f.name, string(f.name) + "/" + leafCode, address, f.mcOnly,
+          isJECVariation(f.group));
+     }), event);
+}
+
+
+bool SkimWriter::IsBranchWritten(BranchBinding const &binding) const
+{
+    if (binding.mcOnly and not isMC)
+        return false;
+    
+    if (binding.jecVariation and not writeJECVariations)
+        return false;
+    
+    if (branchesToWrite.empty() or branchesToWrite.count(binding.name) > 0)
+        return true;
+    
+    
+    // A size branch is written if any of the arrays that depend on it is requested
+    string const index = "[" + binding.name + "]";
+    
+    for (auto const &b: branchBindings)
+        if (b.leafList.find(index) != string::npos and branchesToWrite.count(b.name) > 0)
+            return true;
+    
+    return false;
+}
+
+
+void SkimWriter::CopyJets(JetRange const &range, JetBuffers &buffers) noexcept
+{
+    buffers.size = range.size();
+    
+    for (unsigned i = 0; i < range.size(); ++i)
+    {
+        auto const j = range[i];
+        buffers.pt[i] = j.Pt();
+        buffers.eta[i] = j.Eta();
+        buffers.phi[i] = j.Phi();
+        buffers.bTag[i] = j.BTag();
+        buffers.flavour[i] = j.Flavour();
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <Reader.hpp>
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <string>
+#include <vector>
+#include <set>
+#include <memory>
+
+
+/**
+ * \class SkimWriter
+ * \brief Writes selected events of a Reader into a compact file with the same structure
+ * 
+ * Trees in the output file have the same names, branch names, and types as the source trees, so
+ * they can be read with the class Reader without any changes in the user code. Leptons and jets
+ * are written ordered in pt, and the trees are marked accordingly so that the reader does not
+ * reorder them. Only the requested branches are written. The user is expected to call BeginTree,
+ * then Fill for each selected event, and EndTree for each source tree.
+ */
+class SkimWriter
+{
+public:
+    /**
+     * \brief Constructor from the name of the output file
+     * 
+     * The file is recreated. An exception is thrown if it cannot be opened.
+     */
+    SkimWriter(std::string const &outFileName);
+    
+    /// Copy constructor is disabled
+    SkimWriter(SkimWriter const &) = delete;
+    
+    /// Assignment operator is disabled
+    SkimWriter &operator=(SkimWriter const &) = delete;
+    
+    /// Destructor. Writes the current tree if EndTree has not been called
+    ~SkimWriter();
+    
+public:
+    /**
+     * \brief Restricts writing to the given branches
+     * 
+     * Uses the same branch names as the source trees. The size branches "nlepton", "njets" and
+     * their JEC counterparts are added automatically when needed. An empty set (default) means all
+     * nominal branches. The selection affects trees created afterwards.
+     */
+    void SetBranchesToWrite(std::set<std::string> const &branchNames);
+    
+    /**
+     * \brief Requests writing of JEC-varied jets and MET
+     * 
+     * The corresponding branches must be read by the reader, see Reader::EnableJECVariations. They
+     * are written for simulation only. If none of them is included in the selection given to
+     * SetBranchesToWrite, BeginTree throws an exception.
+     */
+    void EnableJECVariations();
+    
+    /**
+     * \brief Creates a new output tree with the given name
+     * 
+     * The flag isMC indicates if the sample is a simulation; branches that exist in simulation
+     * only are not created otherwise. The previous tree is written if EndTree has not been called.
+     */
+    void BeginTree(std::string const &name, bool isMC = true);
+    
+    /// Writes the current event of the reader into the current tree
+    void Fill(Reader const &reader);
+    
+    /// Writes the current tree into the output file and returns the number of events in it
+    unsigned long EndTree();
+    
+private:
+    /// Buffers to write a collection of jets
+    struct JetBuffers: public JetFields<ArrayStorage<Reader::maxSize>>
+    {
+        Int_t size;
+    };
+    
+    /// Description of a branch that can be written
+    struct BranchBinding
+    {
+        /// Name of the branch
+        std::string name;
+        
+        /// Leaf list as expected by TTree::Branch
+        std::string leafList;
+        
+        /// Address of the buffer
+        void *address;
+        
+        /// Indicates that the branch exists in simulation only
+        bool mcOnly;
+        
+        /// Indicates that the branch describes a JEC variation
+        bool jecVariation;
+    };
+    
+private:
+    /// Fills the table of branches
+    void RegisterBranches();
+    
+    /// Checks if the branch should be created for the current tree
+    bool IsBranchWritten(BranchBinding const &binding) const;
+    
+    /// Copies jets from the given range into the buffers
+    static void CopyJets(JetRange const &range, JetBuffers &buffers) noexcept;
+    
+private:
+    /// Output file
+    std::unique_ptr<TFile> outFile;
+    
+    /// Current output tree. It is owned by the output file
+    TTree *curTree;
+    
+    /// Flag that indicates if the current sample is simulation
+    bool isMC;
+    
+    /// Indicates if the JEC variations are written
+    bool writeJECVariations;
+    
+    /// All branches that can be written by the class
+    std::vector<BranchBinding> branchBindings;
+    
+    /**
+     * \brief Names of the branches requested by the user
+     * 
+     * An empty set means that all nominal branches are written.
+     */
+    std::set<std::string> branchesToWrite;
+    
+    
+    // Buffers to write the trees. Their layout is defined by BranchSchema
+    Int_t lepSize;
+    LeptonFields<ArrayStorage<Reader::maxSize>> leptons;
+    
+    JetBuffers jets, jetsJECUp, jetsJECDown;
+    
+    EventFields<ValueStorage> event;
+};
@@ -27,3 +27,75 @@ enum class SystDirection
     Up,
     Down
 };
+
+
+/**
+ * \class SystWeights
+ * \brief Values of a weight for all systematical variations
+ * 
+ * The values are accessed with the type and the direction of a variation. The two directions of
+ * type Nominal refer to the same nominal value.
+ */
+class SystWeights
+{
+public:
+    /// Number of stored values
+    static unsigned const size = 2 * (unsigned(SystType::BTagCharmUnc2) + 1);
+    
+public:
+    /// Returns the index of the value for the given variation
+    static unsigned GetIndex(SystType systType, SystDirection systDirection) noexcept;
+    
+    /// Accesses the value for the given variation
+    double &operator()(SystType systType, SystDirection systDirection) noexcept;
+    double operator()(SystType systType, SystDirection systDirection) const noexcept;
+    
+    /// Accesses the value with the given index
+    double &operator[](unsigned index) noexcept;
+    double operator[](unsigned index) const noexcept;
+    
+    /// Sets all values to the given one
+    void Fill(double value) noexcept;
+    
+private:
+    /// Values, indexed with GetIndex
+    double values[size];
+};
+
+
+inline unsigned SystWeights::GetIndex(SystType systType, SystDirection systDirection) noexcept
+{
+    return 2 * unsigned(systType) + unsigned(systDirection);
+}
+
+
+inline double &SystWeights::operator()(SystType systType, SystDirection systDirection) noexcept
+{
+    return values[GetIndex(systType, systDirection)];
+}
+
+
+inline double SystWeights::operator()(SystType systType, SystDirection systDirection) const
+ noexcept
+{
+    return values[GetIndex(systType, systDirection)];
+}
+
+
+inline double &SystWeights::operator[](unsigned index) noexcept
+{
+    return values[index];
+}
+
+
+inline double SystWeights::operator[](unsigned index) const noexcept
+{
+    return values[index];
+}
+
+
+inline void SystWeights::Fill(double value) noexcept
+{
+    for (double &v: values)
+        v = value;
+}
@@ -0,0 +1,315 @@
+#include <ZoneMap.hpp>
+#include <Reader.hpp>
+
+#include <TTree.h>
+
+#include <sys/stat.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+
+
+using namespace std;
+
+
+/// Updates the maxima of the k-th largest values with the values of a single event
+static void UpdateRankedMaxima(Float_t const *values, int n, Float_t *maxima)
+{
+    int const nValues = max(n, 0);
+    unsigned const nLargest = min<unsigned>(nValues, ZoneMap::nRanks);
+    
+    Float_t largest[ZoneMap::nRanks];
+    partial_sort_copy(values, values + nValues, largest, largest + nLargest, greater<Float_t>());
+    
+    for (unsigned k = 0; k < nLargest; ++k)
+        maxima[k] = max(maxima[k], largest[k]);
+}
+
+
+// Static data members
+unsigned const ZoneMap::nRanks;
+char const ZoneMap::magic[8] = {'C', 'M', 'S', 'D', 'A', 'S', 'Z', 'M'};
+uint32_t const ZoneMap::version;
+
+
+ZoneMap::ZoneMap(string const &fileName_, string const &srcFileName_):
+    fileName(fileName_), srcFileName(srcFileName_)
+{
+    ReadSourceStamp();
+    Load();
+}
+
+
+bool ZoneMap::Contains(list<string> const &treeNames) const
+{
+    for (auto const &name: treeNames)
+        if (trees.count(name) == 0)
+            return false;
+    
+    return true;
+}
+
+
+void ZoneMap::Build(TFile &srcFile, list<string> const &treeNames, unsigned long zoneSize /*= 0*/)
+{
+    // Buffers to read the branches
+    Int_t nLeptons, nJets;
+    Float_t lepPt[Reader::maxSize], jetPt[Reader::maxSize], jetBTag[Reader::maxSize];
+    
+    
+    for (auto const &treeName: treeNames)
+    {
+        unique_ptr<TTree> tree(dynamic_cast<TTree *>(srcFile.Get(treeName.c_str())));
+        
+        if (not tree)
+        {
+            ostringstream ost;
+            ost << "Cannot find tree \"" << treeName << "\" in file \"" << srcFile.GetName() <<
+             "\".";
+            throw runtime_error(ost.str());
+        }
+        
+        
+        // Read only the branches needed for the summaries
+        tree->SetBranchStatus("*", false);
+        
+        auto activate = [&tree](char const *name, void *address)
+        {
+            tree->SetBranchStatus(name, true);
+            tree->SetBranchAddress(name, address);
+        };
+        
+        activate("nlepton", &nLeptons);
+        activate("lept_pt", lepPt);
+        activate("njets", &nJets);
+        activate("jet_pt", jetPt);
+        activate("jet_btagdiscri", jetBTag);
+        
+        
+        // Find the boundaries of the zones
+        Long64_t const nEntries = tree->GetEntries();
+        vector<Long64_t> zoneEnds;
+        
+        if (zoneSize == 0)
+        {
+            TTree::TClusterIterator clusterIt = tree->GetClusterIterator(0);
+            
+            while (clusterIt() < nEntries)
+                zoneEnds.push_back(min(clusterIt.GetNextEntry(), nEntries));
+        }
+        else
+            for (Long64_t end = 0; end < nEntries; )
+            {
+                end = min<Long64_t>(end + zoneSize, nEntries);
+                zoneEnds.push_back(end);
+            }
+        
+        
+        // Loop over the zones and compute their summaries
+        TreeZones &treeZones = trees[treeName];
+        treeZones.nEntries = nEntries;
+        treeZones.zones.clear();
+        Long64_t entry = 0;
+        
+        for (Long64_t const zoneEnd: zoneEnds)
+        {
+            Zone zone;
+            zone.endEntry = zoneEnd;
+            zone.maxNLeptons = zone.maxNJets = 0;
+            
+            Float_t const lowest = numeric_limits<Float_t>::lowest();
+            
+            for (unsigned k = 0; k < nRanks; ++k)
+                zone.leptonPt[k] = zone.jetPt[k] = zone.bTag[k] = lowest;
+            
+            for (; entry < zoneEnd; ++entry)
+            {
+                tree->GetEntry(entry);
+                
+                zone.maxNLeptons = max<UInt_t>(zone.maxNLeptons, nLeptons);
+                zone.maxNJets = max<UInt_t>(zone.maxNJets, nJets);
+                
+                UpdateRankedMaxima(lepPt, nLeptons, zone.leptonPt);
+                UpdateRankedMaxima(jetPt, nJets, zone.jetPt);
+                UpdateRankedMaxima(jetBTag, nJets, zone.bTag);
+            }
+            
+            treeZones.zones.push_back(zone);
+        }
+    }
+}
+
+
+vector<ZoneMap::Zone> const *ZoneMap::Find(string const &treeName, unsigned long nEntries) const
+{
+    auto const res = trees.find(treeName);
+    
+    if (res == trees.end() or res->second.nEntries != nEntries)
+        return nullptr;
+    
+    return &res->second.zones;
+}
+
+
+bool ZoneMap::MayPass(Zone const &zone, vector<Cut> const &cuts) noexcept
+{
+    for (auto const &cut: cuts)
+    {
+        if (cut.count == 0)
+            continue;
+        
+        
+        // Choose the summaries for the type of objects
+        Float_t const *maxima;
+        unsigned maxCount;
+        
+        switch (cut.variable)
+        {
+            case Variable::LeptonPt:
+                maxima = zone.leptonPt;
+                maxCount = zone.maxNLeptons;
+                break;
+            
+            case Variable::JetPt:
+                maxima = zone.jetPt;
+                maxCount = zone.maxNJets;
+                break;
+            
+            case Variable::JetBTag:
+            default:
+                maxima = zone.bTag;
+                maxCount = zone.maxNJets;
+                break;
+        }
+        
+        
+        // The n-th largest value in an event never exceeds the k-th largest one for k < n. Thus,
+        //if the cut requires more objects than summarised, the last summary gives a loose bound
+        if (cut.count > maxCount or maxima[min(cut.count, nRanks) - 1] < cut.threshold)
+            return false;
+    }
+    
+    return true;
+}
+
+
+void ZoneMap::Save() const
+{
+    // Write into a temporary file, which then replaces the target one. In this way an interrupted
+    //write does not destroy the map saved before
+    string const tmpFileName(fileName + ".tmp");
+    ofstream out(tmpFileName, ios::binary | ios::trunc);
+    
+    if (not out)
+        throw runtime_error(string("Cannot create file \"") + tmpFileName + "\".");
+    
+    auto write = [&out](void const *src, size_t nBytes)
+    {
+        out.write(static_cast<char const *>(src), nBytes);
+    };
+    
+    uint32_t const nTrees = trees.size();
+    write(magic, sizeof(magic));
+    write(&version, sizeof(version));
+    write(&nTrees, sizeof(nTrees));
+    write(&srcSize, sizeof(srcSize));
+    write(&srcModTime, sizeof(srcModTime));
+    
+    for (auto const &t: trees)
+    {
+        uint32_t const nameLength = t.first.size();
+        uint64_t const nEntries = t.second.nEntries;
+        uint64_t const nZones = t.second.zones.size();
+        
+        write(&nameLength, sizeof(nameLength));
+        write(t.first.data(), nameLength);
+        write(&nEntries, sizeof(nEntries));
+        write(&nZones, sizeof(nZones));
+        write(t.second.zones.data(), nZones * sizeof(Zone));
+    }
+    
+    out.close();
+    
+    if (out.fail() or rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+        throw runtime_error(string("Failed to write file \"") + fileName + "\".");
+}
+
+
+void ZoneMap::ReadSourceStamp()
+{
+    struct stat fileStat;
+    
+    if (stat(srcFileName.c_str(), &fileStat) != 0)
+        throw runtime_error(string("Cannot access file \"") + srcFileName + "\".");
+    
+    srcSize = fileStat.st_size;
+    srcModTime = fileStat.st_mtime;
+}
+
+
+void ZoneMap::Load()
+{
+    // Zones are stored as they are laid out in memory
+    static_assert(sizeof(Zone) == 8 + 2 * 4 + 3 * nRanks * 4,
+     "Unexpected padding in ZoneMap::Zone.");
+    
+    ifstream in(fileName, ios::binary);
+    
+    // A missing file is not an error: the map is to be built
+    if (not in)
+        return;
+    
+    auto read = [this, &in](void *dst, size_t nBytes)
+    {
+        if (not in.read(static_cast<char *>(dst), nBytes))
+            throw runtime_error(string("File \"") + fileName + "\" is corrupted.");
+    };
+    
+    
+    // Check the header. If the map describes a different version of the source file, ignore it
+    char fileMagic[sizeof(magic)];
+    uint32_t fileVersion, nTrees;
+    uint64_t fileSrcSize, fileSrcModTime;
+    
+    read(fileMagic, sizeof(fileMagic));
+    read(&fileVersion, sizeof(fileVersion));
+    read(&nTrees, sizeof(nTrees));
+    read(&fileSrcSize, sizeof(fileSrcSize));
+    read(&fileSrcModTime, sizeof(fileSrcModTime));
+    
+    if (memcmp(fileMagic, magic, sizeof(magic)) != 0)
+        throw runtime_error(string("File \"") + fileName + "\" is not a zone map file.");
+    
+    if (fileVersion != version or fileSrcSize != srcSize or fileSrcModTime != srcModTime)
+        return;
+    
+    
+    // Read the zones
+    for (unsigned i = 0; i < nTrees; ++i)
+    {
+        uint32_t nameLength;
+        read(&nameLength, sizeof(nameLength));
+        
+        string name(nameLength, '\0');
+        read(&name[0], nameLength);
+        
+        uint64_t nEntries, nZones;
+        read(&nEntries, sizeof(nEntries));
+        read(&nZones, sizeof(nZones));
+        
+        if (nZones > nEntries)
+            throw runtime_error(string("File \"") + fileName + "\" is corrupted.");
+        
+        TreeZones &treeZones = trees[name];
+        treeZones.nEntries = nEntries;
+        treeZones.zones.resize(nZones);
+        read(treeZones.zones.data(), nZones * sizeof(Zone));
+    }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <TFile.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <cstdint>
+
+
+/**
+ * \class ZoneMap
+ * \brief Summary statistics of consecutive ranges of entries ("zones") in the trees of a file
+ * 
+ * For each zone the class stores the maximal numbers of leptons and jets in an event and the
+ * maximal values, over all events in the zone, of the pt of the k-th leading lepton and jet and of
+ * the k-th largest b-tagging discriminator, for k = 1, ..., nRanks. With these statistics a Reader
+ * can skip whole zones in which no event can pass simple threshold cuts, such as "at least four
+ * jets with pt above 30 GeV" (see Reader::SetZoneMap). Zones normally coincide with the clusters of
+ * the trees, so that skipped zones are not even decompressed. Only the nominal jets are summarised.
+ * 
+ * The map is built with a one-time indexing pass over the source file (method Build) and is saved
+ * in a separate file together with the size and the modification time of the source file. If the
+ * source file changes, the saved map is discarded automatically when it is loaded.
+ * 
+ * The layout of the file is the following (all numbers use the native byte order):
+ * 
+ *   header:  char magic[8], uint32 version, uint32 nTrees, uint64 size and modification time of
+ *            the source file
+ *   tree:    uint32 length of name, name, uint64 nEntries, uint64 nZones, Zone zones[nZones]
+ */
+class ZoneMap
+{
+public:
+    /// Number of leading objects whose properties are summarised
+    static unsigned const nRanks = 4;
+    
+    /// Summary of a zone
+    struct Zone
+    {
+        /// Index of the entry following the last one in the zone
+        Long64_t endEntry;
+        
+        /// Maximal numbers of leptons and jets in an event
+        UInt_t maxNLeptons, maxNJets;
+        
+        /// Maximal values of pt of the k-th leading lepton and jet
+        Float_t leptonPt[nRanks], jetPt[nRanks];
+        
+        /// Maximal values of the k-th largest b-tagging discriminator of jets
+        Float_t bTag[nRanks];
+    };
+    
+    /// Properties of objects that can be used in cuts
+    enum class Variable
+    {
+        LeptonPt,
+        JetPt,
+        JetBTag
+    };
+    
+    /// A cut that requires at least the given number of objects with variable >= threshold
+    struct Cut
+    {
+        /// Property of objects to cut on
+        Variable variable;
+        
+        /// Required number of objects
+        unsigned count;
+        
+        /// Threshold on the property
+        double threshold;
+    };
+    
+public:
+    /**
+     * \brief Constructor from the name of the file with the map and the name of the source file
+     * 
+     * If the file with the map exists and describes the current version of the source file, the
+     * map is loaded from it; otherwise the map starts empty. An exception is thrown if the source
+     * file does not exist or the file with the map is corrupted.
+     */
+    ZoneMap(std::string const &fileName, std::string const &srcFileName);
+    
+public:
+    /// Checks if the map contains summaries for all given trees
+    bool Contains(std::list<std::string> const &treeNames) const;
+    
+    /**
+     * \brief Builds summaries for the given trees of the source file
+     * 
+     * Reads the lepton and jet branches of all entries. If zoneSize is zero, zones coincide with
+     * the clusters of each tree; otherwise they contain zoneSize entries each. Existing summaries
+     * for the trees are replaced.
+     */
+    void Build(TFile &srcFile, std::list<std::string> const &treeNames, unsigned long zoneSize = 0);
+    
+    /**
+     * \brief Returns the zones of the given tree
+     * 
+     * Returns a null pointer if there are no summaries for the tree or it contains a different
+     * number of entries. The zones are sorted and cover all entries of the tree.
+     */
+    std::vector<Zone> const *Find(std::string const &treeName, unsigned long nEntries) const;
+    
+    /// Checks if an event in the zone can pass all the cuts
+    static bool MayPass(Zone const &zone, std::vector<Cut> const &cuts) noexcept;
+    
+    /// Writes the map into the file. An exception is thrown in case of a write error
+    void Save() const;
+    
+private:
+    /// Zones of a tree
+    struct TreeZones
+    {
+        /// Number of entries in the tree
+        unsigned long nEntries;
+        
+        /// Summaries of the zones
+        std::vector<Zone> zones;
+    };
+    
+private:
+    /// Finds the size and the modification time of the source file
+    void ReadSourceStamp();
+    
+    /// Reads the map from the file if it describes the current version of the source file
+    void Load();
+    
+private:
+    /// Magic sequence at the start of the file
+    static char const magic[8];
+    
+    /// Version of the format
+    static std::uint32_t const version = 1;
+    
+    /// Name of the file with the map
+    std::string fileName;
+    
+    /// Name of the source file
+    std::string srcFileName;
+    
+    /// Size and modification time of the source file
+    std::uint64_t srcSize, srcModTime;
+    
+    /// Zones of all trees
+    std::map<std::string, TreeZones> trees;
+};
@@ -0,0 +1,380 @@
+#include <FourVector.hpp>
+#include <PhysicsObjects.hpp>
+
+#include <TLorentzVector.h>
+
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+
+using namespace std;
+
+
+/**
+ * \brief Measures the time needed to execute the given function several times
+ * 
+ * Returns the smallest time per operation over all repetitions, in nanoseconds. The result of the
+ * function is added to the checksum so that the computation cannot be optimised away.
+ */
+double Measure(function<double()> const &f, unsigned nOperations, unsigned nRepetitions,
+ double &checksum)
+{
+    double best = 0.;
+    
+    for (unsigned i = 0; i < nRepetitions; ++i)
+    {
+        auto const start = chrono::steady_clock::now();
+        checksum += f();
+        double const time =
+         chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        
+        if (i == 0 or time < best)
+            best = time;
+    }
+    
+    return best / nOperations;
+}
+
+
+/**
+ * \brief Prints a line of the report
+ * 
+ * Times are given for the reference implementation and for the double and single precision
+ * versions of the compact one. Speed-ups are computed with respect to the reference.
+ */
+void Report(string const &name, double timeRef, double timeDouble, double timeFloat)
+{
+    cout << left << setw(28) << name << right << fixed << setprecision(2) << setw(10) <<
+     timeRef << setw(10) << timeDouble << setw(10) << timeFloat << setw(10) <<
+     timeRef / timeDouble << setw(10) << timeRef / timeFloat << "\n";
+}
+
+
+/**
+ * \brief Selects jets from a large collection, as done in the event loop
+ * 
+ * Jets with pt above 30 GeV and a b-tagging discriminator above the medium working point are
+ * counted, and their transverse momenta are summed. The loop is limited by the memory bandwidth
+ * for large collections, which is where the size of the objects matters.
+ */
+template<typename T>
+double SelectJets(vector<BasicJet<T>> const &jets)
+{
+    double sum = 0.;
+    
+    for (auto const &jet: jets)
+        if (jet.Pt() > T(30) and fabs(jet.Eta()) < T(2.4) and jet.BTag() > T(0.814))
+            sum += jet.Pt();
+    
+    return sum;
+}
+
+
+int main(int argc, char **argv)
+{
+    // Parse the command line. Supported options are:
+    //  --objects N: number of four-vectors in the sample, 1000000 by default; it is increased by
+    //    a factor of 16 for the selection of jets so that the collection does not fit in caches;
+    //  --repetitions N: number of times each measurement is repeated, 10 by default
+    unsigned nObjects = 1000000;
+    unsigned nRepetitions = 10;
+    
+    for (int i = 1; i < argc; ++i)
+    {
+        string const arg(argv[i]);
+        
+        if (arg == "--objects" and i + 1 < argc)
+            nObjects = stoul(argv[++i]);
+        else if (arg == "--repetitions" and i + 1 < argc)
+            nRepetitions = stoul(argv[++i]);
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--objects N] [--repetitions N]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    
+    if (nObjects < 2 or nRepetitions == 0)
+    {
+        cerr << "At least two objects and one repetition are needed.\n";
+        return EXIT_FAILURE;
+    }
+    
+    
+    // Generate a sample of objects with kinematics typical for jets and leptons
+    mt19937_64 generator(12345);
+    exponential_distribution<double> ptDistr(1. / 50.);
+    uniform_real_distribution<double> etaDistr(-2.4, 2.4), phiDistr(-M_PI, M_PI);
+    
+    vector<double> pt(nObjects), eta(nObjects), phi(nObjects), mass(nObjects);
+    vector<float> ptF(nObjects), etaF(nObjects), phiF(nObjects), massF(nObjects);
+    
+    for (unsigned i = 0; i < nObjects; ++i)
+    {
+        pt[i] = 20. + ptDistr(generator);
+        eta[i] = etaDistr(generator);
+        phi[i] = phiDistr(generator);
+        mass[i] = (i % 4 == 0) ? 105.7e-3 : 0.;
+        
+        ptF[i] = pt[i];
+        etaF[i] = eta[i];
+        phiF[i] = phi[i];
+        massF[i] = mass[i];
+    }
+    
+    vector<TLorentzVector> rootVectors(nObjects);
+    vector<FourVector> fourVectors(nObjects);
+    vector<FourVectorF> fourVectorsF(nObjects);
+    double checksum = 0.;
+    
+    cout << "Time per operation for " << nObjects << " objects, in ns\n";
+    cout << left << setw(28) << "Operation" << right << setw(10) << "ROOT" << setw(10) <<
+     "double" << setw(10) << "float" << setw(10) << "x double" << setw(10) << "x float" << "\n";
+    
+    
+    // Construction from pt, pseudorapidity, azimuthal angle, and mass
+    double const constructROOT = Measure([&]()
+    {
+        for (unsigned i = 0; i < nObjects; ++i)
+            rootVectors[i].SetPtEtaPhiM(pt[i], eta[i], phi[i], mass[i]);
+        
+        return rootVectors.back().E();
+    }, nObjects, nRepetitions, checksum);
+    
+    double const constructFourVector = Measure([&]()
+    {
+        for (unsigned i = 0; i < nObjects; ++i)
+            fourVectors[i] = FourVector(pt[i], eta[i], phi[i], mass[i]);
+        
+        return fourVectors.back().Pt();
+    }, nObjects, nRepetitions, checksum);
+    
+    double const constructFloat = Measure([&]()
+    {
+        for (unsigned i = 0; i < nObjects; ++i)
+            fourVectorsF[i] = FourVectorF(ptF[i], etaF[i], phiF[i], massF[i]);
+        
+        return fourVectorsF.back().Pt();
+    }, nObjects, nRepetitions, checksum);
+    
+    Report("construction", constructROOT, constructFourVector, constructFloat);
+    
+    
+    // Access to pt and pseudorapidity, as done in a selection
+    double const accessROOT = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (auto const &p4: rootVectors)
+            if (p4.Pt() > 30. and fabs(p4.Eta()) < 2.4)
+                sum += p4.Pt();
+        
+        return sum;
+    }, nObjects, nRepetitions, checksum);
+    
+    double const accessFourVector = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (auto const &p4: fourVectors)
+            if (p4.Pt() > 30. and fabs(p4.Eta()) < 2.4)
+                sum += p4.Pt();
+        
+        return sum;
+    }, nObjects, nRepetitions, checksum);
+    
+    double const accessFloat = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (auto const &p4: fourVectorsF)
+            if (p4.Pt() > 30.f and fabs(p4.Eta()) < 2.4f)
+                sum += p4.Pt();
+        
+        return sum;
+    }, nObjects, nRepetitions, checksum);
+    
+    Report("pt and eta selection", accessROOT, accessFourVector, accessFloat);
+    
+    
+    // Invariant mass of consecutive pairs
+    double const massROOT = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (unsigned i = 0; i + 1 < nObjects; ++i)
+            sum += (rootVectors[i] + rootVectors[i + 1]).M();
+        
+        return sum;
+    }, nObjects - 1, nRepetitions, checksum);
+    
+    double const massFourVector = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (unsigned i = 0; i + 1 < nObjects; ++i)
+            sum += InvariantMass(fourVectors[i], fourVectors[i + 1]);
+        
+        return sum;
+    }, nObjects - 1, nRepetitions, checksum);
+    
+    double const massFloat = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (unsigned i = 0; i + 1 < nObjects; ++i)
+            sum += InvariantMass(fourVectorsF[i], fourVectorsF[i + 1]);
+        
+        return sum;
+    }, nObjects - 1, nRepetitions, checksum);
+    
+    Report("invariant mass of a pair", massROOT, massFourVector, massFloat);
+    
+    
+    // Invariant mass of consecutive triplets, which requires the full sum of four-vectors
+    double const tripletROOT = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (unsigned i = 0; i + 2 < nObjects; ++i)
+            sum += (rootVectors[i] + rootVectors[i + 1] + rootVectors[i + 2]).M();
+        
+        return sum;
+    }, nObjects - 2, nRepetitions, checksum);
+    
+    double const tripletFourVector = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (unsigned i = 0; i + 2 < nObjects; ++i)
+            sum += (fourVectors[i] + fourVectors[i + 1] + fourVectors[i + 2]).M();
+        
+        return sum;
+    }, nObjects - 2, nRepetitions, checksum);
+    
+    double const tripletFloat = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (unsigned i = 0; i + 2 < nObjects; ++i)
+            sum += (fourVectorsF[i] + fourVectorsF[i + 1] + fourVectorsF[i + 2]).M();
+        
+        return sum;
+    }, nObjects - 2, nRepetitions, checksum);
+    
+    Report("invariant mass of a triplet", tripletROOT, tripletFourVector,
+     tripletFloat);
+    
+    
+    // Angular distance between consecutive objects
+    double const deltaRROOT = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (unsigned i = 0; i + 1 < nObjects; ++i)
+            sum += rootVectors[i].DeltaR(rootVectors[i + 1]);
+        
+        return sum;
+    }, nObjects - 1, nRepetitions, checksum);
+    
+    double const deltaRFourVector = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (unsigned i = 0; i + 1 < nObjects; ++i)
+            sum += fourVectors[i].DeltaR(fourVectors[i + 1]);
+        
+        return sum;
+    }, nObjects - 1, nRepetitions, checksum);
+    
+    double const deltaRFloat = Measure([&]()
+    {
+        double sum = 0.;
+        
+        for (unsigned i = 0; i + 1 < nObjects; ++i)
+            sum += fourVectorsF[i].DeltaR(fourVectorsF[i + 1]);
+        
+        return sum;
+    }, nObjects - 1, nRepetitions, checksum);
+    
+    Report("dR of a pair", deltaRROOT, deltaRFourVector, deltaRFloat);
+    
+    
+    // Ordering in pt. The same shuffled sample is sorted in each repetition
+    vector<TLorentzVector> rootBuffer;
+    vector<FourVector> fourVectorBuffer;
+    vector<FourVectorF> fourVectorBufferF;
+    
+    double const sortROOT = Measure([&]()
+    {
+        rootBuffer = rootVectors;
+        sort(rootBuffer.begin(), rootBuffer.end(),
+         [](TLorentzVector const &a, TLorentzVector const &b){return (a.Pt() > b.Pt());});
+        return rootBuffer.front().Pt();
+    }, nObjects, nRepetitions, checksum);
+    
+    double const sortFourVector = Measure([&]()
+    {
+        fourVectorBuffer = fourVectors;
+        sort(fourVectorBuffer.begin(), fourVectorBuffer.end(),
+         [](FourVector const &a, FourVector const &b){return (a.Pt() > b.Pt());});
+        return fourVectorBuffer.front().Pt();
+    }, nObjects, nRepetitions, checksum);
+    
+    double const sortFloat = Measure([&]()
+    {
+        fourVectorBufferF = fourVectorsF;
+        sort(fourVectorBufferF.begin(), fourVectorBufferF.end(),
+         [](FourVectorF const &a, FourVectorF const &b){return (a.Pt() > b.Pt());});
+        return fourVectorBufferF.front().Pt();
+    }, nObjects, nRepetitions, checksum);
+    
+    Report("ordering in pt", sortROOT, sortFourVector, sortFloat);
+    
+    
+    // Selection of jets from a collection much larger than caches. Only the double and single
+    //precision versions of class BasicJet are compared as they read exactly the same properties
+    unsigned const nJets = 16 * nObjects;
+    uniform_real_distribution<double> bTagDistr(0., 1.);
+    vector<Jet> jets;
+    vector<JetF> jetsF;
+    jets.reserve(nJets);
+    jetsF.reserve(nJets);
+    
+    for (unsigned i = 0; i < nJets; ++i)
+    {
+        unsigned const j = i % nObjects;
+        jets.emplace_back(pt[j], eta[j], phi[j], bTagDistr(generator));
+        jetsF.emplace_back(jets.back());
+    }
+    
+    double const selectDouble = Measure([&](){return SelectJets(jets);}, nJets, nRepetitions,
+     checksum);
+    double const selectFloat = Measure([&](){return SelectJets(jetsF);}, nJets, nRepetitions,
+     checksum);
+    
+    cout << "\nSelection of " << nJets << " jets, in ns per jet and GB/s:\n";
+    cout << left << setw(28) << "Jet" << right << fixed << setprecision(2) << setw(10) <<
+     selectDouble << setw(10) << sizeof(Jet) / selectDouble << "\n";
+    cout << left << setw(28) << "JetF" << right << setw(10) << selectFloat << setw(10) <<
+     sizeof(JetF) / selectFloat << "\n";
+    
+    
+    // Memory footprint
+    cout << "\nSize of an object in bytes:\n";
+    cout << "  TLorentzVector " << sizeof(TLorentzVector) << ", FourVector " <<
+     sizeof(FourVector) << ", FourVectorF " << sizeof(FourVectorF) << "\n";
+    cout << "  Lepton " << sizeof(Lepton) << ", LeptonF " << sizeof(LeptonF) << "; Jet " <<
+     sizeof(Jet) << ", JetF " << sizeof(JetF) << "\n";
+    cout << "Checksum: " << checksum << "\n";
+    
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,91 @@
+/**
+ * Converts trees from a ROOT file into a flat event file, which can be mapped into memory and read
+ * without decompression. The source can be either the original file or a skim produced with the
+ * program skimEvents. The flat file can be given to the class Reader or to produceExampleHist
+ * instead of the ROOT file.
+ */
+
+#include <Reader.hpp>
+#include <Group.hpp>
+#include <EventBatch.hpp>
+#include <FlatEventWriter.hpp>
+
+#include <TFile.h>
+
+#include <list>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <cstdlib>
+
+using namespace std;
+
+
+int main(int argc, char **argv)
+{
+    // Parse the command line
+    string srcFileName("/afs/cern.ch/work/j/jandrea/public/proof_merged.root");
+    string outFileName("events.flat");
+    unsigned blockSize = 65536;
+    
+    for (int i = 1; i < argc; ++i)
+    {
+        string const arg(argv[i]);
+        
+        if (arg == "--input" and i + 1 < argc)
+            srcFileName = argv[++i];
+        else if (arg == "--output" and i + 1 < argc)
+            outFileName = argv[++i];
+        else if (arg == "--block-size" and i + 1 < argc)
+            blockSize = stoul(argv[++i]);
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--input FILE] [--output FILE] [--block-size N]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    
+    
+    // The trees to be converted, same as in produceExampleHist
+    list<Group> groups;
+    groups.emplace_back(Group("Data", {"SingleMuRun2012A", "SingleMuRun2012B", "SingleMuRun2012C", "SingleMuRun2012D"}, false));
+    groups.emplace_back(Group("ttbar", {"TTJets"}));
+    groups.emplace_back(Group("SingleTop", {"T_t-channel", "Tbar_t-channel", "T_tW-channel", "Tbar_tW-channel"}));
+    groups.emplace_back(Group("Wjets", {"W1JetToLNu", "W2JetsToLNu", "W3JetsToLNu", "W4JetsToLNu"}));
+    groups.emplace_back(Group("VV", {"WWJetsIncl", "WZJetsIncl", "ZZJetsIncl"}));
+    groups.emplace_back(Group("DrellYan", {"DYJetsToLL_M-10To50", "DYJetsToLL_M-50"}));
+    groups.emplace_back(Group("QCD", {"QCD_Pt-20to30_MuEnrichedPt5", "QCD_Pt-30to50_MuEnrichedPt5", "QCD_Pt-50to80_MuEnrichedPt5", "QCD_Pt-80to120_MuEnrichedPt5", "QCD_Pt-120to170_MuEnrichedPt5", "QCD_Pt-170to300_MuEnrichedPt5", "QCD_Pt-300to470_MuEnrichedPt5"}));
+    
+    
+    // Copy all trees block by block. All branches are read, including the JEC variations
+    shared_ptr<TFile> srcFile(TFile::Open(srcFileName.c_str()));
+    FlatEventWriter writer(outFileName);
+    EventBatch batch;
+    
+    for (auto const &group: groups)
+        for (auto const &treeName: group.treeNames)
+        {
+            Reader reader(srcFile, treeName, group.isMC);
+            reader.EnableJECVariations();
+            
+            writer.BeginTree(treeName);
+            unsigned long nEvents = 0;
+            
+            while (reader.ReadBatch(batch, blockSize) > 0)
+            {
+                writer.WriteBlock(batch);
+                nEvents += batch.nEvents;
+            }
+            
+            writer.EndTree();
+            cout << "Tree \"" << treeName << "\": " << nEvents << " events converted.\n";
+        }
+    
+    writer.Close();
+    
+    
+    cout << "Done. Events are saved in the file \"" << outFileName << "\".\n";
+    
+    
+    return EXIT_SUCCESS;
+}
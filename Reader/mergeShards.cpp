@@ -0,0 +1,166 @@
+#include <HistMergeTree.hpp>
+
+#include <TFile.h>
+#include <TDirectory.h>
+#include <TKey.h>
+#include <TCollection.h>
+#include <TThread.h>
+#include <TH1.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+
+using namespace std;
+
+
+/**
+ * \brief Merges the results of shards stored in the given directories of input files
+ * 
+ * A directory that contains a subdirectory "group0" holds the results of an EventLoop. The merge
+ * trees of each group are read from all input files and reduced to the final histograms, which are
+ * written into the output directory in the same way as EventLoop::Write does for a single job.
+ * Other subdirectories are recreated in the output and processed recursively.
+ */
+void MergeDirectory(vector<TDirectory *> const &inDirectories, TDirectory &outDirectory,
+ unsigned nThreads)
+{
+    TDirectory &firstDirectory = *inDirectories.front();
+    
+    
+    // Merge the groups of an EventLoop
+    if (firstDirectory.GetKey("group0"))
+    {
+        for (unsigned iGroup = 0; ; ++iGroup)
+        {
+            string const groupName("group" + to_string(iGroup));
+            
+            if (not firstDirectory.GetKey(groupName.c_str()))
+                break;
+            
+            HistMergeTree tree;
+            
+            for (TDirectory *inDirectory: inDirectories)
+            {
+                TDirectory *groupDirectory = inDirectory->GetDirectory(groupName.c_str());
+                
+                if (not groupDirectory)
+                    throw runtime_error(string("Directory \"") + inDirectory->GetPath() +
+                     "\" does not contain \"" + groupName + "\".");
+                
+                tree.Read(*groupDirectory);
+            }
+            
+            tree.Reduce(nThreads);
+            
+            for (auto const &hist: tree.TakeResult())
+                outDirectory.WriteTObject(hist.get(), hist->GetName());
+        }
+        
+        return;
+    }
+    
+    
+    // Mirror other subdirectories
+    TIter nextKey(firstDirectory.GetListOfKeys());
+    
+    while (TKey const *key = dynamic_cast<TKey const *>(nextKey()))
+    {
+        if (string(key->GetClassName()) != "TDirectoryFile")
+            continue;
+        
+        vector<TDirectory *> subDirectories;
+        
+        for (TDirectory *inDirectory: inDirectories)
+        {
+            TDirectory *subDirectory = inDirectory->GetDirectory(key->GetName());
+            
+            if (not subDirectory)
+                throw runtime_error(string("Directory \"") + inDirectory->GetPath() +
+                 "\" does not contain \"" + key->GetName() + "\".");
+            
+            subDirectories.push_back(subDirectory);
+        }
+        
+        TDirectory *outSubDirectory = outDirectory.mkdir(key->GetName(), key->GetTitle());
+        MergeDirectory(subDirectories, *outSubDirectory, nThreads);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    // Parse the command line. Supported options are:
+    //  --output FILE: name of the output file;
+    //  --threads N: number of threads used to add histograms, zero means all available cores.
+    //Remaining arguments are the names of files written by all shards of a job
+    string outFileName;
+    unsigned nThreads = 1;
+    list<string> inFileNames;
+    
+    for (int i = 1; i < argc; ++i)
+    {
+        string const arg(argv[i]);
+        
+        if (arg == "--output" and i + 1 < argc)
+            outFileName = argv[++i];
+        else if (arg == "--threads" and i + 1 < argc)
+            nThreads = stoul(argv[++i]);
+        else if (arg.substr(0, 2) != "--")
+            inFileNames.push_back(arg);
+        else
+        {
+            outFileName.clear();
+            break;
+        }
+    }
+    
+    if (outFileName.empty() or inFileNames.empty())
+    {
+        cerr << "Usage: " << argv[0] << " --output FILE [--threads N] INPUT...\n";
+        return EXIT_FAILURE;
+    }
+    
+    if (nThreads == 0)
+        nThreads = thread::hardware_concurrency();
+    
+    
+    // Histograms are owned by the merge trees rather than by the files
+    TThread::Initialize();
+    TH1::AddDirectory(kFALSE);
+    
+    
+    // Open the files written by the shards
+    list<unique_ptr<TFile>> inFiles;
+    vector<TDirectory *> inDirectories;
+    
+    for (auto const &name: inFileNames)
+    {
+        inFiles.emplace_back(TFile::Open(name.c_str()));
+        
+        if (not inFiles.back() or inFiles.back()->IsZombie())
+        {
+            cerr << "Cannot open file \"" << name << "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        inDirectories.push_back(inFiles.back().get());
+    }
+    
+    
+    // Merge the results
+    TFile outFile(outFileName.c_str(), "recreate");
+    MergeDirectory(inDirectories, outFile, nThreads);
+    
+    
+    cout << "Done. Results of " << inFiles.size() << " shards are merged into the file \"" <<
+     outFile.GetName() << "\".\n";
+    
+    
+    return EXIT_SUCCESS;
+}
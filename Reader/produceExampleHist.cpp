@@ -1,5 +1,11 @@
 #include <Reader.hpp>
+#include <Group.hpp>
+#include <EventLoop.hpp>
+#include <EntryListFile.hpp>
+#include <ZoneMap.hpp>
 #include <CalculatePzNu.hpp>
+#include <MassKernels.hpp>
+#include <InlineVector.hpp>
 #include <TFile.h>
 #include <TH1D.h>
 #include <TLatex.h>
@@ -7,61 +13,238 @@
 #include <list>
 #include <iostream>
 #include <memory>
+#include <fstream>
+#include <cstdio>
 
 #include <TLorentzVector.h>
 
 using namespace std;
 
 
+/// Indices of histograms in the set booked for each group
+enum HistIndex
+{
+    iHistMtW,
+    iHistInv3Jet,
+    iLeptonMass,
+    iNuMass,
+    iWmass1,
+    iWmass2,
+    iTopMass1,
+    iTopMass2
+};
+
+
+/// Books histograms for the group with the given name, in the order given by HistIndex
+EventLoop::HistSet BookHists(string const &groupName)
+{
+    EventLoop::HistSet hists;
+    
+    // Histograms are named after the group
+    hists.emplace_back(new TH1D((groupName+"_histMtW").c_str(), "Transverse W mass;M_{T}(W), GeV;Events", 100., 0., 200.));
+    hists.emplace_back(new TH1D((groupName+"_histInv3Jet").c_str(), "Invariant mass of 3 leading jet; M(jjj), GeV; Events", 300., 0., 600.));
+    hists.emplace_back(new TH1D((groupName+"_hLeptonMass").c_str(), "Lepton Mass; M(l), GeV; Events", 300.0, 0.0, 600.0));
+    hists.emplace_back(new TH1D((groupName+"_hNuMass").c_str(), "Neutrino Mass; M(#nu), GeV; Events", 300.0, 0.0, 600.0));
+    hists.emplace_back(new TH1D((groupName+"_hWmass1").c_str(), "W mass from Hadronic Decay; M(W), GeV; Events", 300.0, 0., 600.0));
+    hists.emplace_back(new TH1D((groupName+"_hWmass2").c_str(), "W mass from Leptonic Decay; M(W), GeV; Events", 300.0, 0.0, 600.0));
+    hists.emplace_back(new TH1D((groupName+"_hTopMass1").c_str(), "Top mass Hadronic; M(top), GeV; Events", 300., 0., 600.));
+    hists.emplace_back(new TH1D((groupName+"_hTopMass2").c_str(), "Top mass Leptonic; M(top), GeV; Events", 300., 0., 600.));
+    
+    return hists;
+}
+
+
 /**
- * \struct Group
- * \brief An auxiliary structure to group several trees together
+ * \brief Applies the event selection and fills the histograms
  * 
- * Each tree in the source file corresponds to a different physics process. It is useful to consider
- * several processes together. This structure defines what trees should be considered with a group,
- * and gives the group a name.
+ * Called for each event. It must not keep any state between events since events are processed in
+ * parallel by several threads.
  */
-struct Group
+void ProcessEvent(Reader &reader, EventLoop::HistSet &hists)
 {
-    /// Constructor without paramters
-    Group() = default;
+    // Perform some event selection
+    // Event should contain exactly one charged lepton (muon in this case)
+    if (reader.GetLeptons().size() != 1)
+        return;
     
-    /// Constructor with explicit initialisation
-    Group(string const &name, initializer_list<string> const &treeNames, bool isMC = true);
     
-    /// Move constructor
-    Group(Group &&) = default;
+    // The muon should have sufficient transverse momentum and should not be too forward
+    LeptonView const l = reader.GetLeptons().front();
     
-    /// A name to refer to the group
-    string name;
+    if (l.Pt() < 26. or fabs(l.Eta()) > 2.1)
+        return;
     
-    /// Names of trees that contribute to this group
-    list<string> treeNames;
     
-    /// Flag to indicate MC simulation as opposed to data
-    bool isMC;
-};
-
-
-Group::Group(string const &name_, initializer_list<string> const &treeNames_,
- bool isMC_ /*= true*/):
-    name(name_), treeNames(treeNames_), isMC(isMC_)
-{}
+    // Require that there are at least four central jets with pt > 30 GeV
+    auto const &jets = reader.GetJets();
+    unsigned nGoodJets = 0;
+    float mass;
+    int nSelJet = 0;
+    
+    InlineVector<JetView, Reader::maxSize> bTaggedJets, untaggedJets;
+    JetKinematics untaggedKinematics;
+    
+    for (auto const &j: jets)
+    {
+        if (j.Pt() < 30.)  // jets are ordered in pt
+            break;
+        ++nSelJet;
+        
+        //if (fabs(j.Eta()) < 2.4)
+        if (fabs(j.Eta()) > 2.4) continue;
+        ++nGoodJets;
+        
+        if (j.BTag() > 0.679)
+          bTaggedJets.push_back(j);
+        else
+        {
+          untaggedJets.push_back(j);
+          untaggedKinematics.Add(j.Momentum());
+        }
+    }
+    
+    if (bTaggedJets.size() != 2) return;
+    
+    
+    // All histograms are filled for events that have passed the cuts above only. Record the
+    //event, so that the following runs can skip the others
+    reader.MarkSelected();
+    
+    
+    if (nSelJet > 3) {
+      mass = (jets.at(0).Momentum() + jets.at(1).Momentum() + jets.at(2).Momentum()).M();
+      hists[iHistInv3Jet]->Fill(mass, reader.GetWeight());
+    }
+    
+    if (nGoodJets < 4)
+        return;
+    
+    // Calculate the variable of interest
+    MET const &met = reader.GetMET();
+    double const MtW = sqrt(pow(l.Pt() + met.Pt(), 2) -
+     pow(l.Px() + met.P4().Px(), 2) - pow(l.Py() + met.P4().Py(), 2));
+    if (MtW < 50.) return; // MtW cut from group 1
+    
+    // Fill the histogram. Note that simulated events are weighted
+    hists[iHistMtW]->Fill(MtW, reader.GetWeight());
+    
+    // Measure the time spent in the reconstruction of top quarks. It is included in the report
+    auto const timer = reader.Time("top reconstruction");
+    
+    //choose 2 jets from W candidate: the pair of untagged jets with the mass closest to W mass.
+    //Only the search uses single precision, the masses are recomputed in double precision
+    double Mass_W = 80.4;
+    MassKernels::PairMatch const WHadronicCandidate =
+     MassKernels::FindBestPair(untaggedKinematics, Mass_W);
+    
+    if (not WHadronicCandidate.found) return;
+    
+    FourVector const WHadronic = untaggedJets.at(WHadronicCandidate.i).Momentum() +
+     untaggedJets.at(WHadronicCandidate.j).Momentum();
+    double const massW = WHadronic.M();
+    
+    //W from lepton channel
+    TLorentzVector WLepton;
+    WLepton = Nu4Momentum(l.P4(), met.Pt(), met.Phi()) + l.P4(); //Nu 4mom + lepton 4mon
+    
+    double massTop1, massTop2;
+    double mtWHad1, mtWHad2;
+    double mtWLep1, mtWLep2;
+    
+    mtWHad1 = (bTaggedJets.at(0).Momentum() + WHadronic).M();
+    mtWHad2 = (bTaggedJets.at(1).Momentum() + WHadronic).M();
+    
+    mtWLep1 = (bTaggedJets.at(0).P4() + WLepton).M();
+    mtWLep2 = (bTaggedJets.at(1).P4() + WLepton).M();
+    
+    if (fabs(mtWHad1 - mtWLep2) < fabs(mtWHad2 - mtWLep1)) {
+      massTop1 = mtWHad1;
+      massTop2 = mtWLep2;
+    }
+    else {
+      massTop1 = mtWHad2;
+      massTop2 = mtWLep1;
+    }
+    
+    hists[iLeptonMass]->Fill( l.M(), reader.GetWeight() );
+    hists[iNuMass]->Fill( Nu4Momentum(l.P4(), met.Pt(), met.Phi() ).M(), reader.GetWeight() );
+    hists[iWmass1]->Fill( massW, reader.GetWeight() );
+    hists[iWmass2]->Fill( WLepton.M(), reader.GetWeight() );
+    hists[iTopMass1]->Fill ( massTop1, reader.GetWeight() );
+    hists[iTopMass2]->Fill( massTop2, reader.GetWeight() );
+}
 
 
-int main()
+int main(int argc, char **argv)
 {
+    // The source ROOT file. Each thread opens its own copy
+    //string srcFileName("/data/shared/Long_Exercise_TTbar/mujets_v3.root");
+    string srcFileName("/afs/cern.ch/work/j/jandrea/public/proof_merged.root");
+    //^ There are copies at CMS DAS machines and AFS
+    
+    
+    // Parse the command line. Supported options are:
+    //  --threads N: number of threads, zero means all available cores;
+    //  --input FILE: source file, which can be a ROOT file or a flat event file;
+    //  --read-ahead N: number of batches of events read in the background, zero disables it;
+    //  --entry-lists FILE: file with lists of selected entries;
+    //  --zone-map FILE: file with the zone map of the source ROOT file, built if needed;
+    //  --shard I/N: process only the I-th out of N shards (counted from 0). Partial results of
+    //   all shards are combined with the program mergeShards;
+    //  --checkpoint FILE: file to save the progress periodically and to resume from after a crash;
+    //  --preview K: read only every K-th cluster of each tree, with weights rescaled accordingly;
+    //  --preview-seed S: choose the clusters for the preview at random with the given seed;
+    //  --jet-cleaning DR: remove jets closer than DR to a lepton with pt > 26 GeV.
+    unsigned nThreads = 1;
+    unsigned readAheadDepth = 0;
+    string entryListFileName;
+    string zoneMapFileName;
+    string checkpointFileName;
+    unsigned previewStride = 1;
+    unsigned long previewSeed = 0;
+    double jetCleaningDR = 0.;
+    unsigned shardIndex = 0, nShards = 1;
+    
+    for (int i = 1; i < argc; ++i)
+    {
+        string const arg(argv[i]);
+        
+        if (arg == "--threads" and i + 1 < argc)
+            nThreads = stoul(argv[++i]);
+        else if (arg == "--input" and i + 1 < argc)
+            srcFileName = argv[++i];
+        else if (arg == "--read-ahead" and i + 1 < argc)
+            readAheadDepth = stoul(argv[++i]);
+        else if (arg == "--entry-lists" and i + 1 < argc)
+            entryListFileName = argv[++i];
+        else if (arg == "--zone-map" and i + 1 < argc)
+            zoneMapFileName = argv[++i];
+        else if (arg == "--shard" and i + 1 < argc and
+         sscanf(argv[i + 1], "%u/%u", &shardIndex, &nShards) == 2)
+            ++i;
+        else if (arg == "--checkpoint" and i + 1 < argc)
+            checkpointFileName = argv[++i];
+        else if (arg == "--preview" and i + 1 < argc)
+            previewStride = stoul(argv[++i]);
+        else if (arg == "--preview-seed" and i + 1 < argc)
+            previewSeed = stoul(argv[++i]);
+        else if (arg == "--jet-cleaning" and i + 1 < argc)
+            jetCleaningDR = stod(argv[++i]);
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--threads N] [--input FILE] [--read-ahead N]" <<
+             " [--entry-lists FILE] [--zone-map FILE] [--shard I/N] [--checkpoint FILE]" <<
+             " [--preview K [--preview-seed S]] [--jet-cleaning DR]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    
+    
     // ROOT manages memory in a very funny way. By default, it will assign every histogram to the
     //file accessed lastly. This behaviour is not desirable and is disabled by the following command
     TH1::AddDirectory(kFALSE);
     
     
-    // Open the source ROOT file
-    //shared_ptr<TFile> srcFile(TFile::Open("/data/shared/Long_Exercise_TTbar/mujets_v3.root"));
-    shared_ptr<TFile> srcFile(TFile::Open("/afs/cern.ch/work/j/jandrea/public/proof_merged.root"));
-    //^ There are copies at CMS DAS machines and AFS
-    
-    
     // There are trees for many processes in the source file. The processes will be combined into
     //several groups, and an independent histogram will be produced for all processes in each group.
     //Define here what processes (what trees) are grouped together and assign some meaningful name
@@ -76,170 +259,136 @@ int main()
     groups.emplace_back(Group("QCD", {"QCD_Pt-20to30_MuEnrichedPt5", "QCD_Pt-30to50_MuEnrichedPt5", "QCD_Pt-50to80_MuEnrichedPt5", "QCD_Pt-80to120_MuEnrichedPt5", "QCD_Pt-120to170_MuEnrichedPt5", "QCD_Pt-170to300_MuEnrichedPt5", "QCD_Pt-300to470_MuEnrichedPt5"}));
     
     
-    // Create an output file to store the histograms that will be created
-    TFile outFile("MtW.root", "recreate");
+    // If requested, read only the entries that passed the selection in a previous run and record
+    //them in the current one. The key must change whenever the selection in ProcessEvent changes.
+    //A shard sees only a part of each tree and thus does not record the lists. The same applies to
+    //a run resumed from a checkpoint and to the preview mode
+    shared_ptr<EntryListFile> entryLists;
+    bool const recordEntryLists = (nShards == 1 and checkpointFileName.empty() and
+     previewStride <= 1);
+    string selectionDescription("1 muon: pt > 26, |eta| < 2.1; "
+     "2 b-tagged jets: pt > 30, |eta| < 2.4, CSV > 0.679");
     
-    vector<Jet const *>bTaggedJets, untaggedJets;  // move to class definition
-    vector<Jet const *> WHadronicCandidate;
-    //vector<Jet> WHad;
+    if (jetCleaningDR > 0.)
+        selectionDescription += "; jets cleaned within dR < " + to_string(jetCleaningDR);
     
-    // Loop over the groups
-    for (auto const &group: groups)
+    string const selectionKey(EntryListFile::MakeKey(selectionDescription));
+    
+    if (not entryListFileName.empty())
+        entryLists.reset(new EntryListFile(entryListFileName));
+    
+    
+    // If requested, skip zones of the source trees in which no event can pass the selection. The
+    //zone map is built with an additional pass over the source file if it is missing or outdated.
+    //Flat event files are not described by zone maps
+    shared_ptr<ZoneMap> zoneMap;
+    vector<ZoneMap::Cut> const zoneCuts{{ZoneMap::Variable::LeptonPt, 1, 26.},
+     {ZoneMap::Variable::JetPt, 4, 30.}, {ZoneMap::Variable::JetBTag, 2, 0.679}};
+    
+    if (not zoneMapFileName.empty() and not FlatEventFile::IsFlatFile(srcFileName))
     {
-        // A bit of verbosity
-        cout << "Processing group \"" << group.name << "\"..." << endl;
+        zoneMap.reset(new ZoneMap(zoneMapFileName, srcFileName));
+        list<string> treeNames;
         
+        for (auto const &group: groups)
+            treeNames.insert(treeNames.end(), group.treeNames.begin(), group.treeNames.end());
         
-        // Create a reader for the current group
-        Reader reader(srcFile, group.treeNames, group.isMC);
-        
-        
-        // Create a histogram to be filled. It is named after the group
-        TH1D histMtW((group.name+"_histMtW").c_str(), "Transverse W mass;M_{T}(W), GeV;Events", 100., 0., 200.);
-        TH1D histInv3Jet((group.name+"_histInv3Jet").c_str(), "Invariant mass of 3 leading jet; M(jjj), GeV; Events", 300., 0., 600.);
-	TH1D hTopMass1((group.name+"_hTopMass1").c_str(), "Top mass Hadronic; M(top), GeV; Events", 300., 0., 600.);
-	TH1D hTopMass2((group.name+"_hTopMass2").c_str(), "Top mass Leptonic; M(top), GeV; Events", 300., 0., 600.);
-	TH1D hWmass1((group.name+"_hWmass1").c_str(), "W mass from Hadronic Decay; M(W), GeV; Events", 300.0, 0., 600.0);
-	TH1D hWmass2((group.name+"_hWmass2").c_str(), "W mass from Leptonic Decay; M(W), GeV; Events", 300.0, 0.0, 600.0);
-	TH1D hLeptonMass((group.name+"_hLeptonMass").c_str(), "Lepton Mass; M(l), GeV; Events", 300.0, 0.0, 600.0);
-	TH1D hNuMass((group.name+"_hNuMass").c_str(), "Neutrino Mass; M(#nu), GeV; Events", 300.0, 0.0, 600.0);
-
-        // Loop over all events in the current group of processes
-        while (reader.ReadNextEvent())
+        if (not zoneMap->Contains(treeNames))
         {
-            // Perform some event selection
-            // Event should contain exactly one charged lepton (muon in this case)
-            if (reader.GetLeptons().size() != 1)
-                continue;
-            
+            cout << "Building the zone map..." << endl;
+            unique_ptr<TFile> srcFile(TFile::Open(srcFileName.c_str()));
             
-            // The muon should have sufficient transverse momentum and should not be too forward
-            Lepton const &l = reader.GetLeptons().front();
-            
-            if (l.Pt() < 26. or fabs(l.Eta()) > 2.1)
-                continue;
-            
-            
-            // Require that there are at least four central jets with pt > 30 GeV
-            auto const &jets = reader.GetJets();
-            unsigned nGoodJets = 0;
-	    float mass;
-	    int nSelJet = 0;
-
-	    //vector<Jet const *> bTaggedJets, untaggedJets;  // move to class definition
-	    bTaggedJets.clear();
-	    untaggedJets.clear();
-            
-            for (Jet const &j: jets)
+            if (not srcFile or srcFile->IsZombie())
             {
-                if (j.Pt() < 30.)  // jets are ordered in pt
-                    break;
-                ++nSelJet;
-
-                //if (fabs(j.Eta()) < 2.4)
-		if (fabs(j.Eta()) > 2.4) continue;
-		++nGoodJets;
-
-		if (j.BTag() > 0.679)
-		  bTaggedJets.push_back(&j);
-		else
-		  untaggedJets.push_back(&j);
+                cerr << "Cannot open file \"" << srcFileName << "\".\n";
+                return EXIT_FAILURE;
             }
-
-	    if (bTaggedJets.size() != 2) continue;
-
-
-      	    if (nSelJet > 3) {
-	      mass = (jets.at(0).P4()+ jets.at(1).P4()+ jets.at(2).P4()).M();
-	      histInv3Jet.Fill(mass, reader.GetWeight());
-	    }
-
-            if (nGoodJets < 4)
-                continue;
             
-            // Calculate the variable of interest
-            MET const &met = reader.GetMET();
-            double const MtW = sqrt(pow(l.Pt() + met.Pt(), 2) -
-             pow(l.P4().Px() + met.P4().Px(), 2) - pow(l.P4().Py() + met.P4().Py(), 2));
-            if (MtW < 50.) continue; // MtW cut from group 1
-
-            // Fill the histogram. Note that simulated events are weighted
-            histMtW.Fill(MtW, reader.GetWeight());
-
-	    //loop to choose 2 jets from W candidate
-	    const int nUnTagJet = untaggedJets.size();
-	    double Mass_W = 80.4;
-	    double massW;
-	    double minimiser = 1000.;
-	    //vector <Jet> WHadronicCandidate;
-
-	    for (int i =0; i < nUnTagJet; ++i) {
-	      for (int j = i+1; j < nUnTagJet; ++j) {
-		massW = (untaggedJets.at(i)->P4() + untaggedJets.at(j)->P4()).M();
-
-		if ( fabs(massW-Mass_W) < minimiser) {
-
-		  minimiser = fabs(massW-Mass_W);
-		  WHadronicCandidate.clear();
-		  WHadronicCandidate.push_back(untaggedJets.at(i));
-		  WHadronicCandidate.push_back(untaggedJets.at(j));
-		}
-	      }
-	    }
-
-	    if (WHadronicCandidate.size() != 2) continue;
-
-	    //W from lepton channel
-	    TLorentzVector WLepton;
-	    WLepton = Nu4Momentum(l.P4(), met.Pt(), met.Phi()) + l.P4(); //Nu 4mom + lepton 4mon
-
-	    double massTop1, massTop2;
-	    double mtWHad1, mtWHad2;
-	    double mtWLep1, mtWLep2;
-
-	    //mtWHad1 = (bTaggedJets.at(0).P4 + WHad.P4()).M();
-	    //mtWHad2 = (bTaggedJets.at(1).P4 + WHad.P4()).M();
-
-	    mtWHad1 = (bTaggedJets.at(0)->P4() + WHadronicCandidate.at(0)->P4() + WHadronicCandidate.at(1)->P4()).M();
-	    mtWHad2 = (bTaggedJets.at(1)->P4() + WHadronicCandidate.at(0)->P4() + WHadronicCandidate.at(1)->P4()).M();
-
-	    mtWLep1 = (bTaggedJets.at(0)->P4() + WLepton).M();
-	    mtWLep2 = (bTaggedJets.at(1)->P4() + WLepton).M();
-
-	    if (fabs(mtWHad1 - mtWLep2) < fabs(mtWHad2 - mtWLep1)) {
-	      massTop1 = mtWHad1;
-	      massTop2 = mtWLep2;
-	    }
-	    else {
-	      massTop1 = mtWHad2;
-	      massTop2 = mtWLep1;
-	    }
-
-	    hLeptonMass.Fill( l.M(), reader.GetWeight() );
-	    hNuMass.Fill( Nu4Momentum(l.P4(), met.Pt(), met.Phi() ).M(), reader.GetWeight() );
-	    hWmass1.Fill( massW, reader.GetWeight() );
-	    hWmass2.Fill( WLepton.M(), reader.GetWeight() );
-	    hTopMass1.Fill ( massTop1, reader.GetWeight() );
-	    hTopMass2.Fill( massTop2, reader.GetWeight() );
-
+            zoneMap->Build(*srcFile, treeNames);
+            zoneMap->Save();
         }
+    }
+    
+    
+    // Process all groups. The output is the same for any number of threads and, after merging, for
+    //any number of shards
+    EventLoop loop(srcFileName, groups, BookHists, ProcessEvent);
+    loop.SetNumThreads(nThreads);
+    loop.SetShard(shardIndex, nShards);
+    loop.SetProgressReport();
+    
+    if (not checkpointFileName.empty())
+        loop.SetCheckpoint(checkpointFileName);
+    
+    loop.SetReaderConfigurator([readAheadDepth, recordEntryLists, previewStride, previewSeed,
+     jetCleaningDR, &entryLists, &selectionKey, &zoneMap, &zoneCuts](Reader &reader)
+    {
+        // Read only the branches that are used in the selection. Branches that exist in
+        //simulation only are ignored automatically for data
+        reader.SetBranchesToRead({"nlepton", "lept_pt", "lept_eta", "lept_phi", "lept_flav",
+         "njets", "jet_pt", "jet_eta", "jet_phi", "jet_btagdiscri", "jet_flav",
+         "met_pt", "met_phi", "evtweight"});
         
+        // Skip events that fail the lepton selection before the other branches are read
+        reader.SetLeptonPreselection([](LeptonRange const &leptons)
+        {
+            return (leptons.size() == 1 and leptons.front().Pt() >= 26. and
+             fabs(leptons.front().Eta()) <= 2.1);
+        });
         
-       // The histogram for the current group has been filled. Save it in the output file
-        outFile.cd();
-        histMtW.Write();
-	histInv3Jet.Write();
-	hLeptonMass.Write();
-	hNuMass.Write();
-	hWmass1.Write();
-	hWmass2.Write();
-	hTopMass1.Write();
-	hTopMass2.Write();
-
-    }
+        // Read only the entries selected in a previous run, if any, and record them for the
+        //following runs
+        if (entryLists)
+        {
+            reader.SetEntryList(entryLists, selectionKey);
+            
+            if (recordEntryLists)
+                reader.RecordEntryList(entryLists, selectionKey);
+        }
+        
+        // Skip zones that cannot contain selected events
+        if (zoneMap)
+            reader.SetZoneMap(zoneMap, zoneCuts);
+        
+        // For a quick look at the distributions, read only a fraction of clusters. Weights are
+        //rescaled to preserve the normalisation
+        if (previewStride > 1)
+            reader.SetPreview(previewStride, previewSeed);
+        
+        // Remove jets that are reconstructed from the muon. Zone maps stay valid since the
+        //cleaning can only reduce the number of jets
+        if (jetCleaningDR > 0.)
+            reader.SetJetLeptonCleaning(jetCleaningDR, 26.);
+        
+        // Optionally read and decompress events in a background thread
+        reader.EnableReadAhead(readAheadDepth);
+    });
+    
+    cout << "Processing " << groups.size() << " groups..." << endl;
+    loop.Run();
+    
+    if (entryLists and recordEntryLists)
+        entryLists->Save();
+    
+    
+    // Save the histograms in an output file. Each shard writes a separate file
+    string outFileName("MtW.root");
+    
+    if (nShards > 1)
+        outFileName = "MtW_shard" + to_string(shardIndex) + "of" + to_string(nShards) + ".root";
+    
+    TFile outFile(outFileName.c_str(), "recreate");
+    loop.Write(outFile);
+    
+    
+    // Save the counters of reading and processing next to the histograms
+    string const reportFileName(outFileName.substr(0, outFileName.rfind('.')) + "_report.json");
+    ofstream reportFile(reportFileName);
+    loop.GetStats().WriteJSON(reportFile, loop.GetRunTime());
     
     
-    cout << "Done. Results are saved in the file \"" << outFile.GetName() << "\".\n";
+    cout << "Done. Results are saved in the file \"" << outFile.GetName() << "\", and the " <<
+     "report on the performance in the file \"" << reportFileName << "\".\n";
     
     
     return EXIT_SUCCESS;
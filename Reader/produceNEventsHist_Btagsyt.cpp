@@ -1,5 +1,9 @@
 #include <Reader.hpp>
+#include <Group.hpp>
+#include <EventLoop.hpp>
 #include <CalculatePzNu.hpp>
+#include <MassKernels.hpp>
+#include <InlineVector.hpp>
 
 #include <TFile.h>
 #include <TH1D.h>
@@ -8,6 +12,8 @@
 #include <iostream>
 #include <memory>
 #include <algorithm>
+#include <string>
+#include <cstdio>
 
 #include <vector>
 
@@ -17,52 +23,211 @@
 using namespace std;
 
 
+/// Indices of histograms in the set booked for each group. They are written in this order
+enum HistIndex
+{
+	iBtagSysMin,
+	iBtagSysMax,
+	iTopMass1,
+	iTopMass2,
+	iTopMass1Min,
+	iTopMass1Max,
+	iTopMass2Min,
+	iTopMass2Max
+};
+
+
+/// Books histograms for the group with the given name, in the order given by HistIndex
+EventLoop::HistSet BookHists(string const &groupName)
+{
+	EventLoop::HistSet hists;
+
+	hists.emplace_back(new TH1D((groupName + "_BtagSys_min").c_str(), "Number of event BtagSys Min", 1, 0., 1.));
+	hists.emplace_back(new TH1D((groupName + "_BtagSys_max").c_str(), "Number of event BtagSys Max", 1, 0., 1.));
+
+	hists.emplace_back(new TH1D((groupName+"_hTopMass1").c_str(), "Nominal Top mass Hadronic; M(top), GeV; Events", 300., 0., 600.));
+	hists.emplace_back(new TH1D((groupName+"_hTopMass2").c_str(), "Nominal Top mass Leptonic; M(top), GeV; Events", 300., 0., 600.));
+
+	hists.emplace_back(new TH1D((groupName+"_hTopMass1min").c_str(), "Min Top mass Hadronic; M(top), GeV; Events", 300., 0., 600.));
+	hists.emplace_back(new TH1D((groupName+"_hTopMass1max").c_str(), "Max Top mass Hadronic; M(top), GeV; Events", 300., 0., 600.));
+	hists.emplace_back(new TH1D((groupName+"_hTopMass2min").c_str(), "Min Top mass Leptonic; M(top), GeV; Events", 300., 0., 600.));
+	hists.emplace_back(new TH1D((groupName+"_hTopMass2max").c_str(), "MaxTop mass Leptonic; M(top), GeV; Events", 300., 0., 600.));
+
+	return hists;
+}
+
+
 /**
- * \struct Group
- * \brief An auxiliary structure to group several trees together
- * 
- * Each tree in the source file corresponds to a different physics process. It is useful to consider
- * several processes together. This structure defines what trees should be considered with a group,
- * and gives the group a name.
+ * \brief Applies the event selection and fills the histograms
+ *
+ * Called for each event. It must not keep any state between events since events are processed in
+ * parallel by several threads.
  */
-struct Group
+void ProcessEvent(Reader &reader, EventLoop::HistSet &hists)
 {
-	/// Constructor without paramters
-	Group() = default;
+	// Perform some event selection
+	// Event should contain exactly one charged lepton (muon in this case)
+	if (reader.GetLeptons().size() != 1)
+		return;
 
-	/// Constructor with explicit initialisation
-	Group(string const &name, initializer_list<string> const &treeNames, bool isMC = true);
 
-	/// Move constructor
-	Group(Group &&) = default;
+	// The muon should have sufficient transverse momentum and should not be too forward
+	LeptonView const l = reader.GetLeptons().front();
 
-	/// A name to refer to the group
-	string name;
+	if (l.Pt() < 26. or fabs(l.Eta()) > 2.1)
+		return;
 
-	/// Names of trees that contribute to this group
-	list<string> treeNames;
+	double muPt = l.Pt();
 
-	/// Flag to indicate MC simulation as opposed to data
-	bool isMC;
-};
+	// Require that there are at least four central jets with pt > 30 GeV
+	auto const &jets = reader.GetJets();
+	unsigned nGoodJets = 0;
+	unsigned nMedBJets = 0;
+	InlineVector<double, Reader::maxSize> jetPt;
+	InlineVector<double, Reader::maxSize> bJetPt;
+	InlineVector<double, Reader::maxSize> bJetBT;
+
+	InlineVector<JetView, Reader::maxSize> bTaggedJets, untaggedJets;
+	JetKinematics untaggedKinematics;
+
+	for (auto const &j: jets)
+	{
+		if (j.Pt() < 30.)  // jets are ordered in pt
+			break;
+
+		if (fabs(j.Eta()) >= 2.4)
+			continue;
+
+		++nGoodJets;
+
+		if (j.BTag() > 0.679)
+			bTaggedJets.push_back(j);
+		else
+		{
+			untaggedJets.push_back(j);
+			untaggedKinematics.Add(j.Momentum());
+		}
+
+
+		jetPt.push_back(j.Pt());
+		if(j.BTag() > WP_M){
+			++nMedBJets;
+			bJetPt.push_back(j.Pt());
+			bJetBT.push_back(j.BTag());
+
+		}
+	}
+
+	if (nGoodJets < 4 || nMedBJets != 2)
+		return;
+
+	// Calculate the variable of interest
+	MET const &met = reader.GetMET();
+	double const MtW = sqrt(pow(l.Pt() + met.Pt(), 2) -
+			pow(l.Px() + met.P4().Px(), 2) - pow(l.Py() + met.P4().Py(), 2));
+
+	if(MtW < 50.)
+		return;
+
+	// Weights for all b-tagging variations, computed by the reader in a single pass over jets. The
+	//vector lives for one event, so its memory is taken from the arena of the reader
+	SystWeights const &allWeights = reader.GetAllWeights();
+	ArenaVector<double> vec_BtagSys(reader.GetArena());
+	vec_BtagSys.reserve(16);
+
+	for (SystDirection const systDirection: {SystDirection::Up, SystDirection::Down})
+		for (SystType const systType: {SystType::BTagPurityHF, SystType::BTagPurityLF,
+				SystType::BTagStatHF1, SystType::BTagStatHF2, SystType::BTagStatLF1,
+				SystType::BTagStatLF2, SystType::BTagCharmUnc1, SystType::BTagCharmUnc2})
+			vec_BtagSys.push_back(allWeights(systType, systDirection));
 
+	// Fill the histogram. Note that simulated events are weighted
+	//histNEvents_jetdown.Fill(0., reader.GetWeight());
 
-Group::Group(string const &name_, initializer_list<string> const &treeNames_,
-		bool isMC_ /*= true*/):
-	name(name_), treeNames(treeNames_), isMC(isMC_)
-{}
+	//hists[iBtagSysMin]->Fill(0, std::min_element( std::begin(vec_BtagSys), std::end(vec_BtagSys) ) );
+	hists[iBtagSysMin]->Fill(0., *std::min_element( vec_BtagSys.begin(), vec_BtagSys.end()) );
+	hists[iBtagSysMax]->Fill(0., *std::max_element( vec_BtagSys.begin(), vec_BtagSys.end()) );
 
 
-int main()
+	//choose 2 jets from W candidate: the pair of untagged jets with the mass closest to W mass.
+	//Only the search uses single precision, the masses are recomputed in double precision
+	double Mass_W = 80.4;
+	MassKernels::PairMatch const WHadronicCandidate =
+			MassKernels::FindBestPair(untaggedKinematics, Mass_W);
+
+	if (not WHadronicCandidate.found) return;
+
+	//W from lepton channel
+	TLorentzVector WLepton;
+	WLepton = Nu4Momentum(l.P4(), met.Pt(), met.Phi()) + l.P4(); //Nu 4mom + lepton 4mon
+
+	double massTop1, massTop2;
+	double mtWHad1, mtWHad2;
+	double mtWLep1, mtWLep2;
+
+	FourVector const WHadronic = untaggedJets.at(WHadronicCandidate.i).Momentum() +
+			untaggedJets.at(WHadronicCandidate.j).Momentum();
+	mtWHad1 = (bTaggedJets.at(0).Momentum() + WHadronic).M();
+	mtWHad2 = (bTaggedJets.at(1).Momentum() + WHadronic).M();
+
+	mtWLep1 = (bTaggedJets.at(0).P4() + WLepton).M();
+	mtWLep2 = (bTaggedJets.at(1).P4() + WLepton).M();
+
+	if (fabs(mtWHad1 - mtWLep2) < fabs(mtWHad2 - mtWLep1)) {
+		massTop1 = mtWHad1;
+		massTop2 = mtWLep2;
+	}
+	else {
+		massTop1 = mtWHad2;
+		massTop2 = mtWLep1;
+	}
+
+	hists[iTopMass1]->Fill ( massTop1, reader.GetWeight() );
+	hists[iTopMass2]->Fill( massTop2, reader.GetWeight() );
+
+	hists[iTopMass1Min]->Fill ( massTop1, *std::min_element( vec_BtagSys.begin(), vec_BtagSys.end()));
+	hists[iTopMass2Min]->Fill( massTop2, *std::min_element( vec_BtagSys.begin(), vec_BtagSys.end()));
+	hists[iTopMass1Max]->Fill ( massTop1, *std::max_element( vec_BtagSys.begin(), vec_BtagSys.end()) );
+	hists[iTopMass2Max]->Fill( massTop2, *std::max_element( vec_BtagSys.begin(), vec_BtagSys.end()) );
+}
+
+
+// The main function is excluded when the event processing is linked into testNoAlloc
+#ifndef NO_ANALYSIS_MAIN
+int main(int argc, char **argv)
 {
+	// Parse the command line. Supported options are:
+	//  --threads N: number of threads, zero means all available cores;
+	//  --shard I/N: process only the I-th out of N shards (counted from 0). Partial results of
+	//   all shards are combined with the program mergeShards.
+	unsigned nThreads = 1;
+	unsigned shardIndex = 0, nShards = 1;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		string const arg(argv[i]);
+
+		if (arg == "--threads" and i + 1 < argc)
+			nThreads = stoul(argv[++i]);
+		else if (arg == "--shard" and i + 1 < argc and
+			sscanf(argv[i + 1], "%u/%u", &shardIndex, &nShards) == 2)
+			++i;
+		else
+		{
+			cerr << "Usage: " << argv[0] << " [--threads N] [--shard I/N]\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+
 	// ROOT manages memory in a very funny way. By default, it will assign every histogram to the
 	//file accessed lastly. This behaviour is not desirable and is disabled by the following command
 	TH1::AddDirectory(kFALSE);
 	TH1::SetDefaultSumw2(kTRUE); 
 
-	// Open the source ROOT file
-	shared_ptr<TFile> srcFile(TFile::Open("/afs/cern.ch/work/j/jandrea/public/proof_merged.root"));
-	//shared_ptr<TFile> srcFile(TFile::Open("/data/shared/Long_Exercise_TTbar/mujets_v3.root"));
+	// The source ROOT file. Each thread opens its own copy
+	string const srcFileName("/afs/cern.ch/work/j/jandrea/public/proof_merged.root");
+	//string const srcFileName("/data/shared/Long_Exercise_TTbar/mujets_v3.root");
 	//^ There are copies at CMS DAS machines and AFS
 
 
@@ -82,215 +247,40 @@ int main()
 				"QCD_Pt-50to80_MuEnrichedPt5", "QCD_Pt-80to120_MuEnrichedPt5", "QCD_Pt-120to170_MuEnrichedPt5",
 				"QCD_Pt-170to300_MuEnrichedPt5", "QCD_Pt-300to470_MuEnrichedPt5"}));
 
-	// Create an output file to store the histograms that will be created
-	TFile outFile("selection_BtagSys.root", "recreate");
-	outFile.mkdir("NEvents");
+	// Process all groups. The output is the same for any number of threads and, after merging, for
+	//any number of shards
+	EventLoop loop(srcFileName, groups, BookHists, ProcessEvent);
+	loop.SetNumThreads(nThreads);
+	loop.SetShard(shardIndex, nShards);
 
-	// Loop over the groups
-	for (auto const &group: groups)
+	loop.SetReaderConfigurator([](Reader &reader)
 	{
-		// A bit of verbosity
-		cout << "Processing group \"" << group.name << "\"..." << endl;
-
-
-		// Create a reader for the current group
-		Reader reader(srcFile, group.treeNames, group.isMC);
-
-		TH1D histNEvents_BtagSys_min((group.name + "_BtagSys_min").c_str(), "Number of event BtagSys Min", 1, 0., 1.);
-		TH1D histNEvents_BtagSys_max((group.name + "_BtagSys_max").c_str(), "Number of event BtagSys Max", 1, 0., 1.);
-
-		TH1D hTopMass1((group.name+"_hTopMass1").c_str(), "Nominal Top mass Hadronic; M(top), GeV; Events", 300., 0., 600.);
-		TH1D hTopMass2((group.name+"_hTopMass2").c_str(), "Nominal Top mass Leptonic; M(top), GeV; Events", 300., 0., 600.);
-
-		TH1D hTopMass1min((group.name+"_hTopMass1min").c_str(), "Min Top mass Hadronic; M(top), GeV; Events", 300., 0., 600.);
-		TH1D hTopMass2min((group.name+"_hTopMass2min").c_str(), "Min Top mass Leptonic; M(top), GeV; Events", 300., 0., 600.);
-		TH1D hTopMass1max((group.name+"_hTopMass1max").c_str(), "Max Top mass Hadronic; M(top), GeV; Events", 300., 0., 600.);
-		TH1D hTopMass2max((group.name+"_hTopMass2max").c_str(), "MaxTop mass Leptonic; M(top), GeV; Events", 300., 0., 600.);
-
-		vector<double> vec_BtagSys;
-
-		while (reader.ReadNextEvent())
+		// Skip events that fail the lepton selection before the other branches are read
+		reader.SetLeptonPreselection([](LeptonRange const &leptons)
 		{
-			// Perform some event selection
-			// Event should contain exactly one charged lepton (muon in this case)
-			if (reader.GetLeptons().size() != 1)
-				continue;
-
-
-			// The muon should have sufficient transverse momentum and should not be too forward
-			Lepton const &l = reader.GetLeptons().front();
-
-			if (l.Pt() < 26. or fabs(l.Eta()) > 2.1)
-				continue;
-
-			double muPt = l.Pt();
-
-			// Require that there are at least four central jets with pt > 30 GeV
-			auto const &jets = reader.GetJets();
-			unsigned nGoodJets = 0;
-			unsigned nMedBJets = 0;
-			vector<double> jetPt;
-			vector<double> bJetPt;
-			vector<double> bJetBT;
-
-	    		vector<Jet const *> bTaggedJets, untaggedJets;
-	    		bTaggedJets.clear();
-	    		untaggedJets.clear();
-
-			for (auto const &j: jets)
-			{
-				if (j.Pt() < 30.)  // jets are ordered in pt
-					break;
-
-				if (fabs(j.Eta()) >= 2.4)
-					continue;
-
-				++nGoodJets;
-
-				if (j.BTag() > 0.679)
-		  			bTaggedJets.push_back(&j);
-				else
-		  		untaggedJets.push_back(&j);
-
-
-				jetPt.push_back(j.Pt());
-				if(j.BTag() > WP_M){
-					++nMedBJets;
-					bJetPt.push_back(j.Pt());
-					bJetBT.push_back(j.BTag());
-
-				}
-			}
-
-			if (nGoodJets < 4 || nMedBJets != 2)
-				continue;
-
-			// Calculate the variable of interest
-			MET const &met = reader.GetMET();
-			double const MtW = sqrt(pow(l.Pt() + met.Pt(), 2) -
-					pow(l.P4().Px() + met.P4().Px(), 2) - pow(l.P4().Py() + met.P4().Py(), 2));
-
-			if(MtW < 50.)
-				continue;
-
-			vec_BtagSys.clear();
-
-			reader.SetSystematics(SystType::BTagPurityHF , SystDirection::Up);
-			vec_BtagSys.push_back( reader.GetWeight());
-
-			reader.SetSystematics(SystType::BTagPurityLF , SystDirection::Up);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagStatHF1 , SystDirection::Up);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagStatHF2 , SystDirection::Up);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagStatLF1 , SystDirection::Up);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagStatLF2 , SystDirection::Up);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagCharmUnc1 , SystDirection::Up);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagCharmUnc2 , SystDirection::Up);
-			vec_BtagSys.push_back( reader.GetWeight());
-
-			reader.SetSystematics(SystType::BTagPurityHF , SystDirection::Down);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagPurityLF , SystDirection::Down);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagStatHF1 , SystDirection::Down);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagStatHF2 , SystDirection::Down);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagStatLF1 , SystDirection::Down);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagStatLF2 , SystDirection::Down);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagCharmUnc1 , SystDirection::Down);
-			vec_BtagSys.push_back( reader.GetWeight());
-			reader.SetSystematics(SystType::BTagCharmUnc2 , SystDirection::Down);
-			vec_BtagSys.push_back( reader.GetWeight());
-
-			// Fill the histogram. Note that simulated events are weighted
-			//histNEvents_jetdown.Fill(0., reader.GetWeight());
-
-			//histNEvents_BtagSys_min.Fill(0, std::min_element( std::begin(vec_BtagSys), std::end(vec_BtagSys) ) );
-			histNEvents_BtagSys_min.Fill(0., *std::min_element( vec_BtagSys.begin(), vec_BtagSys.end()) );
-			histNEvents_BtagSys_max.Fill(0., *std::max_element( vec_BtagSys.begin(), vec_BtagSys.end()) );
-
-
-	    		//loop to choose 2 jets from W candidate
-	    		const int nUnTagJet = untaggedJets.size();
-	    		double Mass_W = 80.4;
-	    		double massW;
-	    		double minimiser = 1000.;
-			vector <const Jet*> WHadronicCandidate;
-
-	    		for (int i =0; i < nUnTagJet; ++i) {
-	      			for (int j = i+1; j < nUnTagJet; ++j) {
-					massW = (untaggedJets.at(i)->P4() + untaggedJets.at(j)->P4()).M();
-
-					if ( fabs(massW-Mass_W) < minimiser) {
-
-		  				minimiser = fabs(massW-Mass_W);
-		  				WHadronicCandidate.clear();
-		  				WHadronicCandidate.push_back(untaggedJets.at(i));
-		  				WHadronicCandidate.push_back(untaggedJets.at(j));
-					}
-	      			}
-	    		}
-
-	    		if (WHadronicCandidate.size() != 2) continue;
-
-	    		//W from lepton channel
-	    		TLorentzVector WLepton;
-			WLepton = Nu4Momentum(l.P4(), met.Pt(), met.Phi()) + l.P4(); //Nu 4mom + lepton 4mon
-
-			double massTop1, massTop2	;
-	    		double mtWHad1, mtWHad2;
-		       double mtWLep1, mtWLep2;
-
-	    		mtWHad1 = (bTaggedJets.at(0)->P4() + WHadronicCandidate.at(0)->P4() + WHadronicCandidate.at(1)->P4()).M();
-	    		mtWHad2 = (bTaggedJets.at(1)->P4() + WHadronicCandidate.at(0)->P4() + WHadronicCandidate.at(1)->P4()).M();
-
-	    		mtWLep1 = (bTaggedJets.at(0)->P4() + WLepton).M();
-	    		mtWLep2 = (bTaggedJets.at(1)->P4() + WLepton).M();
-
-	    		if (fabs(mtWHad1 - mtWLep2) < fabs(mtWHad2 - mtWLep1)) {
-	      			massTop1 = mtWHad1;
-	      			massTop2 = mtWLep2;
-	    		}
-	    		else {
-	      			massTop1 = mtWHad2;
-	      			massTop2 = mtWLep1;
-	    		}
-
-		    	hTopMass1.Fill ( massTop1, reader.GetWeight() );
-		    	hTopMass2.Fill( massTop2, reader.GetWeight() );
-
-	    		hTopMass1min.Fill ( massTop1, *std::min_element( vec_BtagSys.begin(), vec_BtagSys.end()));
-	    		hTopMass2min.Fill( massTop2, *std::min_element( vec_BtagSys.begin(), vec_BtagSys.end()));
-	    		hTopMass1max.Fill ( massTop1, *std::max_element( vec_BtagSys.begin(), vec_BtagSys.end()) );
-	    		hTopMass2max.Fill( massTop2, *std::max_element( vec_BtagSys.begin(), vec_BtagSys.end()) );
+			return (leptons.size() == 1 and leptons.front().Pt() >= 26. and
+				fabs(leptons.front().Eta()) <= 2.1);
+		});
+	});
 
+	cout << "Processing " << groups.size() << " groups..." << endl;
+	loop.Run();
 
-		}
 
+	// Create an output file to store the histograms that have been created. Each shard writes a
+	//separate file
+	string outFileName("selection_BtagSys.root");
 
+	if (nShards > 1)
+		outFileName = "selection_BtagSys_shard" + to_string(shardIndex) + "of" + to_string(nShards) +
+			".root";
 
-		outFile.cd("NEvents");
-		histNEvents_BtagSys_min.Write();
-		histNEvents_BtagSys_max.Write();
-		hTopMass1.Write();
-		hTopMass2.Write();
-
-		hTopMass1min.Write();
-		hTopMass1max.Write();
-		hTopMass2min.Write();
-		hTopMass2max.Write();
+	TFile outFile(outFileName.c_str(), "recreate");
+	outFile.mkdir("NEvents");
+	loop.Write(*outFile.GetDirectory("NEvents"));
 
-		
-	}
 	cout << "Done. Results are saved in the file \"" << outFile.GetName() << "\".\n";
 
 	return EXIT_SUCCESS;
 }
+#endif  // NO_ANALYSIS_MAIN
@@ -0,0 +1,170 @@
+/**
+ * Selects events with exactly one tight lepton and several jets and saves them in a compact file
+ * that can be read with the class Reader in the same way as the original one. Analyses that apply
+ * a tighter selection can be run on the skimmed file, which is much faster.
+ */
+
+#include <Reader.hpp>
+#include <Group.hpp>
+#include <SkimWriter.hpp>
+
+#include <TFile.h>
+
+#include <list>
+#include <set>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+
+int main(int argc, char **argv)
+{
+    // Parse the command line
+    string srcFileName("/afs/cern.ch/work/j/jandrea/public/proof_merged.root");
+    string outFileName("skim.root");
+    // The default selection is looser than, or equal to, the selections in produceExampleHist and
+    //produceNEventsHist_Btagsyt, so that the skim gives them the same results as the source file.
+    //The cuts are inclusive, and jets are counted regardless of pseudorapidity because
+    //produceExampleHist fills the three-jet mass for events with four jets in any direction
+    double lepPtThreshold = 26.;
+    double lepEtaMax = 2.1;
+    unsigned minNumJets = 4;
+    double jetPtThreshold = 30.;
+    double jetEtaMax = numeric_limits<double>::infinity();
+    bool keepJEC = false;
+    
+    for (int i = 1; i < argc; ++i)
+    {
+        string const arg(argv[i]);
+        
+        if (arg == "--input" and i + 1 < argc)
+            srcFileName = argv[++i];
+        else if (arg == "--output" and i + 1 < argc)
+            outFileName = argv[++i];
+        else if (arg == "--lepton-pt" and i + 1 < argc)
+            lepPtThreshold = stod(argv[++i]);
+        else if (arg == "--jets" and i + 1 < argc)
+            minNumJets = stoul(argv[++i]);
+        else if (arg == "--jet-pt" and i + 1 < argc)
+            jetPtThreshold = stod(argv[++i]);
+        else if (arg == "--jet-eta" and i + 1 < argc)
+            jetEtaMax = stod(argv[++i]);
+        else if (arg == "--keep-jec")
+            keepJEC = true;
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--input FILE] [--output FILE] [--lepton-pt PT] " <<
+             "[--jets N] [--jet-pt PT] [--jet-eta ETA] [--keep-jec]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    
+    
+    // The trees to be skimmed, same as in produceExampleHist
+    list<Group> groups;
+    groups.emplace_back(Group("Data", {"SingleMuRun2012A", "SingleMuRun2012B", "SingleMuRun2012C", "SingleMuRun2012D"}, false));
+    groups.emplace_back(Group("ttbar", {"TTJets"}));
+    groups.emplace_back(Group("SingleTop", {"T_t-channel", "Tbar_t-channel", "T_tW-channel", "Tbar_tW-channel"}));
+    groups.emplace_back(Group("Wjets", {"W1JetToLNu", "W2JetsToLNu", "W3JetsToLNu", "W4JetsToLNu"}));
+    groups.emplace_back(Group("VV", {"WWJetsIncl", "WZJetsIncl", "ZZJetsIncl"}));
+    groups.emplace_back(Group("DrellYan", {"DYJetsToLL_M-10To50", "DYJetsToLL_M-50"}));
+    groups.emplace_back(Group("QCD", {"QCD_Pt-20to30_MuEnrichedPt5", "QCD_Pt-30to50_MuEnrichedPt5", "QCD_Pt-50to80_MuEnrichedPt5", "QCD_Pt-80to120_MuEnrichedPt5", "QCD_Pt-120to170_MuEnrichedPt5", "QCD_Pt-170to300_MuEnrichedPt5", "QCD_Pt-300to470_MuEnrichedPt5"}));
+    
+    
+    // Branches to be kept. Lepton isolation and the number of primary vertices are not used in the
+    //downstream analysis and are dropped
+    set<string> branchNames{"nlepton", "lept_pt", "lept_eta", "lept_phi", "lept_flav",
+     "njets", "jet_pt", "jet_eta", "jet_phi", "jet_btagdiscri", "jet_flav",
+     "met_pt", "met_phi", "evtweight"};
+    
+    // The JEC-varied jets and MET must be read and written as well if they are kept
+    if (keepJEC)
+    {
+        for (auto const &collection: {BranchSchema::JetsJECUp(), BranchSchema::JetsJECDown()})
+        {
+            branchNames.insert(collection.sizeName);
+            BranchSchema::ForEachJetField([&](char const *suffix)
+            {
+                branchNames.insert(string(collection.prefix) + suffix);
+            });
+        }
+        
+        BranchSchema::ForEachEventField([&](BranchSchema::EventField const &field)
+        {
+            if (field.group & (bgMETJECUp | bgMETJECDown))
+                branchNames.insert(field.name);
+        });
+    }
+    
+    
+    // Open the source file and create the skim
+    shared_ptr<TFile> srcFile(TFile::Open(srcFileName.c_str()));
+    SkimWriter skim(outFileName);
+    skim.SetBranchesToWrite(branchNames);
+    
+    if (keepJEC)
+        skim.EnableJECVariations();
+    
+    
+    // Loop over all trees
+    for (auto const &group: groups)
+        for (auto const &treeName: group.treeNames)
+        {
+            Reader reader(srcFile, treeName, group.isMC);
+            reader.SetBranchesToRead(branchNames);
+            
+            // Read jets and other branches only for events with a good lepton
+            reader.SetLeptonPreselection([=](LeptonRange const &leptons)
+            {
+                return (leptons.size() == 1 and leptons.front().Pt() >= lepPtThreshold and
+                 fabs(leptons.front().Eta()) <= lepEtaMax);
+            });
+            
+            if (keepJEC)
+                reader.EnableJECVariations();
+            
+            skim.BeginTree(treeName, group.isMC);
+            
+            // Counts jets that pass the kinematic selection
+            auto countJets = [=](JetRange const &jets)
+            {
+                unsigned n = 0;
+                
+                for (auto const &j: jets)
+                    if (j.Pt() >= jetPtThreshold and fabs(j.Eta()) <= jetEtaMax)
+                        ++n;
+                
+                return n;
+            };
+            
+            while (reader.ReadNextEvent())
+            {
+                // With JEC variations kept, an event is saved if it passes the selection for any of
+                //them
+                unsigned nJets = countJets(reader.GetJets(SystType::Nominal, SystDirection::Up));
+                
+                if (keepJEC and group.isMC)
+                    nJets = max({nJets,
+                     countJets(reader.GetJets(SystType::JEC, SystDirection::Up)),
+                     countJets(reader.GetJets(SystType::JEC, SystDirection::Down))});
+                
+                if (nJets >= minNumJets)
+                    skim.Fill(reader);
+            }
+            
+            unsigned long const nSaved = skim.EndTree();
+            cout << "Tree \"" << treeName << "\": " << nSaved << " events saved.\n";
+        }
+    
+    
+    cout << "Done. The skim is saved in the file \"" << outFileName << "\".\n";
+    
+    
+    return EXIT_SUCCESS;
+}
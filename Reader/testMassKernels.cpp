@@ -0,0 +1,100 @@
+/**
+ * Checks that all implementations of MassKernels supported by the CPU give identical results.
+ * 
+ * Random collections of objects of all sizes up to JetKinematics::maxSize are processed with each
+ * implementation in turn, which covers the vectorised loops as well as their scalar remainders.
+ * The program exits with a non-zero code if any result differs from that of the scalar
+ * implementation.
+ */
+
+#include <MassKernels.hpp>
+
+#include <vector>
+#include <random>
+#include <cstring>
+#include <iostream>
+#include <cstdlib>
+
+
+using namespace std;
+
+
+/// Checks if two results of the search are identical, comparing masses bitwise
+bool Identical(MassKernels::PairMatch const &lhs, MassKernels::PairMatch const &rhs)
+{
+    return (lhs.found == rhs.found and lhs.i == rhs.i and lhs.j == rhs.j and
+     memcmp(&lhs.mass, &rhs.mass, sizeof(float)) == 0);
+}
+
+
+int main()
+{
+    // Implementations to compare
+    vector<MassKernels::Isa> isas;
+    
+    for (auto const isa: {MassKernels::Isa::Scalar, MassKernels::Isa::AVX2,
+     MassKernels::Isa::AVX512})
+    {
+        if (MassKernels::IsSupported(isa))
+            isas.push_back(isa);
+        else
+            cout << "Implementation \"" << MassKernels::GetName(isa) << "\" is not supported " <<
+             "by the CPU and is skipped.\n";
+    }
+    
+    
+    // Generate collections of jets with realistic kinematics. Massless pairs are included to
+    //exercise the negative squared masses due to rounding
+    mt19937 generator(12345);
+    exponential_distribution<double> ptDistr(1. / 40.);
+    uniform_real_distribution<double> etaDistr(-2.4, 2.4), phiDistr(-3.14159, 3.14159),
+     massDistr(0., 15.);
+    unsigned const nRepetitions = 200;
+    unsigned nDifferences = 0, nComparisons = 0;
+    
+    for (unsigned rep = 0; rep < nRepetitions; ++rep)
+        for (unsigned n = 0; n <= JetKinematics::maxSize; ++n)
+        {
+            JetKinematics objects;
+            
+            for (unsigned k = 0; k < n; ++k)
+            {
+                double const mass = (k % 5 == 0) ? 0. : massDistr(generator);
+                objects.Add(FourVector(20. + ptDistr(generator), etaDistr(generator),
+                 phiDistr(generator), mass));
+            }
+            
+            float const targetMass = (rep % 2 == 0) ? 80.4f : 0.f;
+            MassKernels::PairMatch reference{};
+            
+            for (unsigned iIsa = 0; iIsa < isas.size(); ++iIsa)
+            {
+                MassKernels::SetIsa(isas[iIsa]);
+                MassKernels::PairMatch const match =
+                 MassKernels::FindBestPair(objects, targetMass, 1e30f);
+                
+                if (iIsa == 0)
+                {
+                    reference = match;
+                    continue;
+                }
+                
+                ++nComparisons;
+                
+                if (not Identical(match, reference))
+                {
+                    ++nDifferences;
+                    cerr << "Implementation \"" << MassKernels::GetName(isas[iIsa]) <<
+                     "\" differs for " << n << " objects: pair (" << match.i << ", " <<
+                     match.j << ") with mass " << match.mass << " instead of (" <<
+                     reference.i << ", " << reference.j << ") with mass " << reference.mass <<
+                     ".\n";
+                }
+            }
+        }
+    
+    
+    cout << nDifferences << " differences in " << nComparisons << " comparisons.\n";
+    
+    return (nDifferences == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,284 @@
+/**
+ * Checks that the event processing in produceNEventsHist_Btagsyt does not allocate memory on the
+ * heap once the reader and the arena have been warmed up.
+ * 
+ * Global operators new and delete are replaced with versions that count calls made by the main
+ * thread while the counting is enabled. The counting covers both Reader::ReadNextEvent and the
+ * event processor. With a flat event file, which is accessed in place, all events after the
+ * warm-up are checked. With a ROOT file, the trees are read one cluster at a time, and the first
+ * event of each cluster is not checked since ROOT fills its cache when it is read. The program
+ * exits with a non-zero code if any allocation has been detected or if too few events have reached
+ * the computation of weights and the reconstruction of top quarks.
+ */
+
+#include <Reader.hpp>
+#include <EventLoop.hpp>
+#include <FlatEventFile.hpp>
+
+#include <TFile.h>
+#include <TH1.h>
+#include <TTree.h>
+
+#include <new>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cmath>
+
+
+using namespace std;
+
+
+/// Indicates whether allocations in the current thread are counted
+static thread_local bool countAllocations = false;
+
+/// Number of allocations counted
+static thread_local unsigned long nAllocations = 0;
+
+
+/// Allocates a block of memory, counting the call if requested
+static void *CountedAlloc(size_t size) noexcept
+{
+    if (countAllocations)
+        ++nAllocations;
+    
+    return malloc(size == 0 ? 1 : size);
+}
+
+
+/**
+ * \brief Releases a block of memory allocated with CountedAlloc
+ * 
+ * The function is not inlined: otherwise GCC sees free applied to memory from operator new and
+ * warns about mismatched allocation functions.
+ */
+__attribute__((noinline)) static void CountedFree(void *p) noexcept
+{
+    free(p);
+}
+
+
+void *operator new(size_t size)
+{
+    void *const p = CountedAlloc(size);
+    
+    if (not p)
+        throw bad_alloc();
+    
+    return p;
+}
+
+
+void *operator new[](size_t size)
+{
+    void *const p = CountedAlloc(size);
+    
+    if (not p)
+        throw bad_alloc();
+    
+    return p;
+}
+
+
+void *operator new(size_t size, nothrow_t const &) noexcept
+{
+    return CountedAlloc(size);
+}
+
+
+void *operator new[](size_t size, nothrow_t const &) noexcept
+{
+    return CountedAlloc(size);
+}
+
+
+void operator delete(void *p) noexcept
+{
+    CountedFree(p);
+}
+
+
+void operator delete[](void *p) noexcept
+{
+    CountedFree(p);
+}
+
+
+void operator delete(void *p, nothrow_t const &) noexcept
+{
+    CountedFree(p);
+}
+
+
+void operator delete[](void *p, nothrow_t const &) noexcept
+{
+    CountedFree(p);
+}
+
+
+// Functions defined in produceNEventsHist_Btagsyt.cpp
+EventLoop::HistSet BookHists(string const &groupName);
+void ProcessEvent(Reader &reader, EventLoop::HistSet &hists);
+
+
+int main(int argc, char **argv)
+{
+    // Parse the command line. Supported options are:
+    //  --input FILE: source file, which can be a ROOT file or a flat event file;
+    //  --tree NAME: tree to read;
+    //  --warm-up N: number of events processed before the counting starts;
+    //  --events N: number of events processed with the counting enabled;
+    //  --min-filled N: minimal number of checked events that reach the computation of weights.
+    string srcFileName("/afs/cern.ch/work/j/jandrea/public/proof_merged.root");
+    string treeName("TTJets");
+    unsigned nWarmUp = 100, nEvents = 500, nMinFilled = 100;
+    
+    for (int i = 1; i < argc; ++i)
+    {
+        string const arg(argv[i]);
+        
+        if (arg == "--input" and i + 1 < argc)
+            srcFileName = argv[++i];
+        else if (arg == "--tree" and i + 1 < argc)
+            treeName = argv[++i];
+        else if (arg == "--warm-up" and i + 1 < argc)
+            nWarmUp = stoul(argv[++i]);
+        else if (arg == "--events" and i + 1 < argc)
+            nEvents = stoul(argv[++i]);
+        else if (arg == "--min-filled" and i + 1 < argc)
+            nMinFilled = stoul(argv[++i]);
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--input FILE] [--tree NAME] [--warm-up N] " <<
+             "[--events N] [--min-filled N]\n";
+            return EXIT_FAILURE;
+        }
+    }
+    
+    
+    TH1::AddDirectory(kFALSE);
+    TH1::SetDefaultSumw2(kTRUE);
+    
+    
+    // Open the source file and split the tree into ranges of entries that are read without
+    //allocations. A flat event file is accessed in place, so the whole tree forms one range, while
+    //a ROOT tree is split into its clusters
+    shared_ptr<TFile> srcFile;
+    shared_ptr<FlatEventFile> flatFile;
+    unique_ptr<Reader> reader;
+    vector<pair<unsigned long, unsigned long>> ranges;
+    
+    if (FlatEventFile::IsFlatFile(srcFileName))
+    {
+        flatFile.reset(new FlatEventFile(srcFileName));
+        reader.reset(new Reader(flatFile, treeName));
+        
+        unsigned long nEntries = 0;
+        
+        for (auto const &block: flatFile->GetTree(treeName).blocks)
+            nEntries = max<unsigned long>(nEntries, block.firstEntry + block.nEvents);
+        
+        ranges.emplace_back(0, nEntries);
+    }
+    else
+    {
+        srcFile.reset(TFile::Open(srcFileName.c_str()));
+        
+        if (not srcFile or srcFile->IsZombie())
+            throw runtime_error("Cannot open file \"" + srcFileName + "\".");
+        
+        unique_ptr<TTree> tree(dynamic_cast<TTree *>(srcFile->Get(treeName.c_str())));
+        
+        if (not tree)
+            throw runtime_error("Cannot find tree \"" + treeName + "\" in file \"" +
+             srcFileName + "\".");
+        
+        Long64_t const nEntries = tree->GetEntries();
+        TTree::TClusterIterator clusterIt = tree->GetClusterIterator(0);
+        Long64_t clusterStart;
+        
+        while ((clusterStart = clusterIt()) < nEntries)
+            ranges.emplace_back(clusterStart, min(clusterIt.GetNextEntry(), nEntries));
+        
+        tree.reset();
+        reader.reset(new Reader(srcFile, treeName));
+    }
+    
+    
+    // Set up the reader in the same way as produceNEventsHist_Btagsyt does
+    reader->SetLeptonPreselection([](LeptonRange const &leptons)
+    {
+        return (leptons.size() == 1 and leptons.front().Pt() >= 26. and
+         fabs(leptons.front().Eta()) <= 2.1);
+    });
+    
+    EventLoop::HistSet hists(BookHists(treeName));
+    
+    
+    // Process the ranges until enough events have been checked. The first histogram is filled
+    //once per event that reaches the computation of weights and the search for the W candidate
+    unsigned nProcessed = 0, nChecked = 0;
+    double nFilled = 0.;
+    
+    for (auto const &range: ranges)
+    {
+        if (nChecked >= nEvents and nFilled >= nMinFilled)
+            break;
+        
+        reader->SetEntryRange(range.first, range.second);
+        bool firstInRange = true;
+        
+        while (true)
+        {
+            // The reading is checked unless it starts a cluster of a ROOT tree
+            bool const check = (nProcessed >= nWarmUp);
+            unsigned long const nAllocationsBefore = nAllocations;
+            countAllocations = (check and (flatFile or not firstInRange));
+            
+            bool const read = reader->ReadNextEvent();
+            countAllocations = false;
+            
+            if (not read)
+            {
+                // The call that finds the end of the range is not a part of the event loop
+                nAllocations = nAllocationsBefore;
+                break;
+            }
+            
+            firstInRange = false;
+            double const nFilledBefore = hists.front()->GetEntries();
+            
+            countAllocations = check;
+            ProcessEvent(*reader, hists);
+            countAllocations = false;
+            
+            ++nProcessed;
+            
+            if (check)
+            {
+                ++nChecked;
+                nFilled += hists.front()->GetEntries() - nFilledBefore;
+                
+                if (nChecked >= nEvents and nFilled >= nMinFilled)
+                    break;
+            }
+        }
+    }
+    
+    
+    cout << nAllocations << " heap allocations in " << nChecked << " events, " << nFilled <<
+     " of which have reached the computation of weights.\n";
+    
+    if (nChecked < nEvents or nFilled < nMinFilled)
+    {
+        cerr << "Too few events have been checked.\n";
+        return EXIT_FAILURE;
+    }
+    
+    return (nAllocations == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}